@@ -0,0 +1,146 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <limits>
+#include <algorithm>
+
+namespace lmu
+{
+	// Axis-aligned box [min, max]. The default box is empty (min > max).
+	struct AABB
+	{
+		AABB() :
+			min(Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity())),
+			max(Eigen::Vector3d::Constant(-std::numeric_limits<double>::infinity()))
+		{
+		}
+
+		AABB(const Eigen::Vector3d& min, const Eigen::Vector3d& max) :
+			min(min),
+			max(max)
+		{
+		}
+
+		static AABB infinite()
+		{
+			return AABB(Eigen::Vector3d::Constant(-std::numeric_limits<double>::infinity()), Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity()));
+		}
+
+		bool isEmpty() const
+		{
+			return (min.array() > max.array()).any();
+		}
+
+		bool isFinite() const
+		{
+			return !isEmpty() && min.allFinite() && max.allFinite();
+		}
+
+		double volume() const
+		{
+			return isEmpty() ? 0.0 : (max - min).prod();
+		}
+
+		AABB merged(const AABB& other) const
+		{
+			return AABB(min.cwiseMin(other.min), max.cwiseMax(other.max));
+		}
+
+		//AABB of the transformed box.
+		AABB transformed(const Eigen::Affine3d& t) const
+		{
+			if (!isFinite())
+				return *this;
+
+			Eigen::Vector3d c = t * (0.5 * (min + max));
+			Eigen::Vector3d e = t.linear().cwiseAbs() * (0.5 * (max - min));
+
+			return AABB(c - e, c + e);
+		}
+
+		//Euclidean distance to the box (0 inside).
+		double distance(const Eigen::Vector3d& p) const
+		{
+			return (min - p).cwiseMax(p - max).cwiseMax(0.0).norm();
+		}
+
+		//Distance to the farthest point of the box.
+		double farthestDistance(const Eigen::Vector3d& p) const
+		{
+			return (p - min).cwiseAbs().cwiseMax((max - p).cwiseAbs()).norm();
+		}
+
+		Eigen::Vector3d min;
+		Eigen::Vector3d max;
+	};
+
+	// Bounds of a signed distance function f that hold everywhere:
+	//   |f(p)| <= outer.farthestDistance(p) + slack,
+	//   f(p) >= scale * inner.distance(p) - slack for p outside of inner.
+	// For primitives, inner and outer are the AABB of the primitive. scale accounts for distances that underestimate 
+	// the euclidean distance (e.g. max() of plane distances) and slack for displacements.
+	// Operations derive both from their children (see CSGNodeOperation::bounds()).
+	struct DistanceBounds
+	{
+		DistanceBounds() :
+			inner(AABB::infinite()),
+			outer(AABB::infinite()),
+			scale(1.0),
+			slack(0.0)
+		{
+		}
+
+		DistanceBounds(const AABB& inner, const AABB& outer, double scale, double slack) :
+			inner(inner),
+			outer(outer),
+			scale(scale),
+			slack(slack)
+		{
+		}
+
+		DistanceBounds(const AABB& box, double scale = 1.0, double slack = 0.0) :
+			inner(box),
+			outer(box),
+			scale(scale),
+			slack(slack)
+		{
+		}
+
+		static DistanceBounds unbounded()
+		{
+			return DistanceBounds();
+		}
+
+		bool isBounded() const
+		{
+			return outer.isFinite();
+		}
+
+		double lowerBound(const Eigen::Vector3d& p) const
+		{
+			double d = inner.distance(p);
+			return d > 0.0 ? scale * d - slack : -(outer.farthestDistance(p) + slack);
+		}
+
+		double upperBound(const Eigen::Vector3d& p) const
+		{
+			return outer.farthestDistance(p) + slack;
+		}
+
+		//Only valid for rigid transforms.
+		DistanceBounds transformed(const Eigen::Affine3d& t) const
+		{
+			return DistanceBounds(inner.transformed(t), outer.transformed(t), scale, slack);
+		}
+
+		AABB inner;
+		AABB outer;
+		double scale;
+		double slack;
+	};
+}
+
+#endif
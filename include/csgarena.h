@@ -0,0 +1,103 @@
+#ifndef CSGARENA_H
+#define CSGARENA_H
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "csgnode.h"
+
+#include <Eigen/Core>
+
+namespace lmu
+{
+	//A CSGNode stored as one contiguous array of nodes in pre-order: the subtree of node i occupies
+	//[i, i + subtreeSize), so the index of a node equals its index for nodePtrAt() and numNodes() is O(1).
+	//Childs are referenced by index, the first two inline (enough for all binary operations), more in a
+	//shared overflow list. Functions are stored once in functions(), names of operations and attributes
+	//only for the nodes that have them.
+
+	struct CSGArenaNode
+	{
+		static const int NumInlineChilds = 2;
+
+		CSGArenaNode(CSGNodeType type, CSGNodeOperationType operationType, int function, int parent) :
+			type(type),
+			operationType(operationType),
+			function(function),
+			parent(parent),
+			subtreeSize(1),
+			numChilds(0),
+			extraChilds(-1)
+		{
+			childs[0] = childs[1] = -1;
+		}
+
+		CSGNodeType type;
+		CSGNodeOperationType operationType;
+		int function;		//Index into CSGArena::functions() for geometry nodes, -1 otherwise
+		int parent;			//-1 for the root
+		int subtreeSize;	//Number of nodes in the subtree (including this node)
+		int numChilds;
+		int childs[NumInlineChilds];
+		int extraChilds;	//Start of childs [NumInlineChilds, numChilds) in the overflow list, -1 if there are none
+	};
+
+	class CSGArena
+	{
+	public:
+
+		CSGArena();
+		explicit CSGArena(const CSGNode& node);
+
+		CSGNode toCSGNode() const;
+		CSGNode toCSGNode(int idx) const;
+
+		//Copy of the subtree at idx and a copy of this tree with the subtree at idx replaced by other.
+		CSGArena subtree(int idx) const;
+		CSGArena replaced(int idx, const CSGArena& other) const;
+
+		bool isValid() const;
+		int root() const;
+
+		int numNodes() const;
+		int numNodes(int idx) const;
+		int depthAt(int idx) const;
+		int depth() const;
+
+		const CSGArenaNode& node(int idx) const;
+		int child(int idx, int i) const;
+		ImplicitFunctionPtr function(int idx) const;
+		std::string name(int idx) const;
+		//nullptr if the node has no attributes.
+		const ICSGNode::Attributes* attributes(int idx) const;
+
+		const std::vector<CSGArenaNode>& nodes() const;
+		const std::vector<ImplicitFunctionPtr>& functions() const;
+
+		double signedDistance(const Eigen::Vector3d& p) const;
+		double signedDistance(int idx, const Eigen::Vector3d& p) const;
+
+		//Same value as CSGNode::hash().
+		size_t hash(size_t seed) const;
+		size_t hash(int idx, size_t seed) const;
+
+	private:
+
+		int append(const CSGNode& node, int parent);
+		int append(const CSGArena& other, int otherIdx, int parent, int replaceIdx = -1, const CSGArena* replacement = nullptr);
+		int addNode(const CSGArenaNode& node);
+		void setChilds(int idx, const std::vector<int>& childs);
+		int functionIndex(const ImplicitFunctionPtr& function);
+
+		std::vector<CSGArenaNode> _nodes;
+		std::vector<int> _extraChilds;
+		std::vector<ImplicitFunctionPtr> _functions;
+		std::unordered_map<ImplicitFunction*, int> _functionLookup;
+
+		std::unordered_map<int, std::string> _names;
+		std::unordered_map<int, ICSGNode::Attributes> _attributes;
+	};
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <atomic>
 
 #include "helper.h"
 
@@ -41,6 +42,27 @@ namespace lmu
 	
 	class CSGNode;
 
+	// Primitive that determines the signed distance of a tree at a point: the tree's distance and gradient are 
+	// sign times the ones of the primitive. node is null if no primitive is involved (e.g. an empty union).
+	struct ActivePrimitive
+	{
+		ActivePrimitive(double distance = 0.0, const ICSGNode* node = nullptr, double sign = 1.0) :
+			distance(distance),
+			node(node),
+			sign(sign)
+		{
+		}
+
+		ActivePrimitive negated() const
+		{
+			return ActivePrimitive(-distance, node, -sign);
+		}
+
+		double distance;
+		const ICSGNode* node;
+		double sign;
+	};
+
 	class ICSGNode
 	{
 	public: 		
@@ -54,6 +76,23 @@ namespace lmu
 		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const = 0;
 		virtual double signedDistance(const Eigen::Vector3d& p) const = 0;
 
+		//Batched evaluation. ps is N x 3 (one point per row), results are N x 4 (distance, gradient) and N x 1.
+		virtual Eigen::MatrixXd signedDistanceAndGradients(const Eigen::MatrixXd& ps, double h = 0.001) const = 0;
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const = 0;
+
+		//Selects the active primitive using distances only. Operations compute gradients just for it.
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const = 0;
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const = 0;
+
+		//Value, gradient and Hessian in one pass through the tree (see HyperDual).
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const = 0;
+
+		//Conservative bound [lo, hi] of the signed distance over the AABB [min, max].
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const = 0;
+
+		//Bounds of the signed distance (see DistanceBounds). Used to skip children that cannot change the result.
+		virtual DistanceBounds bounds() const = 0;
+
 		virtual std::string name() const = 0; 
 
 		virtual CSGNodeType type() const = 0;
@@ -127,6 +166,18 @@ namespace lmu
 		{	
 		}
 
+		//Copies the childs (which share their subtrees, see CSGNode) and the cached bounds.
+		CSGNodeOperation(const CSGNodeOperation& other) :
+			CSGNodeBase(other),
+			_childs(other._childs)
+		{
+			if (other._boundsState.load(std::memory_order_acquire) == BoundsValid)
+			{
+				_bounds = other._bounds;
+				_boundsState.store(BoundsValid, std::memory_order_relaxed);
+			}
+		}
+
 		virtual ImplicitFunctionPtr function() const override 
 		{
 			return nullptr;
@@ -141,8 +192,10 @@ namespace lmu
 			return _childs;
 		}
 
+		//Childs may be changed through the reference, the cached bounds are recomputed on the next call of bounds().
 		virtual std::vector<CSGNode>& childsRef() override
 		{
+			_boundsState.store(BoundsInvalid, std::memory_order_relaxed);
 			return _childs;
 		}
 
@@ -157,14 +210,44 @@ namespace lmu
 				return false; 
 
 			_childs.push_back(child);
+			_boundsState.store(BoundsInvalid, std::memory_order_relaxed);
 
 			return true;
 		}
 
+		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const override;
+		virtual Eigen::MatrixXd signedDistanceAndGradients(const Eigen::MatrixXd& ps, double h = 0.001) const override;
+
+		//Subtrees are shared between trees that are ranked in parallel. Only the thread that starts the computation
+		//writes the cache, the others use their own result.
+		virtual DistanceBounds bounds() const override
+		{
+			if (_boundsState.load(std::memory_order_acquire) == BoundsValid)
+				return _bounds;
+
+			DistanceBounds bounds = computeBounds();
+
+			int expected = BoundsInvalid;
+			if (_boundsState.compare_exchange_strong(expected, BoundsComputing, std::memory_order_acquire))
+			{
+				_bounds = bounds;
+				_boundsState.store(BoundsValid, std::memory_order_release);
+			}
+
+			return bounds;
+		}
+
 		virtual size_t hash(size_t seed) const override;
 
 	protected: 
+		virtual DistanceBounds computeBounds() const = 0;
+
 		std::vector<CSGNode> _childs;
+
+		enum { BoundsInvalid, BoundsComputing, BoundsValid };
+
+		mutable DistanceBounds _bounds;
+		mutable std::atomic<int> _boundsState{ BoundsInvalid };
 	};
 
 	class CSGNodeGeometry : public CSGNodeBase
@@ -202,6 +285,48 @@ namespace lmu
 			return _function->signedDistance(p);
 		}
 
+		virtual Eigen::MatrixXd signedDistanceAndGradients(const Eigen::MatrixXd& ps, double h = 0.001) const override
+		{
+			return _function->signedDistanceAndGradients(ps, h);
+		}
+
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override
+		{
+			return _function->signedDistances(ps);
+		}
+
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override
+		{
+			return ActivePrimitive(_function->signedDistance(p), this);
+		}
+
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override
+		{
+			Eigen::VectorXd ds = _function->signedDistances(ps);
+
+			std::vector<ActivePrimitive> res;
+			res.reserve(ds.size());
+			for (int i = 0; i < ds.size(); ++i)
+				res.push_back(ActivePrimitive(ds(i), this));
+
+			return res;
+		}
+
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override
+		{
+			return _function->signedDistanceDerivatives(p, h);
+		}
+
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override
+		{
+			return _function->signedDistanceInterval(min, max);
+		}
+
+		virtual DistanceBounds bounds() const override
+		{
+			return _function->bounds();
+		}
+
 		virtual std::vector<CSGNode> childs() const override
 		{
 			return _childs;
@@ -259,7 +384,10 @@ namespace lmu
 	std::vector<ImplicitFunctionPtr> allDistinctFunctions(const CSGNode& node);
 
 	void visit(const CSGNode& node, const std::function<void(const CSGNode& node)>& f);
+	//Accesses all childs mutably, so a shared tree is copied completely. Read-only visits have to pass the node as const.
 	void visit(CSGNode& node, const std::function<void(CSGNode& node)>& f);
+	//Calls f for the nodes that match. Only the paths to them are accessed mutably (copied if the tree is shared).
+	void visit(CSGNode& node, const std::function<bool(const CSGNode& node)>& match, const std::function<void(CSGNode& node)>& f);
 
 	class CSGNode : public ICSGNode 
 	{
@@ -280,6 +408,7 @@ namespace lmu
 		template<typename T>
 		void setAttribute(const std::string& name, const T& value)
 		{
+			detach();
 			_node->attributesRef()[name] = value;
 		}
 
@@ -288,19 +417,12 @@ namespace lmu
 		{
 		}
 
-		CSGNode(const CSGNode& node) :
-			_node(node.clone())
-		{
-			//std::cout << "Copy" << std::endl;
-		}
-
-		CSGNode& operator = (const CSGNode& other)
-		{
-			if (this != &other) 
-				_node = other.clone();
-
-			return *this;
-		}
+		//Copies share the node (copy-on-write). Non-const access (childsRef(), addChild(), setFunction(), attributes) 
+		//copies a shared node first. The copy shares its childs, so changing a node reached from the root through 
+		//childsRef() only copies the path to it (see nodePtrAt()). 
+		//Note that pointers and references into a tree must not be used for changes after the tree was copied.
+		CSGNode(const CSGNode& node) = default;
+		CSGNode& operator = (const CSGNode& other) = default;
 
 		inline virtual CSGNodePtr clone() const override final
 		{
@@ -317,6 +439,41 @@ namespace lmu
 			return _node->signedDistance(p);
 		}
 
+		inline virtual Eigen::MatrixXd signedDistanceAndGradients(const Eigen::MatrixXd& ps, double h = 0.001) const override final
+		{
+			return _node->signedDistanceAndGradients(ps, h);
+		}
+
+		inline virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override final
+		{
+			return _node->signedDistances(ps);
+		}
+
+		inline virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override final
+		{
+			return _node->activePrimitive(p);
+		}
+
+		inline virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override final
+		{
+			return _node->activePrimitives(ps);
+		}
+
+		inline virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override final
+		{
+			return _node->signedDistanceDerivatives(p, h);
+		}
+
+		inline virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override final
+		{
+			return _node->signedDistanceInterval(min, max);
+		}
+
+		inline virtual DistanceBounds bounds() const override final
+		{
+			return _node->bounds();
+		}
+
 		inline virtual std::string name() const override final
 		{
 			return _node->name(); 
@@ -339,6 +496,7 @@ namespace lmu
 
 		inline virtual bool addChild(const CSGNode& child) override final
 		{
+			detach();
 			return _node->addChild(child);
 		}
 
@@ -354,6 +512,7 @@ namespace lmu
 
 		inline virtual void setFunction(const ImplicitFunctionPtr& f) override final
 		{
+			detach();
 			_node->setFunction(f);
 		}
 
@@ -369,11 +528,13 @@ namespace lmu
 
 		inline virtual std::vector<CSGNode>& childsRef() override final
 		{
+			detach();
 			return _node->childsRef();
 		}
 
 		virtual Attributes& attributesRef() override
 		{
+			detach();
 			return _node->attributesRef();
 		}
 
@@ -421,6 +582,12 @@ namespace lmu
 		static const CSGNode invalidNode;
 
 	private: 
+		void detach()
+		{
+			if (_node && _node.use_count() > 1)
+				_node = _node->clone();
+		}
+
 		CSGNodePtr _node;
 	};
 
@@ -433,11 +600,17 @@ namespace lmu
 		}
 
 		virtual CSGNodePtr clone() const override;
-		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const override;
 		virtual double signedDistance(const Eigen::Vector3d& p) const override;
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override;
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override;
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override;
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override;
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override;
 		virtual CSGNodeOperationType operationType() const override;
 		virtual std::tuple<int, int> numAllowedChilds() const override;
 		virtual Mesh mesh() const override;
+	protected:
+		virtual DistanceBounds computeBounds() const override;
 	};
 
 	class IntersectionOperation : public CSGNodeOperation
@@ -449,11 +622,17 @@ namespace lmu
 		}
 
 		virtual CSGNodePtr clone() const override;
-		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const override;
 		virtual double signedDistance(const Eigen::Vector3d& p) const override;
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override;
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override;
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override;
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override;
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override;
 		virtual CSGNodeOperationType operationType() const override;
 		virtual std::tuple<int, int> numAllowedChilds() const override;
 		virtual Mesh mesh() const override;
+	protected:
+		virtual DistanceBounds computeBounds() const override;
 	};
 
 	class DifferenceOperation : public CSGNodeOperation
@@ -465,11 +644,17 @@ namespace lmu
 		}
 
 		virtual CSGNodePtr clone() const override;
-		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const override;
 		virtual double signedDistance(const Eigen::Vector3d& p) const override;
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override;
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override;
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override;
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override;
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override;
 		virtual CSGNodeOperationType operationType() const override;
 		virtual std::tuple<int, int> numAllowedChilds() const override;
 		virtual Mesh mesh() const override;
+	protected:
+		virtual DistanceBounds computeBounds() const override;
 	};
 
 	class ComplementOperation : public CSGNodeOperation
@@ -481,11 +666,17 @@ namespace lmu
 		}
 
 		virtual CSGNodePtr clone() const override;
-		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const override;
 		virtual double signedDistance(const Eigen::Vector3d& p) const override;
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override;
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override;
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override;
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override;
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override;
 		virtual CSGNodeOperationType operationType() const override;
 		virtual std::tuple<int, int> numAllowedChilds() const override;
 		virtual Mesh mesh() const override;
+	protected:
+		virtual DistanceBounds computeBounds() const override;
 	};
 
 	class IdentityOperation : public CSGNodeOperation
@@ -497,11 +688,17 @@ namespace lmu
 		}
 
 		virtual CSGNodePtr clone() const override;
-		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const override;
 		virtual double signedDistance(const Eigen::Vector3d& p) const override;
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override;
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override;
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override;
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override;
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override;
 		virtual CSGNodeOperationType operationType() const override;
 		virtual std::tuple<int, int> numAllowedChilds() const override;
 		virtual Mesh mesh() const override;
+	protected:
+		virtual DistanceBounds computeBounds() const override;
 	};
 
 	class NoOperation : public CSGNodeOperation
@@ -512,11 +709,17 @@ namespace lmu
 		{
 		}
 		virtual CSGNodePtr clone() const override;
-		virtual Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& p, double h = 0.001) const override;
 		virtual double signedDistance(const Eigen::Vector3d& p) const override;
+		virtual Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const override;
+		virtual ActivePrimitive activePrimitive(const Eigen::Vector3d& p) const override;
+		virtual std::vector<ActivePrimitive> activePrimitives(const Eigen::MatrixXd& ps) const override;
+		virtual HyperDual signedDistanceDerivatives(const Eigen::Vector3d& p, double h = 0.001) const override;
+		virtual Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const override;
 		virtual CSGNodeOperationType operationType() const override;
 		virtual std::tuple<int, int> numAllowedChilds() const override;
 		virtual Mesh mesh() const override;
+	protected:
+		virtual DistanceBounds computeBounds() const override;
 	};
 	
 	CSGNode createOperation(CSGNodeOperationType type, const std::string& name = std::string(), const std::vector<CSGNode>& childs = {});
@@ -595,10 +798,27 @@ namespace lmu
 	MergeResult mergeNodes(const CommonSubgraph& lcs, bool allowIntersections);
 	
 	Mesh computeMesh(const CSGNode& node, const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min = Eigen::Vector3d(0.0, 0.0, 0.0), 
-		const Eigen::Vector3d& max = Eigen::Vector3d(0.0, 0.0, 0.0));
+		const Eigen::Vector3d& max = Eigen::Vector3d(0.0, 0.0, 0.0), Precision precision = Precision::Double);
+
+	// Same mesh as computeMesh(), streamed to an OBJ file (see marchingCubesToOBJ()). Memory grows with the size of a grid layer,
+	// so it is meant for resolutions whose grid does not fit into memory. Returns the number of triangles.
+	int64_t computeMeshToOBJ(const CSGNode& node, const Eigen::Vector3i& numSamples, const std::string& file, const Eigen::Vector3d& min = Eigen::Vector3d(0.0, 0.0, 0.0), 
+		const Eigen::Vector3d& max = Eigen::Vector3d(0.0, 0.0, 0.0), Precision precision = Precision::Double);
+
+	// Same sampling grid as computeMesh(), but only the cells in the leaves of an octree whose interval bounds contain
+	// the surface are evaluated (each leaf with the tree pruned to it) and polygonized with marching tetrahedra. 
+	// Memory and evaluations grow with the surface area instead of the volume. The mesh is closed where the surface 
+	// does not leave [min, max] and its triangles face outwards.
+	Mesh computeMeshAdaptive(const CSGNode& node, const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min = Eigen::Vector3d(0.0, 0.0, 0.0), 
+		const Eigen::Vector3d& max = Eigen::Vector3d(0.0, 0.0, 0.0), Precision precision = Precision::Double);
 	
 	int optimizeCSGNodeStructure(CSGNode& node);
 
+	// Tree with the signed distances of node inside the world space AABB [min, max]: childs of unions (intersections) whose
+	// interval bounds are above (below) the bounds of another child by more than tolerance (relative) are removed, and differences 
+	// that provably result in one of their operands are replaced by it. Unchanged subtrees are shared with node.
+	CSGNode pruneCSGNode(const CSGNode& node, const Eigen::Vector3d& min, const Eigen::Vector3d& max, double tolerance = 1e-9);
+
 	void optimizeCSGNode(CSGNode& node, double tolerance);
 
 	void convertToTreeWithMaxNChilds(CSGNode& node, int n);
@@ -0,0 +1,110 @@
+#ifndef CSGNODE_CACHE_H
+#define CSGNODE_CACHE_H
+
+#include <vector>
+#include <memory>
+#include <list>
+#include <mutex>
+#include <cstdint>
+#include <unordered_map>
+
+#include "csgnode.h"
+#include "evolution.h"
+
+#include <Eigen/Core>
+
+namespace lmu
+{
+	class PrecomputedPrimitives;
+
+	//Bounded (least recently used) cache of the per-point results of CSG subtrees for a fixed set of points.
+	//A result has one row per point: the distance, and the gradient if the cache stores gradients.
+	//Subtrees are keyed by their structure: a function, or an operation type and the entries of its childs in operand order.
+	//So a tree that differs from an already evaluated one in a single subtree only evaluates that subtree and the path to the root.
+	//Results are identical to CSGTape::signedDistanceAndGradients() (or CSGTape::signedDistances()).
+	//maxBytes bounds the results and the keys. Entries hold their functions, so function addresses are never reused for other keys.
+	//Can be used from several threads.
+	class CSGNodeResultCache
+	{
+	public:
+
+		using Result = std::shared_ptr<const Eigen::MatrixXd>;
+
+		//ps is N x 3 (one point per row), maxBytes is the maximum size of all cached results.
+		//Results of the functions contained in primitives (computed for the same points, h and precision) are taken from them.
+		CSGNodeResultCache(const Eigen::MatrixXd& ps, double h, Precision precision, size_t maxBytes, bool gradients = true, 
+			const std::shared_ptr<const PrecomputedPrimitives>& primitives = nullptr);
+
+		Result evaluate(const CSGNode& node);
+
+		CacheStatistics statistics() const;
+		void clear();
+
+	private:
+
+		//Key of a single node. Childs are referred to by the ids of their entries, so a key has the size of the node.
+		//Ids are never reused: if a child entry is evicted, the keys of its parents are not found anymore.
+		struct Key
+		{
+			CSGNodeType type;
+			CSGNodeOperationType operationType;
+			const ImplicitFunction* function;
+			std::vector<std::uint64_t> childs;
+
+			bool operator==(const Key& other) const;
+		};
+
+		struct KeyHash
+		{
+			size_t operator()(const Key& key) const;
+		};
+
+		struct Entry
+		{
+			std::uint64_t id;
+			Result result;
+			ImplicitFunctionPtr function;
+			size_t numBytes;
+			std::list<const Key*>::iterator lruPosition;
+		};
+
+		struct Subtree
+		{
+			const CSGNode* node;
+			Key key;
+			bool isComplete; //All childs have entries, so the key can be looked up.
+			std::vector<int> childs; //Indices of the child subtrees in operand order.
+		};
+
+		struct Evaluation
+		{
+			std::uint64_t id;
+			Result result;
+		};
+
+		int computeKeys(const CSGNode& node, std::vector<Subtree>& subtrees);
+		Evaluation evaluate(std::vector<Subtree>& subtrees, int idx);
+		Result compute(const std::vector<Subtree>& subtrees, const std::vector<Result>& childResults, int idx);
+		Result constant(double value) const;
+
+		std::uint64_t findId(const Key& key) const;
+		Evaluation find(const Key& key);
+		std::uint64_t insert(const Key& key, const Result& result, const ImplicitFunctionPtr& function);
+
+		Eigen::MatrixXd _ps;
+		Eigen::MatrixXf _psFloat; //_ps converted once for Precision::Float.
+		double _h;
+		Precision _precision;
+		size_t _maxBytes;
+		int _numCols;
+		std::shared_ptr<const PrecomputedPrimitives> _primitives;
+
+		std::unordered_map<Key, Entry, KeyHash> _entries;
+		std::uint64_t _nextId;
+		std::list<const Key*> _lru;
+		CacheStatistics _statistics;
+		mutable std::mutex _mutex;
+	};
+}
+
+#endif
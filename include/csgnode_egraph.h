@@ -0,0 +1,115 @@
+#ifndef CSGNODE_EGRAPH_H
+#define CSGNODE_EGRAPH_H
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "csgnode.h"
+
+namespace lmu
+{
+	enum class CSGNodeCost
+	{
+		NumNodes,
+		Evaluation	//Estimated operations per point, a primitive counts as CSGEGraph::PrimitiveCost operations
+	};
+
+	struct CSGENode
+	{
+		enum class Op
+		{
+			Geometry,
+			Union,
+			Intersection,
+			Difference,
+			Complement,
+			Empty,		//NoOperation
+			Universe	//Complement of NoOperation
+		};
+
+		CSGENode(Op op, const std::vector<int>& childs = {}, int function = -1) :
+			op(op),
+			function(function),
+			childs(childs)
+		{
+		}
+
+		bool operator==(const CSGENode& other) const
+		{
+			return op == other.op && function == other.function && childs == other.childs;
+		}
+
+		Op op;
+		int function;				//Index into the functions of the e-graph for geometry nodes, -1 otherwise
+		std::vector<int> childs;	//e-classes, sorted and unique for unions and intersections
+	};
+
+	struct CSGENodeHash
+	{
+		size_t operator()(const CSGENode& node) const;
+	};
+
+	//E-graph of a CSG tree: every e-class is a set of equivalent nodes whose childs are e-classes.
+	//saturate() applies Boolean-algebra identities and merges the e-classes they prove equal:
+	//associativity (flattening), commutativity and idempotence (by sorting and deduplicating childs), absorption,
+	//De Morgan, double complement elimination, difference as intersection with a complement and the identities of empty and universe.
+	//These keep the signed distances (min, max and negation). Contradiction (x & !x = empty, x - x = empty) and excluded middle
+	//(x | !x = universe) only hold for the point sets (max(x, -x) = |x|), they are only applied with setIdentities.
+	//extract() returns the cheapest tree of the root e-class. Operands of unions and intersections keep the order of the input tree,
+	//so ties between them are resolved as before.
+	class CSGEGraph
+	{
+	public:
+
+		static const int PrimitiveCost = 8;
+
+		explicit CSGEGraph(const CSGNode& node, bool setIdentities = false);
+
+		//Returns the number of iterations. Stops if nothing changed, after maxIterations or if there are more than maxNodes nodes.
+		int saturate(int maxIterations, int maxNodes);
+
+		CSGNode extract(CSGNodeCost cost) const;
+
+		int root() const;
+		int numClasses() const;
+		int numNodes() const;
+
+		static double cost(const CSGNode& node, CSGNodeCost cost);
+
+	private:
+
+		int add(const CSGNode& node);
+		int addInput(const CSGNode& node);
+		int add(CSGENode node);
+		int find(int c) const;
+		bool merge(int c0, int c1);
+		void rebuild();
+		bool canonicalize(CSGENode& node) const;
+		bool applyRules();
+
+		//Copies, adding nodes invalidates references into the e-classes.
+		std::vector<CSGENode> nodes(int c, CSGENode::Op op) const;
+		int emptyClass();
+		int universeClass();
+
+		static double nodeCost(const CSGENode& node, const std::vector<double>& childCosts, CSGNodeCost cost);
+
+		mutable std::vector<int> _parents;
+		std::vector<std::vector<CSGENode>> _classes;
+		std::unordered_map<CSGENode, int, CSGENodeHash> _memo;
+		std::vector<ImplicitFunctionPtr> _functions;
+		std::unordered_map<ImplicitFunction*, int> _functionLookup;
+		std::vector<int> _positions; //Pre-order position of the first node of the input tree in each e-class, max() for e-classes added by rules.
+		int _numInputNodes;
+		int _root;
+		int _numMerges;
+		bool _setIdentities;
+	};
+
+	//Cheapest tree that is equivalent to node under the identities of CSGEGraph. Returns node if no tree is cheaper.
+	//Without setIdentities, the result has the same signed distances as node.
+	CSGNode optimizeCSGNodeWithEGraph(const CSGNode& node, CSGNodeCost cost = CSGNodeCost::NumNodes, int maxIterations = 8, int maxNodes = 5000, bool setIdentities = false);
+}
+
+#endif
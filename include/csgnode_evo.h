@@ -8,6 +8,10 @@
 #include "evolution.h"
 #include "congraph.h"
 #include "params.h"
+#include "csgnode_pool.h"
+#include "csgnode_cache.h"
+#include "csgnode_egraph.h"
+#include "csgtape.h"
 
 #include <Eigen/Core>
 
@@ -17,18 +21,23 @@ namespace lmu
 
 	struct CSGNodeRanker
 	{
-		CSGNodeRanker(double lambda, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions, const lmu::Graph& connectionGraph = lmu::Graph());
+		// subtreeCacheSize is the maximum size (in bytes) of the cached per-subtree results of rank(node), 0 disables the cache.
+		// primitivesBudget is the maximum size (in bytes) of the distances and gradients of all functions at all points, precomputed
+		// for rank(node) (see PrecomputedPrimitives). If they need more, the functions are evaluated per tree. 0 disables precomputation.
+		CSGNodeRanker(double lambda, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions, const lmu::Graph& connectionGraph = lmu::Graph(), Precision precision = Precision::Double, size_t subtreeCacheSize = 0, size_t primitivesBudget = 0);
 
 		double rank(const CSGNode& node) const;
 		double rank(const CSGNode& node, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions) const;
 
 		std::string info() const;
+		CacheStatistics cacheStatistics() const;
 
 		bool treeIsInvalid(const lmu::CSGNode& node) const;
 
 	private:
 
 		double computeEpsilonScale();
+		double computeGeometryScore(const Eigen::MatrixXd& distAndGrads) const;
 		double _h;
 		double _lambda;
 		std::vector<std::shared_ptr<lmu::ImplicitFunction>> _functions;
@@ -37,6 +46,17 @@ namespace lmu
 		double _epsilonScale;
 		double _epsilon;
 		double _alpha;
+		Precision _precision;
+
+		//Both hold the points of all functions and are shared by copies of the ranker.
+		std::shared_ptr<CSGNodeResultCache> _subtreeCache;
+		std::shared_ptr<const PrecomputedPrimitives> _primitives;
+
+		//Positions of the points of each function, converted once for Precision::Float (shared by copies of the ranker).
+		std::shared_ptr<const std::unordered_map<ImplicitFunction*, Eigen::MatrixXf>> _floatPoints;
+
+		//Primitives of all functions, converted once for the tapes of rank() (shared by copies of the ranker).
+		std::shared_ptr<const PrimitiveSet> _primitiveSet;
 	};
 
 	using MappingFunction = std::function<double(double)>;
@@ -85,7 +105,7 @@ namespace lmu
 
 	struct CSGNodePopMan
 	{	
-		CSGNodePopMan(double optimizationProb, double preOptimizationProb, int maxFunctions, int nodeSelectionTries, int randomIterations, CSGNodeOptimization type, const lmu::CSGNodeRanker& ranker, const lmu::Graph& connectionGraph);
+		CSGNodePopMan(double optimizationProb, double preOptimizationProb, int maxFunctions, int nodeSelectionTries, int randomIterations, CSGNodeOptimization type, const lmu::CSGNodeRanker& ranker, const lmu::Graph& connectionGraph, bool useEGraph = false);
 
 		void manipulateBeforeRanking(std::vector<RankedCreature<CSGNode>>& population) const;
 		void manipulateAfterRanking(std::vector<RankedCreature<CSGNode>>& population) const;
@@ -103,7 +123,9 @@ namespace lmu
 		lmu::Graph _connectionGraph;
 		CSGNodeOptimization _type;
 		int _randomIterations;
+		bool _useEGraph;
 		mutable std::unordered_map<size_t, CSGNode> _nodeLookup;
+		mutable CSGNodePool _pool;
 
 		mutable std::default_random_engine _rndEngine;
 		mutable std::random_device _rndDevice;
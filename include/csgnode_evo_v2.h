@@ -72,6 +72,7 @@ namespace lmu
 
 		double rank(const CSGNode& node) const;
 		std::string info() const;
+		CacheStatistics cacheStatistics() const;
 
 		double computeGeometryScore(const CSGNode& node, const std::vector<ImplicitFunctionPtr>& funcs) const;
 
@@ -0,0 +1,64 @@
+#ifndef CSGNODE_JIT_H
+#define CSGNODE_JIT_H
+
+#include <string>
+#include <memory>
+
+#include "csgnode.h"
+
+#include <Eigen/Core>
+
+namespace lmu
+{
+	// Native evaluator of a CSG tree, loaded from a shared object built by CSGNodeCompiler.
+	// Evaluates the same instructions as CSGTape, with the primitive parameters and transforms as constants.
+	class CompiledCSGNode
+	{
+	public:
+
+		// ps is N x 3 (one point per row). Results are the distances of CSGTape::signedDistances() up to rounding
+		// (the compiler may contract and reorder the primitive formulas).
+		Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const;
+
+		const std::string& libraryPath() const;
+
+	private:
+
+		friend class CSGNodeCompiler;
+
+		using Function = void(*)(const double* x, const double* y, const double* z, int n, double* out);
+
+		CompiledCSGNode(const std::string& libraryPath, const std::shared_ptr<void>& library, Function function);
+
+		std::string _libraryPath;
+		std::shared_ptr<void> _library;
+		Function _function;
+	};
+
+	// Emits C++ for a tree, compiles it with the system compiler into a shared object and loads it.
+	// Shared objects are cached in cacheDir by the hash of the compiled unit (the compiler and flags, sdf_primitives.h and the
+	// emitted source, which contains the whole tree with all primitive parameters), so the same tree is only compiled once, also across runs.
+	// The unit is stored next to the shared object and compared before loading, a hash collision compiles again.
+	// Only available on platforms with dlopen (see CSG_PLAYGROUND_JIT), compile() throws otherwise.
+	// Compiled trees only evaluate distances: the ranker (which needs gradients) and the tiled evaluation use CSGTape.
+	class CSGNodeCompiler
+	{
+	public:
+
+		CSGNodeCompiler(const std::string& cacheDir, const std::string& compiler = "c++", const std::string& flags = "-O3 -march=native");
+
+		// Throws if the tree contains functions without a value representation (see Primitive) or if compiling fails.
+		std::shared_ptr<CompiledCSGNode> compile(const CSGNode& node) const;
+
+		static std::string generateSource(const CSGNode& node);
+		static bool isAvailable();
+
+	private:
+
+		std::string _cacheDir;
+		std::string _compiler;
+		std::string _flags;
+	};
+}
+
+#endif
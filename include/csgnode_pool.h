@@ -0,0 +1,65 @@
+#ifndef CSGNODE_POOL_H
+#define CSGNODE_POOL_H
+
+#include <vector>
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+
+#include "csgnode.h"
+
+namespace lmu
+{
+	//Interning table for CSG nodes (hash-consing). Interned trees are DAGs over the nodes of the pool:
+	//each distinct structure (node class, operation type, function and interned childs - the same things
+	//CSGNode::hash() looks at) and name exists only once and is shared by all trees that contain it.
+	//Two interned nodes have the same structure iff they share the same node (nodePtr()), and id() is a stable
+	//identity that caches can key on. Attributes are taken from the node that was interned first.
+	//Interned nodes are never changed: changing a tree that contains them copies the changed path (see CSGNode).
+	//The pool holds a reference to each node, so changing an interned tree always copies the path.
+	class CSGNodePool
+	{
+	public:
+
+		//Returns the interned node with the structure of node. An invalid node is returned unchanged.
+		CSGNode intern(const CSGNode& node);
+
+		//Id of an interned node, -1 if the node is not part of the pool.
+		int id(const CSGNode& node) const;
+
+		//Removes all nodes that are only referenced by the pool. Ids of the remaining nodes stay valid.
+		void prune();
+		//prune() visits the whole pool. This only calls it once the pool doubled since the last pruning.
+		void pruneIfGrown();
+		void clear();
+
+		int size() const;
+
+	private:
+
+		struct Key
+		{
+			std::type_index nodeClass;
+			CSGNodeOperationType operationType;
+			const ImplicitFunction* function;
+			std::string name;
+			std::vector<int> childs;
+
+			bool operator==(const Key& other) const;
+		};
+
+		struct KeyHash
+		{
+			size_t operator()(const Key& key) const;
+		};
+
+		std::unordered_map<Key, int, KeyHash> _ids;
+		std::unordered_map<const ICSGNode*, int> _nodeIds;
+		std::unordered_map<int, CSGNodePtr> _nodes;
+		std::unordered_map<int, Key> _keys;
+		int _nextId = 0;
+		int _sizeAfterPrune = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef CSGTAPE_H
+#define CSGTAPE_H
+
+#include <vector>
+#include <memory>
+
+#include "csgnode.h"
+#include "primitive_set.h"
+
+#include <Eigen/Core>
+
+namespace lmu
+{
+	// A CSGNode lowered to a linear list of register instructions (postfix order).
+	// Nested unions and intersections are flattened into a single accumulation.
+	// All primitive leaves are evaluated first (each distinct function only once, distances grouped by type, see PrimitiveSet),
+	// the instructions then only combine whole columns of the register file.
+
+	enum class CSGTapeOpCode
+	{
+		Load,		// r[dst] = primitive[src]
+		Const,		// r[dst] = value, gradient 0
+		Min,		// r[dst] = r[src] < r[dst] ? r[src] : r[dst]
+		Max,		// r[dst] = r[src] > r[dst] ? r[src] : r[dst]
+		MaxNeg,		// r[dst] = r[dst] > -r[src] ? r[dst] : -r[src] (difference)
+		Neg			// r[dst] = -r[dst]
+	};
+
+	struct CSGTapeInstruction
+	{
+		CSGTapeInstruction(CSGTapeOpCode op, int dst, int src = 0, double value = 0.0) :
+			op(op),
+			dst(dst),
+			src(src),
+			value(value)
+		{
+		}
+
+		CSGTapeOpCode op;
+		int dst;
+		int src;
+		double value;
+	};
+
+	class PrecomputedPrimitives;
+
+	class CSGTape
+	{
+	public:
+
+		// Primitives that primitives holds are not converted again (see PrimitiveSet).
+		explicit CSGTape(const CSGNode& node, const PrimitiveSet& primitives = PrimitiveSet());
+
+		// ps is N x 3 (one point per row). Results are identical to CSGNode::signedDistances() and CSGNode::signedDistanceAndGradients().
+		Eigen::VectorXd signedDistances(const Eigen::MatrixXd& ps) const;
+		Eigen::MatrixXd signedDistanceAndGradients(const Eigen::MatrixXd& ps, double h = 0.001) const;
+
+		// Scalar is double or float (see Precision).
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistances(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps) const;
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> signedDistanceAndGradients(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps, double h = 0.001) const;
+
+		// Evaluates the tape for the points of primitives without evaluating any primitive. All primitives of the tape must be contained.
+		Eigen::MatrixXd signedDistanceAndGradients(const PrecomputedPrimitives& primitives) const;
+
+		const std::vector<CSGTapeInstruction>& instructions() const;
+		const std::vector<ImplicitFunctionPtr>& primitives() const;
+		const PrimitiveSet& primitiveSet() const;
+		int numRegisters() const;
+
+		std::string info() const;
+
+	private:
+
+		void compile(const CSGNode& node, int reg);
+		void compileAccumulation(const CSGNode& node, int reg);
+		int primitiveIndex(const ImplicitFunctionPtr& function);
+
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> execute(const std::vector<Eigen::Ref<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>>>& prims, int numPoints) const;
+
+		std::vector<CSGTapeInstruction> _instructions;
+		std::vector<ImplicitFunctionPtr> _primitives;
+		std::unordered_map<ImplicitFunction*, int> _primitiveLookup;
+		PrimitiveSet _primitiveSet;
+		int _numRegisters;
+	};
+
+	// Distances and gradients of functions at fixed points, computed once (N x 4 columns per function).
+	// A tree over these functions is then evaluated with CSGTape::signedDistanceAndGradients(primitives) only.
+	class PrecomputedPrimitives
+	{
+	public:
+
+		// ps is N x 3 (one point per row). Results are computed in the given precision and stored as double.
+		PrecomputedPrimitives(const std::vector<ImplicitFunctionPtr>& functions, const Eigen::MatrixXd& ps, double h, Precision precision = Precision::Double);
+
+		// Size (in bytes) of the results for numFunctions functions and numPoints points.
+		static size_t memoryEstimate(int numFunctions, int numPoints);
+
+		bool contains(const ImplicitFunctionPtr& function) const;
+		bool contains(const CSGTape& tape) const;
+
+		Eigen::Ref<const Eigen::MatrixXd> signedDistanceAndGradients(const ImplicitFunctionPtr& function) const;
+
+		int numPoints() const;
+		size_t memory() const;
+
+	private:
+
+		Eigen::MatrixXd _results;
+		std::unordered_map<ImplicitFunction*, int> _indices;
+	};
+
+	// Evaluates spatially coherent points (grids, sorted point clouds) tile by tile: points are bucketed into cubes with edge length
+	// tileSize and each tile is evaluated with the tape of the tree pruned to the bounding box of its points (see pruneCSGNode()).
+	// ps is N x 3 (one point per row). Results are the same as CSGTape(node).signedDistances(ps).
+	template<typename Scalar>
+	Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistancesTiled(const CSGNode& node, const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps, double tileSize);
+
+	double computeGeometryScore(const CSGTape& tape, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs);
+
+	// distAndGrads has one row (distance and gradient) per row of points (position and normal).
+	double computeGeometryScore(const Eigen::Ref<const Eigen::MatrixXd>& distAndGrads, const PointCloud& points, double epsilon, double alpha);
+	double computeGeometryScore(const Eigen::Ref<const Eigen::MatrixXf>& distAndGrads, const PointCloud& points, double epsilon, double alpha);
+}
+
+#endif
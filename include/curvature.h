@@ -120,6 +120,10 @@ namespace lmu
 		double k2; 
 	};
 
+	Curvature curvature(const HyperDual& d);
+
+	//Uses one pass through the tree (see ICSGNode::signedDistanceDerivatives()) and the gradients at ps +- h along each axis. 
+	//Close to kinks (e.g. edges of boxes), the Hessian is estimated from these gradients, so edges show up as curvature outliers.
 	Curvature curvature(const Eigen::Vector3d& ps, const CSGNode& node, double h);
 
 	enum class FilterBehavior
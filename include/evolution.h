@@ -22,6 +22,21 @@
 
 namespace lmu
 {
+	// Counters of a cache used by a ranker (see GeneticAlgorithm::Statistics).
+	struct CacheStatistics
+	{
+		CacheStatistics() :
+			numHits(0),
+			numTries(0),
+			numBytes(0)
+		{
+		}
+
+		long long numHits;
+		long long numTries;
+		size_t numBytes;
+	};
+
 	enum class ScheduleType
 	{
 		LOG,
@@ -324,6 +339,8 @@ namespace lmu
 			int numCacheHits; 
 			int numCacheTries;
 
+			CacheStatistics subtreeCache;
+
 			double bestScore;
 			double worstScore;
 			std::vector<double> bestCandidateScores;
@@ -349,6 +366,7 @@ namespace lmu
 				std::cout << "Mutations: " << numMutations << " Tried: " << numMutationTries << " (" << (double)numMutations / (double)numMutationTries * 100.0 << "%)" << std::endl;
 				std::cout << "Crossovers: " << numCrossovers << " Tried: " << numCrossoverTries << " (" << (double)numCrossovers / (double)numCrossoverTries * 100.0 << "%)" << std::endl;
 				std::cout << "Cache Hits: " << numCacheHits << " Tried: " << numCacheTries << " (" << (double)numCacheHits / (double)numCacheTries * 100.0 << "%)" << std::endl;
+				std::cout << "Subtree Cache Hits: " << subtreeCache.numHits << " Tried: " << subtreeCache.numTries << " (" << (double)subtreeCache.numHits / (double)subtreeCache.numTries * 100.0 << "%) Memory: " << subtreeCache.numBytes << " bytes" << std::endl;
 
 				std::cout << "Score Best: " << bestScore << " Worst: " << worstScore << std::endl;				
 			}
@@ -467,6 +485,7 @@ namespace lmu
 
 				std::cout << "Rank population." << std::endl;
 				rankPopulation(population, ranker, params.rankingInParallel, params.useCaching, stats);
+				stats.subtreeCache = ranker.cacheStatistics();
 				stats.rankingDurations.push_back(stats.iterationDuration.tick());
 
 				sortPopulation(population);
@@ -0,0 +1,82 @@
+#ifndef HYPERDUAL_H
+#define HYPERDUAL_H
+
+#include <Eigen/Core>
+
+#include <cmath>
+
+namespace lmu
+{
+	// Value, gradient and Hessian of a function of a 3D point (second order forward mode differentiation).
+	// Provides the operations used by the formulas in sdf_primitives.h (found via ADL), so evaluating a formula
+	// on HyperDuals gives all derivatives in one pass. Constants have zero derivatives.
+	struct HyperDual
+	{
+		HyperDual() :
+			v(0.0),
+			g(Eigen::Vector3d::Zero()),
+			H(Eigen::Matrix3d::Zero())
+		{
+		}
+
+		HyperDual(double v) :
+			v(v),
+			g(Eigen::Vector3d::Zero()),
+			H(Eigen::Matrix3d::Zero())
+		{
+		}
+
+		HyperDual(double v, const Eigen::Vector3d& g, const Eigen::Matrix3d& H) :
+			v(v),
+			g(g),
+			H(H)
+		{
+		}
+
+		double v;
+		Eigen::Vector3d g;
+		Eigen::Matrix3d H;
+	};
+
+	// f(a) with f' = d1 and f'' = d2 at a.v (chain rule).
+	inline HyperDual chain(const HyperDual& a, double f, double d1, double d2)
+	{
+		return HyperDual(f, d1 * a.g, d1 * a.H + d2 * a.g * a.g.transpose());
+	}
+
+	inline HyperDual operator+(const HyperDual& a, const HyperDual& b) { return HyperDual(a.v + b.v, a.g + b.g, a.H + b.H); }
+	inline HyperDual operator-(const HyperDual& a, const HyperDual& b) { return HyperDual(a.v - b.v, a.g - b.g, a.H - b.H); }
+	inline HyperDual operator-(const HyperDual& a) { return HyperDual(-a.v, -a.g, -a.H); }
+
+	inline HyperDual operator*(const HyperDual& a, const HyperDual& b)
+	{
+		Eigen::Matrix3d gg = a.g * b.g.transpose();
+		return HyperDual(a.v * b.v, a.v * b.g + b.v * a.g, a.v * b.H + b.v * a.H + gg + gg.transpose());
+	}
+
+	inline HyperDual operator/(const HyperDual& a, const HyperDual& b)
+	{
+		return a * chain(b, 1.0 / b.v, -1.0 / (b.v * b.v), 2.0 / (b.v * b.v * b.v));
+	}
+
+	inline HyperDual vsqr(const HyperDual& a) { return chain(a, a.v * a.v, 2.0 * a.v, 2.0); }
+
+	//Derivatives are zero where the square root is not differentiable (as for the analytic gradients).
+	inline HyperDual vsqrt(const HyperDual& a)
+	{
+		if (a.v <= 0.0)
+			return HyperDual(0.0);
+
+		double s = std::sqrt(a.v);
+		return chain(a, s, 0.5 / s, -0.25 / (s * a.v));
+	}
+
+	inline HyperDual vabs(const HyperDual& a) { return a.v < 0.0 ? -a : a; }
+	inline HyperDual vmax(const HyperDual& a, const HyperDual& b) { return a.v >= b.v ? a : b; }
+	inline HyperDual vmin(const HyperDual& a, const HyperDual& b) { return a.v <= b.v ? a : b; }
+	inline HyperDual vsign(const HyperDual& a) { return HyperDual(a.v < 0.0 ? -1.0 : (a.v > 0.0 ? 1.0 : 0.0)); }
+
+	inline HyperDual vsin(const HyperDual& a) { return chain(a, std::sin(a.v), std::cos(a.v), -std::sin(a.v)); }
+}
+
+#endif
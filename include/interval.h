@@ -0,0 +1,101 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace lmu
+{
+	// Closed interval [lo, hi] for conservative bounds of signed distances over regions.
+	// Provides the operations used by the formulas in sdf_primitives.h (found via ADL).
+	struct Interval
+	{
+		Interval() :
+			lo(0.0),
+			hi(0.0)
+		{
+		}
+
+		Interval(double v) :
+			lo(v),
+			hi(v)
+		{
+		}
+
+		Interval(double lo, double hi) :
+			lo(lo),
+			hi(hi)
+		{
+		}
+
+		static Interval unbounded()
+		{
+			return Interval(-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+		}
+
+		bool contains(double v) const
+		{
+			return lo <= v && v <= hi;
+		}
+
+		double lo;
+		double hi;
+	};
+
+	inline Interval operator+(const Interval& a, const Interval& b) { return Interval(a.lo + b.lo, a.hi + b.hi); }
+	inline Interval operator-(const Interval& a, const Interval& b) { return Interval(a.lo - b.hi, a.hi - b.lo); }
+	inline Interval operator-(const Interval& a) { return Interval(-a.hi, -a.lo); }
+
+	inline Interval operator*(const Interval& a, const Interval& b)
+	{
+		double p0 = a.lo * b.lo, p1 = a.lo * b.hi, p2 = a.hi * b.lo, p3 = a.hi * b.hi;
+		return Interval(std::min(std::min(p0, p1), std::min(p2, p3)), std::max(std::max(p0, p1), std::max(p2, p3)));
+	}
+
+	inline Interval operator/(const Interval& a, const Interval& b)
+	{
+		if (b.contains(0.0))
+			return Interval::unbounded();
+
+		return a * Interval(1.0 / b.hi, 1.0 / b.lo);
+	}
+
+	inline Interval vsqr(const Interval& a)
+	{
+		double l = a.lo * a.lo, h = a.hi * a.hi;
+		if (a.contains(0.0))
+			return Interval(0.0, std::max(l, h));
+
+		return Interval(std::min(l, h), std::max(l, h));
+	}
+
+	inline Interval vsqrt(const Interval& a) { return Interval(std::sqrt(std::max(a.lo, 0.0)), std::sqrt(std::max(a.hi, 0.0))); }
+
+	inline Interval vabs(const Interval& a)
+	{
+		if (a.lo >= 0.0)
+			return a;
+		if (a.hi <= 0.0)
+			return -a;
+
+		return Interval(0.0, std::max(-a.lo, a.hi));
+	}
+
+	inline Interval vmax(const Interval& a, const Interval& b) { return Interval(std::max(a.lo, b.lo), std::max(a.hi, b.hi)); }
+	inline Interval vmin(const Interval& a, const Interval& b) { return Interval(std::min(a.lo, b.lo), std::min(a.hi, b.hi)); }
+
+	inline Interval vsign(const Interval& a)
+	{
+		auto sign = [](double v) { return v < 0.0 ? -1.0 : (v > 0.0 ? 1.0 : 0.0); };
+		return Interval(sign(a.lo), sign(a.hi));
+	}
+
+	// Both intervals bound the same value.
+	inline Interval intersect(const Interval& a, const Interval& b)
+	{
+		return Interval(std::max(a.lo, b.lo), std::min(a.hi, b.hi));
+	}
+}
+
+#endif
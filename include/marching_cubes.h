@@ -0,0 +1,34 @@
+#ifndef MARCHING_CUBES_H
+#define MARCHING_CUBES_H
+
+#include <string>
+#include <cstdint>
+#include <functional>
+
+#include "mesh.h"
+
+#include <Eigen/Core>
+
+namespace lmu
+{
+	// Values of the samples of the layers [z0, z1] of the grid. points holds one sample per row,
+	// ordered x fastest, then y, then z (same layout as igl::copyleft::marching_cubes).
+	using SlabSampler = std::function<Eigen::VectorXd(int z0, int z1, const Eigen::MatrixXd& points)>;
+
+	// Marching cubes of the zero level set of a grid with numSamples samples per axis at min + i * stepSize.
+	// The grid is processed in slabs of slabSize cube layers: slabs are sampled (sample is called concurrently)
+	// and polygonized in parallel, and the shared vertices of neighboring slabs are welded in slab order,
+	// so the mesh does not depend on the number of threads.
+	// Cubes, vertices (values > 0 are outside) and triangles are those of igl::copyleft::marching_cubes, which uses the
+	// same tables, so the mesh is the same, in the same order.
+	Mesh marchingCubes(const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, int slabSize, const SlabSampler& sample);
+
+	// Streaming version of marchingCubes() for grids that do not fit into memory: only two layers of samples and the
+	// vertices on the upper one are kept. Layers are sampled one at a time (sample is called with z0 == z1), the cubes
+	// between them are polygonized and the new vertices and triangles are appended to an OBJ file right away.
+	// The file holds the same mesh as marchingCubes(). Returns the number of triangles, throws std::runtime_error if
+	// the file cannot be written.
+	int64_t marchingCubesToOBJ(const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, const SlabSampler& sample, const std::string& file);
+}
+
+#endif
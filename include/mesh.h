@@ -11,11 +11,17 @@
 
 #include <iostream>
 #include <memory>
+#include <functional>
 
 #include <string>
 #include <vector>
 
 #include "pointcloud.h"
+#include "sdf_kernels.h"
+#include "sdf_primitives.h"
+#include "interval.h"
+#include "bounds.h"
+#include "hyperdual.h"
 
 namespace lmu
 {
@@ -52,6 +58,17 @@ namespace lmu
 
 	Mesh fromOBJFile(const std::string& file);
 
+	// Pool of primitive preview meshes. Primitives with the same key (type, parameters and transform) share one
+	// immutable mesh, created by create() on the first request and released with the last primitive using it. Thread-safe.
+	std::shared_ptr<const Mesh> sharedPrimitiveMesh(const std::vector<double>& key, const std::function<Mesh()>& create);
+
+	// Binary PLY (little endian) and STL files. Vertex normals are written to PLY if there is one per vertex.
+	// STL stores float vertices per triangle, fromSTLFile() merges equal vertices. Throw std::runtime_error on failure.
+	void writeMeshPLY(const std::string& file, const Mesh& mesh);
+	Mesh fromPLYFile(const std::string& file);
+	void writeMeshSTL(const std::string& file, const Mesh& mesh);
+	Mesh fromSTLFile(const std::string& file);
+
 	enum class ImplicitFunctionType
 	{
 		Sphere = 0,
@@ -63,22 +80,57 @@ namespace lmu
 
 	std::string iFTypeToString(ImplicitFunctionType type);
 
+	// How primitives compute gradients. 
+	// FiniteDifference uses central differences with step size h and is meant for validating the analytic gradients.
+	enum class GradientMode
+	{
+		Analytic = 0,
+		FiniteDifference
+	};
+
+	// Structure of the transform of a primitive, classified on construction. 
+	// Queries of identity and translation-only primitives skip the matrix product of the world->local mapping, 
+	// distances of rigid primitives are preserved by the transform.
+	enum class TransformClass
+	{
+		Identity = 0,
+		Translation,
+		Rigid,
+		Affine
+	};
+
 	struct ImplicitFunction 
 	{
-		ImplicitFunction(const Eigen::Affine3d& transform, const Mesh& mesh, const std::string& name) :
+		ImplicitFunction(const Eigen::Affine3d& transform, const std::string& name) :
 			_transform(transform),
 			_pos(0.0,0.0,0.0),
-			_mesh(mesh),
-			_name(name)
+			_name(name),
+			_gradientMode(GradientMode::Analytic),
+			_transformClass(classifyTransform(transform))
 		{
 			_pos = _transform * _pos;
 			_invTrans = transform.inverse();
+
+			//Largest singular value of the world->local mapping, scales the Lipschitz constant in signedDistanceInterval().
+			_invScale = _transformClass == TransformClass::Affine ? Eigen::JacobiSVD<Eigen::Matrix3d>(_invTrans.linear()).singularValues()(0) : 1.0;
+		}
+
+		static TransformClass classifyTransform(const Eigen::Affine3d& transform)
+		{
+			if (transform.linear() == Eigen::Matrix3d::Identity())
+				return transform.translation().isZero(0.0) ? TransformClass::Identity : TransformClass::Translation;
+
+			//Same tolerance as the bounds (see updateBounds()).
+			if ((transform.linear().transpose() * transform.linear()).isIdentity(1e-9))
+				return TransformClass::Rigid;
+
+			return TransformClass::Affine;
 		}
 
 		Eigen::Vector4d signedDistanceAndGradient(const Eigen::Vector3d& worldP, double h = 0.001)
 		{
 			//world -> local
-			auto pLocal = _invTrans * worldP;
+			Eigen::Vector3d pLocal = toLocal(worldP);
 
 			double d = signedDistanceLocal(pLocal);
 					
@@ -96,18 +148,105 @@ namespace lmu
 
 		double signedDistance(const Eigen::Vector3d& worldP)
 		{
-			auto localP = _invTrans * worldP;
-			return signedDistanceLocal(localP);
+			return signedDistanceLocal(toLocal(worldP));
 		}
 
-		Mesh& meshRef()
+		// Batched versions: worldPs holds one point per row (N x 3). 
+		// Result has one row per point: distance for signedDistances(), distance and gradient for signedDistanceAndGradients().
+		// Scalar is double or float (see Precision). With float, distances are evaluated in single precision, 
+		// gradients are still computed in double precision.
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> signedDistanceAndGradients(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs, double h = 0.001)
 		{
-			return _mesh;
+			Eigen::MatrixXd localPs = toLocal(worldPs);
+
+			Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> res(worldPs.rows(), 4);
+			res.col(0) = signedDistancesWorld(worldPs);
+
+			//Row-wise version of the gradient transform in signedDistanceAndGradient().
+			if (isTranslationOnly())
+				res.rightCols(3) = gradientsLocal(localPs, h).template cast<Scalar>();
+			else
+				res.rightCols(3) = (gradientsLocal(localPs, h) * _invTrans.linear()).template cast<Scalar>();
+
+			return res;
+		}
+
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistances(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs)
+		{
+			return signedDistancesWorld(worldPs);
+		}
+
+		// Non-template overloads so that blocks and expressions of double matrices can be passed.
+		Eigen::MatrixXd signedDistanceAndGradients(const Eigen::MatrixXd& worldPs, double h = 0.001)
+		{
+			return signedDistanceAndGradients<double>(worldPs, h);
+		}
+
+		Eigen::VectorXd signedDistances(const Eigen::MatrixXd& worldPs)
+		{
+			return signedDistancesWorld(worldPs);
+		}
+
+		// Conservative bound of the signed distance over the world space AABB [min, max].
+		Interval signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max)
+		{
+			Eigen::Vector3d c = 0.5 * (min + max);
+			Eigen::Vector3d e = 0.5 * (max - min);
+
+			//Local AABB of the transformed box.
+			Eigen::Vector3d cLocal = toLocal(c);
+			Eigen::Vector3d eLocal = isTranslationOnly() ? e : Eigen::Vector3d(_invTrans.linear().cwiseAbs() * e);
+
+			Interval d = signedDistanceIntervalLocal(Interval(cLocal.x() - eLocal.x(), cLocal.x() + eLocal.x()), 
+				Interval(cLocal.y() - eLocal.y(), cLocal.y() + eLocal.y()), Interval(cLocal.z() - eLocal.z(), cLocal.z() + eLocal.z()));
+
+			//The distance at the center and the Lipschitz constant give a second bound (tighter for rotated primitives).
+			double r = lipschitzConstantLocal() * _invScale * e.norm();
+			double dc = signedDistanceLocal(cLocal);
+
+			return intersect(d, Interval(dc - r, dc + r));
 		}
 
+		// Value, gradient and Hessian of the signed distance at worldP in one pass (see HyperDual).
+		// h is only used by functions without a HyperDual formula and in GradientMode::FiniteDifference.
+		HyperDual signedDistanceDerivatives(const Eigen::Vector3d& worldP, double h = 0.001)
+		{
+			//The local coordinates are affine in the world point.
+			Eigen::Vector3d pLocal = toLocal(worldP);
+			Eigen::Matrix3d l = _invTrans.linear();
+
+			return signedDistanceDerivativesLocal(HyperDual(pLocal.x(), l.row(0).transpose(), Eigen::Matrix3d::Zero()),
+				HyperDual(pLocal.y(), l.row(1).transpose(), Eigen::Matrix3d::Zero()), HyperDual(pLocal.z(), l.row(2).transpose(), Eigen::Matrix3d::Zero()), h);
+		}
+
+		// World space bounds of the signed distance (see DistanceBounds). Computed from the primitive parameters on construction.
+		const DistanceBounds& bounds() const
+		{
+			return _bounds;
+		}
+
+		// World space AABB of the primitive shape (without displacements), computed from the parameters.
+		// Empty for functions without analytic bounds.
+		AABB aabb() const
+		{
+			AABB box = boundsLocal().outer;
+			return box.isFinite() ? box.transformed(_transform) : AABB();
+		}
+
+		// Preview mesh in world space. Tessellated on first use and shared with all primitives (and clones) with the 
+		// same parameters and transform (see sharedPrimitiveMesh()).
 		const Mesh& meshCRef() const 
 		{
-			return _mesh;
+			std::shared_ptr<const Mesh> mesh = std::atomic_load(&_mesh);
+			if (!mesh)
+			{
+				mesh = sharedPrimitiveMesh(meshKey(), [this]() { return createMesh(); });
+				std::atomic_store(&_mesh, mesh);
+			}
+
+			return *mesh;
 		}
 
 		PointCloud& points()
@@ -127,6 +266,16 @@ namespace lmu
 
 		virtual ImplicitFunctionType type() const = 0;
 
+		GradientMode gradientMode() const
+		{
+			return _gradientMode;
+		}
+
+		void setGradientMode(GradientMode mode)
+		{
+			_gradientMode = mode;
+		}
+
 		Eigen::Vector3d pos() const
 		{
 			return _pos;
@@ -142,6 +291,11 @@ namespace lmu
 			return _transform;
 		}
 
+		TransformClass transformClass() const
+		{
+			return _transformClass;
+		}
+
 	  // row-order: row1 " " row2 " " row3 " " row4
 	  std::string serializeTransform() const {
 	    std::string row1 = std::to_string(_transform(0,0)) + " " 
@@ -177,22 +331,178 @@ namespace lmu
 		virtual Eigen::Vector3d gradientLocal(const Eigen::Vector3d& localP, double h) = 0;
 		virtual double signedDistanceLocal(const Eigen::Vector3d& localP) = 0;
 
+		//Interval extension of signedDistanceLocal(). The default bound is unbounded.
+		virtual Interval signedDistanceIntervalLocal(const Interval& x, const Interval& y, const Interval& z)
+		{
+			return Interval::unbounded();
+		}
+
+		virtual double lipschitzConstantLocal() const
+		{
+			return 1.0;
+		}
+
+		//HyperDual extension of signedDistanceLocal(). x, y and z are affine in the world point.
+		//The default uses the gradient and central differences of it for the Hessian.
+		virtual HyperDual signedDistanceDerivativesLocal(const HyperDual& x, const HyperDual& y, const HyperDual& z, double h)
+		{
+			Eigen::Vector3d p(x.v, y.v, z.v);
+			Eigen::Matrix3d j;
+			j << x.g.transpose(), y.g.transpose(), z.g.transpose();
+
+			Eigen::Matrix3d hess;
+			for (int i = 0; i < 3; ++i)
+			{
+				Eigen::Vector3d d = Eigen::Vector3d::Unit(i) * h;
+				hess.col(i) = (gradientLocal(p + d, h) - gradientLocal(p - d, h)) / (2.0 * h);
+			}
+			hess = 0.5 * (hess + hess.transpose()).eval();
+
+			return HyperDual(signedDistanceLocal(p), j.transpose() * gradientLocal(p, h), j.transpose() * hess * j);
+		}
+
+		//Bounds in local coordinates. Functions without analytic bounds are unbounded.
+		virtual DistanceBounds boundsLocal() const
+		{
+			return DistanceBounds::unbounded();
+		}
+
+		//Tessellation of the preview mesh and the parameters it depends on. Functions without one have an empty mesh.
+		virtual Mesh createMesh() const
+		{
+			return Mesh();
+		}
+
+		virtual std::vector<double> meshParameters() const
+		{
+			return std::vector<double>();
+		}
+
+		std::vector<double> meshKey() const
+		{
+			std::vector<double> key = meshParameters();
+			key.insert(key.begin(), (double)type());
+			key.insert(key.end(), _transform.matrix().data(), _transform.matrix().data() + _transform.matrix().size());
+			return key;
+		}
+
+		//Must be called by the constructors of functions that override boundsLocal().
+		void updateBounds()
+		{
+			//Distances are not preserved by non-rigid transforms.
+			_bounds = _transformClass != TransformClass::Affine ? boundsLocal().transformed(_transform) : DistanceBounds::unbounded();
+		}
+
+		//Default batch implementations fall back to the per-point versions. 
+		virtual Eigen::MatrixXd gradientsLocal(const Eigen::MatrixXd& localPs, double h)
+		{
+			Eigen::MatrixXd res(localPs.rows(), 3);
+			for (int i = 0; i < localPs.rows(); ++i)
+				res.row(i) = gradientLocal(localPs.row(i).transpose(), h).transpose();
+			return res;
+		}
+
+		virtual Eigen::VectorXd signedDistancesLocal(const Eigen::MatrixXd& localPs)
+		{
+			Eigen::VectorXd res(localPs.rows());
+			for (int i = 0; i < localPs.rows(); ++i)
+				res(i) = signedDistanceLocal(localPs.row(i).transpose());
+			return res;
+		}
+
+		Eigen::Vector3d finiteDifferenceGradientLocal(const Eigen::Vector3d& localP, double h)
+		{
+			double dx = (signedDistanceLocal(Eigen::Vector3d(localP.x() + h, localP.y(), localP.z())) - signedDistanceLocal(Eigen::Vector3d(localP.x() - h, localP.y(), localP.z()))) / (2.0 * h);
+			double dy = (signedDistanceLocal(Eigen::Vector3d(localP.x(), localP.y() + h, localP.z())) - signedDistanceLocal(Eigen::Vector3d(localP.x(), localP.y() - h, localP.z()))) / (2.0 * h);
+			double dz = (signedDistanceLocal(Eigen::Vector3d(localP.x(), localP.y(), localP.z() + h)) - signedDistanceLocal(Eigen::Vector3d(localP.x(), localP.y(), localP.z() - h))) / (2.0 * h);
+
+			return Eigen::Vector3d(dx, dy, dz);
+		}
+
+		bool isTranslationOnly() const
+		{
+			return _transformClass == TransformClass::Identity || _transformClass == TransformClass::Translation;
+		}
+
+		//The specialized mappings give the same local points as the full transform.
+		Eigen::Vector3d toLocal(const Eigen::Vector3d& worldP) const
+		{
+			switch (_transformClass)
+			{
+			case TransformClass::Identity:
+				return worldP;
+			case TransformClass::Translation:
+				return worldP + _invTrans.translation();
+			default:
+				return _invTrans * worldP;
+			}
+		}
+
+		template<typename Scalar>
+		Eigen::MatrixXd toLocal(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs) const
+		{
+			switch (_transformClass)
+			{
+			case TransformClass::Identity:
+				return worldPs.template cast<double>();
+			case TransformClass::Translation:
+				return worldPs.template cast<double>().rowwise() + _invTrans.translation().transpose();
+			default:
+				return (worldPs.template cast<double>() * _invTrans.linear().transpose()).rowwise() + _invTrans.translation().transpose();
+			}
+		}
+
+		//Primitives with a SIMD distance kernel override these and evaluate world space points directly.
+		virtual Eigen::VectorXd signedDistancesWorld(const Eigen::MatrixXd& worldPs)
+		{
+			return signedDistancesLocal(toLocal(worldPs));
+		}
+
+		virtual Eigen::VectorXf signedDistancesWorld(const Eigen::MatrixXf& worldPs)
+		{
+			return signedDistancesLocal(toLocal(worldPs)).cast<float>();
+		}
+
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> evaluateKernel(SDFKernel<Scalar> kernel, const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs, const double* params) const
+		{
+			Eigen::Matrix<double, 3, 4, Eigen::RowMajor> invTrans = _invTrans.matrix().topRows(3);
+
+			//Columns of worldPs are the SoA coordinate arrays.
+			Eigen::Matrix<Scalar, Eigen::Dynamic, 1> res(worldPs.rows());
+			kernel(worldPs.col(0).data(), worldPs.col(1).data(), worldPs.col(2).data(), worldPs.rows(), invTrans.data(), params, res.data());
+
+			return res;
+		}
+
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> displacements(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs, double displacement) const
+		{
+			Eigen::MatrixXd localPs = toLocal(worldPs);
+			return ((displacement * localPs.col(0)).array().sin() * (displacement * localPs.col(1)).array().sin() * (displacement * localPs.col(2)).array().sin()).matrix().template cast<Scalar>();
+		}
+
 		Eigen::Affine3d _transform;
 		Eigen::Affine3d _invTrans;
 
 		Eigen::Vector3d _pos;
-		Mesh _mesh;
+		mutable std::shared_ptr<const Mesh> _mesh;
 		PointCloud _points;
 		std::string _name;
+		GradientMode _gradientMode;
+		DistanceBounds _bounds;
+		TransformClass _transformClass;
+		double _invScale;
 	};
 
 	struct IFSphere : public ImplicitFunction 
 	{
 		IFSphere(const Eigen::Affine3d& transform, double radius, const std::string& name, double displacement = 0.0) : 
-			ImplicitFunction(transform, createSphere(transform, radius, 50, 50), name),
+			ImplicitFunction(transform, name),
 			_radius(radius),
 			_displacement(displacement)
 		{
+			updateBounds();
 		}
 	
 		virtual ImplicitFunctionType type() const override
@@ -223,19 +533,98 @@ namespace lmu
 
 		virtual double signedDistanceLocal(const Eigen::Vector3d& localP) override
 		{
-			double d = localP.norm() - _radius;
-			
-			double d2 = std::sin(_displacement * localP.x())*sin(_displacement * localP.y())*sin(_displacement * localP.z());
-
-			return d + d2;
+			return signedDistanceLocalInline(localP);
 		}
 
 		virtual Eigen::Vector3d gradientLocal(const Eigen::Vector3d& localP, double h) override
 		{
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return finiteDifferenceGradientLocal(localP, h);
+
 			return localP.normalized();
 		}
 
+		virtual Eigen::VectorXd signedDistancesWorld(const Eigen::MatrixXd& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		virtual Eigen::VectorXf signedDistancesWorld(const Eigen::MatrixXf& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		//The displacement is bounded by [-1, 1], the Lipschitz bound is tighter for small boxes.
+		virtual Interval signedDistanceIntervalLocal(const Interval& x, const Interval& y, const Interval& z) override
+		{
+			Interval d = sdf::sphereDistance(x, y, z, _radius);
+
+			return _displacement != 0.0 ? d + Interval(-1.0, 1.0) : d;
+		}
+
+		virtual double lipschitzConstantLocal() const override
+		{
+			return 1.0 + std::abs(_displacement) * std::sqrt(3.0);
+		}
+
+		//The displacement is bounded by [-1, 1].
+		virtual DistanceBounds boundsLocal() const override
+		{
+			return DistanceBounds(AABB(Eigen::Vector3d::Constant(-_radius), Eigen::Vector3d::Constant(_radius)), 1.0, _displacement != 0.0 ? 1.0 : 0.0);
+		}
+
+		virtual Mesh createMesh() const override
+		{
+			return createSphere(_transform, _radius, 50, 50);
+		}
+
+		virtual std::vector<double> meshParameters() const override
+		{
+			return { _radius };
+		}
+
+		virtual HyperDual signedDistanceDerivativesLocal(const HyperDual& x, const HyperDual& y, const HyperDual& z, double h) override
+		{
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return ImplicitFunction::signedDistanceDerivativesLocal(x, y, z, h);
+
+			HyperDual d = sdf::sphereDistance(x, y, z, _radius);
+
+			return _displacement != 0.0 ? d + sdf::displacement(x, y, z, _displacement) : d;
+		}
+
+		virtual Eigen::MatrixXd gradientsLocal(const Eigen::MatrixXd& localPs, double h) override
+		{
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return ImplicitFunction::gradientsLocal(localPs, h);
+
+			Eigen::MatrixXd res(localPs.rows(), 3);
+			for (int i = 0; i < localPs.rows(); ++i)
+				res.row(i) = localPs.row(i).normalized();
+			return res;
+		}
+
 	private: 
+
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistancesWorldT(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs)
+		{
+			const double params[] = { _radius };
+			Eigen::Matrix<Scalar, Eigen::Dynamic, 1> res = evaluateKernel(sdfKernels().get<Scalar>().sphere, worldPs, params);
+
+			if (_displacement != 0.0)
+				res += displacements(worldPs, _displacement);
+
+			return res;
+		}
+
+		inline double signedDistanceLocalInline(const Eigen::Vector3d& localP)
+		{
+			double d = sdf::sphereDistance(localP.x(), localP.y(), localP.z(), _radius);
+
+			return _displacement != 0.0 ? d + sdf::displacement(localP.x(), localP.y(), localP.z(), _displacement) : d;
+		}
+
 		double _radius;
 		double _displacement;
 	};
@@ -244,11 +633,13 @@ namespace lmu
 	struct IFCylinder : ImplicitFunction
 	{
 		IFCylinder(const Eigen::Affine3d& transform, double radius, double height, const std::string& name) :
-			ImplicitFunction(transform, createCylinder(transform, radius, radius, height, 200, 200), name),
+			ImplicitFunction(transform, name),
 			_radius(radius),
 			_height(height)
 		{
 			_invTrans = transform.inverse();
+
+			updateBounds();
 		}
 
 		virtual ImplicitFunctionType type() const override
@@ -279,26 +670,81 @@ namespace lmu
 
 		virtual Eigen::Vector3d gradientLocal(const Eigen::Vector3d& localP, double h) override
 		{
-			double dx = (signedDistanceLocalInline(Eigen::Vector3d(localP.x() + h, localP.y(), localP.z())) - signedDistanceLocalInline(Eigen::Vector3d(localP.x() - h, localP.y(), localP.z()))) / (2.0 * h);
-			double dy = (signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y() + h, localP.z())) - signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y() - h, localP.z()))) / (2.0 * h);
-			double dz = (signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y(), localP.z() + h)) - signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y(), localP.z() - h))) / (2.0 * h);
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return finiteDifferenceGradientLocal(localP, h);
 
-			return Eigen::Vector3d(dx, dy, dz);
+			Eigen::Vector3d g;
+			sdf::cylinderGradient(localP.x(), localP.y(), localP.z(), _radius, _height / 2.0, g.x(), g.y(), g.z());
+
+			return g;
 		}
 
 		virtual double signedDistanceLocal(const Eigen::Vector3d& localP) override
 		{
 			return signedDistanceLocalInline(localP);
 		}
+
+		virtual Eigen::VectorXd signedDistancesWorld(const Eigen::MatrixXd& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		virtual Eigen::VectorXf signedDistancesWorld(const Eigen::MatrixXf& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		virtual Interval signedDistanceIntervalLocal(const Interval& x, const Interval& y, const Interval& z) override
+		{
+			return sdf::cylinderDistance(x, y, z, _radius, _height / 2.0);
+		}
+
+		//The max() of the radial and axial distance is at least 1/sqrt(2) of the euclidean distance.
+		virtual DistanceBounds boundsLocal() const override
+		{
+			return DistanceBounds(AABB(Eigen::Vector3d(-_radius, -_height / 2.0, -_radius), Eigen::Vector3d(_radius, _height / 2.0, _radius)), 1.0 / std::sqrt(2.0));
+		}
+
+		virtual Mesh createMesh() const override
+		{
+			return createCylinder(_transform, _radius, _radius, _height, 200, 200);
+		}
+
+		virtual std::vector<double> meshParameters() const override
+		{
+			return { _radius, _height };
+		}
+
+		virtual HyperDual signedDistanceDerivativesLocal(const HyperDual& x, const HyperDual& y, const HyperDual& z, double h) override
+		{
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return ImplicitFunction::signedDistanceDerivativesLocal(x, y, z, h);
+
+			return sdf::cylinderDistance(x, y, z, _radius, _height / 2.0);
+		}
+
+		virtual Eigen::MatrixXd gradientsLocal(const Eigen::MatrixXd& localPs, double h) override
+		{
+			Eigen::MatrixXd res(localPs.rows(), 3);
+			for (int i = 0; i < localPs.rows(); ++i)
+				res.row(i) = IFCylinder::gradientLocal(localPs.row(i).transpose(), h).transpose();
+			return res;
+		}
 	
 	private:
 
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistancesWorldT(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs)
+		{
+			const double params[] = { _radius, _height / 2.0 };
+			Eigen::Matrix<Scalar, Eigen::Dynamic, 1> res = evaluateKernel(sdfKernels().get<Scalar>().cylinder, worldPs, params);
+
+			return res;
+		}
+
 		inline double signedDistanceLocalInline(const Eigen::Vector3d& localP)
 		{
-			double l = Eigen::Vector2d(localP.x(), localP.z()).norm();
-			double dx = std::abs(l) - _height;
-			double dy = std::abs(localP.y()) - _height;
-			return std::max(l - _radius, abs(localP.y()) - _height / 2.0);// std::min(std::max(dx, dy), 0.0) + Eigen::Vector2d(std::max(dx, 0.0), std::max(dy, 0.0)).norm();
+			return sdf::cylinderDistance(localP.x(), localP.y(), localP.z(), _radius, _height / 2.0);
 		}
 
 		double _radius;
@@ -308,10 +754,12 @@ namespace lmu
 	struct IFBox : public ImplicitFunction
 	{
 		IFBox(const Eigen::Affine3d& transform, const Eigen::Vector3d& size, int numSubdivisions, const std::string& name, double displacement = 0.0) :
-			ImplicitFunction(transform, createBox(transform, size, numSubdivisions), name),
+			ImplicitFunction(transform, name),
 			_size(size),
-			_displacement(displacement)
+			_displacement(displacement),
+			_numSubdivisions(numSubdivisions)
 		{
+			updateBounds();
 		}
 
 		virtual ImplicitFunctionType type() const override
@@ -343,11 +791,19 @@ namespace lmu
 
 		virtual Eigen::Vector3d gradientLocal(const Eigen::Vector3d& localP, double h) override
 		{
-			double dx = (signedDistanceLocalInline(Eigen::Vector3d(localP.x() + h, localP.y(), localP.z())) - signedDistanceLocalInline(Eigen::Vector3d(localP.x() - h, localP.y(), localP.z()))) / (2.0 * h);
-			double dy = (signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y() + h, localP.z())) - signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y() - h, localP.z()))) / (2.0 * h);
-			double dz = (signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y(), localP.z() + h)) - signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y(), localP.z() - h))) / (2.0 * h);
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return finiteDifferenceGradientLocal(localP, h);
 
-			return Eigen::Vector3d(dx, dy, dz);
+			Eigen::Vector3d g, gd;
+			sdf::boxGradient(localP.x(), localP.y(), localP.z(), _size.x() / 2.0, _size.y() / 2.0, _size.z() / 2.0, g.x(), g.y(), g.z());
+			
+			if (_displacement != 0.0)
+			{
+				sdf::displacementGradient(localP.x(), localP.y(), localP.z(), _displacement, gd.x(), gd.y(), gd.z());
+				g += gd;
+			}
+
+			return g;
 		}
 
 		virtual double signedDistanceLocal(const Eigen::Vector3d& localP) override
@@ -355,25 +811,93 @@ namespace lmu
 			return signedDistanceLocalInline(localP);
 		}
 
+		virtual Eigen::VectorXd signedDistancesWorld(const Eigen::MatrixXd& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		virtual Eigen::VectorXf signedDistancesWorld(const Eigen::MatrixXf& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		//The displacement is bounded by [-1, 1], the Lipschitz bound is tighter for small boxes.
+		virtual Interval signedDistanceIntervalLocal(const Interval& x, const Interval& y, const Interval& z) override
+		{
+			Interval d = sdf::boxDistance(x, y, z, _size.x() / 2.0, _size.y() / 2.0, _size.z() / 2.0);
+
+			return _displacement != 0.0 ? d + Interval(-1.0, 1.0) : d;
+		}
+
+		virtual double lipschitzConstantLocal() const override
+		{
+			return 1.0 + std::abs(_displacement) * std::sqrt(3.0);
+		}
+
+		//The max() of the plane distances is at least 1/sqrt(3) of the euclidean distance.
+		virtual DistanceBounds boundsLocal() const override
+		{
+			return DistanceBounds(AABB(-_size / 2.0, _size / 2.0), 1.0 / std::sqrt(3.0), _displacement != 0.0 ? 1.0 : 0.0);
+		}
+
+		virtual Mesh createMesh() const override
+		{
+			return createBox(_transform, _size, _numSubdivisions);
+		}
+
+		virtual std::vector<double> meshParameters() const override
+		{
+			return { _size.x(), _size.y(), _size.z(), (double)_numSubdivisions };
+		}
+
+		virtual HyperDual signedDistanceDerivativesLocal(const HyperDual& x, const HyperDual& y, const HyperDual& z, double h) override
+		{
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return ImplicitFunction::signedDistanceDerivativesLocal(x, y, z, h);
+
+			HyperDual d = sdf::boxDistance(x, y, z, _size.x() / 2.0, _size.y() / 2.0, _size.z() / 2.0);
+
+			return _displacement != 0.0 ? d + sdf::displacement(x, y, z, _displacement) : d;
+		}
+
+		virtual Eigen::MatrixXd gradientsLocal(const Eigen::MatrixXd& localPs, double h) override
+		{
+			Eigen::MatrixXd res(localPs.rows(), 3);
+			for (int i = 0; i < localPs.rows(); ++i)
+				res.row(i) = IFBox::gradientLocal(localPs.row(i).transpose(), h).transpose();
+			return res;
+		}
+
 	private:
 
-		inline double signedDistanceLocalInline(const Eigen::Vector3d& localP)
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistancesWorldT(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs)
 		{
-			double d1 = std::max(abs(localP.x()) - _size.x() / 2.0, std::max(abs(localP.y()) - _size.y() / 2.0, abs(localP.z()) - _size.z() / 2.0));
+			const double params[] = { _size.x() / 2.0, _size.y() / 2.0, _size.z() / 2.0 };
+			Eigen::Matrix<Scalar, Eigen::Dynamic, 1> res = evaluateKernel(sdfKernels().get<Scalar>().box, worldPs, params);
+
+			if (_displacement != 0.0)
+				res += displacements(worldPs, _displacement);
+
+			return res;
+		}
 
-			double d2 = std::sin(_displacement * localP.x())*sin(_displacement * localP.y())*sin(_displacement * localP.z());
+		inline double signedDistanceLocalInline(const Eigen::Vector3d& localP)
+		{
+			double d1 = sdf::boxDistance(localP.x(), localP.y(), localP.z(), _size.x() / 2.0, _size.y() / 2.0, _size.z() / 2.0);
 
-			return d1 + d2;			
+			return _displacement != 0.0 ? d1 + sdf::displacement(localP.x(), localP.y(), localP.z(), _displacement) : d1;
 		}
 
 		Eigen::Vector3d _size;
 		double _displacement;
+		int _numSubdivisions;
 	};
 
 	struct IFNull : public ImplicitFunction
 	{
 		IFNull(const std::string& name) :
-			ImplicitFunction(Eigen::Affine3d::Identity(), lmu::Mesh(), name)
+			ImplicitFunction(Eigen::Affine3d::Identity(), name)
 		{
 		}
 
@@ -408,9 +932,10 @@ namespace lmu
 	struct IFCone : public ImplicitFunction
 	{
 		IFCone(const Eigen::Affine3d& transform, const Eigen::Vector3d& c, const std::string& name) :
-			ImplicitFunction(transform, createCylinder(transform, c.x(), c.y(), c.z(), 200, 200), name),
+			ImplicitFunction(transform, name),
 			_c(c)
 		{
+			updateBounds();
 		}
 
 		virtual ImplicitFunctionType type() const override
@@ -447,11 +972,13 @@ namespace lmu
 
 		virtual Eigen::Vector3d gradientLocal(const Eigen::Vector3d& localP, double h) override
 		{
-			double dx = (signedDistanceLocalInline(Eigen::Vector3d(localP.x() + h, localP.y(), localP.z())) - signedDistanceLocalInline(Eigen::Vector3d(localP.x() - h, localP.y(), localP.z()))) / (2.0 * h);
-			double dy = (signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y() + h, localP.z())) - signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y() - h, localP.z()))) / (2.0 * h);
-			double dz = (signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y(), localP.z() + h)) - signedDistanceLocalInline(Eigen::Vector3d(localP.x(), localP.y(), localP.z() - h))) / (2.0 * h);
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return finiteDifferenceGradientLocal(localP, h);
 
-			return Eigen::Vector3d(dx, dy, dz);
+			Eigen::Vector3d g;
+			sdf::coneGradient(localP.x(), localP.y(), localP.z(), _c.x(), _c.y(), _c.z(), g.x(), g.y(), g.z());
+
+			return g;
 		}
 
 		virtual double signedDistanceLocal(const Eigen::Vector3d& localP) override
@@ -459,20 +986,70 @@ namespace lmu
 			return signedDistanceLocalInline(localP);
 		}
 
+		virtual Eigen::VectorXd signedDistancesWorld(const Eigen::MatrixXd& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		virtual Eigen::VectorXf signedDistancesWorld(const Eigen::MatrixXf& worldPs) override
+		{
+			return signedDistancesWorldT(worldPs);
+		}
+
+		virtual Interval signedDistanceIntervalLocal(const Interval& x, const Interval& y, const Interval& z) override
+		{
+			return sdf::coneDistance(x, y, z, _c.x(), _c.y(), _c.z());
+		}
+
+		//Apex at the origin, base at y = -c.z() (see sdf::coneDistance()). 
+		//Above the apex, the distance is measured to the extended side line, i.e. scaled by the sine of the half angle.
+		virtual DistanceBounds boundsLocal() const override
+		{
+			double r = std::abs(_c.z() * _c.y() / _c.x());
+			double h = std::abs(_c.z());
+			return DistanceBounds(AABB(Eigen::Vector3d(-r, std::min(0.0, -_c.z()), -r), Eigen::Vector3d(r, std::max(0.0, -_c.z()), r)), r / std::sqrt(r * r + h * h));
+		}
+
+		virtual Mesh createMesh() const override
+		{
+			return createCylinder(_transform, _c.x(), _c.y(), _c.z(), 200, 200);
+		}
+
+		virtual std::vector<double> meshParameters() const override
+		{
+			return { _c.x(), _c.y(), _c.z() };
+		}
+
+		virtual HyperDual signedDistanceDerivativesLocal(const HyperDual& x, const HyperDual& y, const HyperDual& z, double h) override
+		{
+			if (_gradientMode == GradientMode::FiniteDifference)
+				return ImplicitFunction::signedDistanceDerivativesLocal(x, y, z, h);
+
+			return sdf::coneDistance(x, y, z, _c.x(), _c.y(), _c.z());
+		}
+
+		virtual Eigen::MatrixXd gradientsLocal(const Eigen::MatrixXd& localPs, double h) override
+		{
+			Eigen::MatrixXd res(localPs.rows(), 3);
+			for (int i = 0; i < localPs.rows(); ++i)
+				res.row(i) = IFCone::gradientLocal(localPs.row(i).transpose(), h).transpose();
+			return res;
+		}
+
 	private:
 
-		inline double signedDistanceLocalInline(const Eigen::Vector3d& localP) 
+		template<typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistancesWorldT(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& worldPs)
 		{
-			Eigen::Vector2d q = Eigen::Vector2d(Eigen::Vector2d(localP.x(), localP.z()).norm(), localP.y());
-			Eigen::Vector2d v = Eigen::Vector2d(_c.z()*_c.y() / _c.x(), -_c.z());
-			Eigen::Vector2d w = v - q;
-			Eigen::Vector2d vv = Eigen::Vector2d(v.dot(v), v.x()*v.x());
-			Eigen::Vector2d qv = Eigen::Vector2d(v.dot(w), v.x()*w.x());
-			Eigen::Vector2d d;
-			d.x() = std::max(qv.x(), 0.0)*qv.x() / vv.x();
-			d.y() = std::max(qv.y(), 0.0)*qv.y() / vv.y();
+			const double params[] = { _c.x(), _c.y(), _c.z() };
+			Eigen::Matrix<Scalar, Eigen::Dynamic, 1> res = evaluateKernel(sdfKernels().get<Scalar>().cone, worldPs, params);
+
+			return res;
+		}
 
-			return sqrt(w.dot(w) - std::max(d.x(), d.y())) * sign(std::max(q.y()*v.x() - q.x()*v.y(), w.y()));
+		inline double signedDistanceLocalInline(const Eigen::Vector3d& localP) 
+		{
+			return sdf::coneDistance(localP.x(), localP.y(), localP.z(), _c.x(), _c.y(), _c.z());
 		}
 
 		Eigen::Vector3d _c;
@@ -14,6 +14,10 @@ namespace lmu
   void writePointCloudXYZ(const std::string& file, PointCloud& points);
   PointCloud readPointCloud(const std::string& file, double scaleFactor=1.0);
   PointCloud readPointCloudXYZ(const std::string& file, double scaleFactor=1.0);
+
+  // Binary PLY (little endian, x y z nx ny nz as doubles). Throw std::runtime_error on failure.
+  void writePointCloudPLY(const std::string& file, const PointCloud& points);
+  PointCloud readPointCloudPLY(const std::string& file, double scaleFactor=1.0);
   PointCloud pointCloudFromMesh(const lmu::Mesh & mesh, double delta, double samplingRate, double errorSigma);
   
   Eigen::MatrixXd getSIFTKeypoints(Eigen::MatrixXd& points, double minScale, double minContrast, int numOctaves, int numScalesPerOctave, bool normalsAvailable);
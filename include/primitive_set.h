@@ -0,0 +1,87 @@
+#ifndef PRIMITIVE_SET_H
+#define PRIMITIVE_SET_H
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "mesh.h"
+#include "sdf_kernels.h"
+#include "sdf_primitives.h"
+
+#include <Eigen/Core>
+
+namespace lmu
+{
+	//Value-type representation of a primitive of the closed set of types in ImplicitFunctionType:
+	//the type tag, the parameters inline (see SDFKernel) and the world->local transform as a row-major 3x4 matrix.
+	//Evaluation switches on the tag instead of calling the virtual functions of ImplicitFunction,
+	//which stays the facade that owns the transform, mesh, points and name.
+	struct Primitive
+	{
+		static const int MaxParameters = 3;
+
+		//Returns false if the function has no value representation (a type that is not one of the built-in classes).
+		static bool fromFunction(const ImplicitFunction& function, Primitive& primitive);
+
+		//Signed distance at a world point, same as ImplicitFunction::signedDistance() up to the rounding of the transform.
+		template<typename T>
+		inline T signedDistance(const T& x, const T& y, const T& z) const
+		{
+			T lx, ly, lz;
+			sdf::transformPoint(x, y, z, invTrans, lx, ly, lz);
+
+			switch (type)
+			{
+			case ImplicitFunctionType::Sphere:
+				return sdf::sphereDistance(lx, ly, lz, params[0]) + (displacement != 0.0 ? sdf::displacement(lx, ly, lz, displacement) : T(0.0));
+			case ImplicitFunctionType::Box:
+				return sdf::boxDistance(lx, ly, lz, params[0], params[1], params[2]) + (displacement != 0.0 ? sdf::displacement(lx, ly, lz, displacement) : T(0.0));
+			case ImplicitFunctionType::Cylinder:
+				return sdf::cylinderDistance(lx, ly, lz, params[0], params[1]);
+			case ImplicitFunctionType::Cone:
+				return sdf::coneDistance(lx, ly, lz, params[0], params[1], params[2]);
+			default:
+				return T(0.0);
+			}
+		}
+
+		ImplicitFunctionType type;
+		double invTrans[12];
+		double params[MaxParameters];
+		double displacement;
+	};
+
+	//Primitives of a list of functions, sorted by type so that each type is evaluated by a run of the same
+	//distance kernel (see SDFKernels) without virtual calls. Functions without a value representation are
+	//evaluated through the facade.
+	class PrimitiveSet
+	{
+	public:
+
+		explicit PrimitiveSet(const std::vector<std::shared_ptr<ImplicitFunction>>& functions = {});
+
+		//Primitives of functions that converted holds are copied from it instead of being converted again
+		//(e.g. for the pruned trees of one tree).
+		PrimitiveSet(const std::vector<std::shared_ptr<ImplicitFunction>>& functions, const PrimitiveSet& converted);
+
+		//ps is N x 3 (one point per row). Element i holds the distances of functions[i],
+		//identical to ImplicitFunction::signedDistances(). Scalar is double or float (see Precision).
+		template<typename Scalar>
+		std::vector<Eigen::Matrix<Scalar, Eigen::Dynamic, 1>> signedDistances(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps) const;
+
+		int size() const;
+		int numFallbacks() const;
+
+	private:
+
+		void convert(const std::vector<std::shared_ptr<ImplicitFunction>>& functions, const PrimitiveSet* converted);
+
+		std::vector<Primitive> _primitives;
+		std::vector<int> _indices;
+		std::vector<std::pair<int, std::shared_ptr<ImplicitFunction>>> _fallbacks;
+		std::unordered_map<ImplicitFunction*, int> _lookup; //Index into _primitives.
+	};
+}
+
+#endif
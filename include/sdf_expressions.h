@@ -0,0 +1,376 @@
+#ifndef SDF_EXPRESSIONS_H
+#define SDF_EXPRESSIONS_H
+
+#include <tuple>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "sdf_primitives.h"
+#include "csgnode_helper.h"
+
+// Expression templates for CSG models that are known at compile time, e.g.
+//   auto model = sdf::difference(sdf::union_(sdf::box(t0, size, 2, "Box_0"), sdf::sphere(t1, 0.3, "Sphere_0")), sdf::sphere(t2, 0.4, "Sphere_1"));
+// The type of an expression is the whole tree, so model(x, y, z) compiles to the inlined primitive formulas combined
+// with min/max (no virtual calls, no allocations). Results are the signed distances of the same tree as CSGNode
+// (without the bounds-based skipping, which does not change results).
+// toCSGNode() builds the equivalent runtime tree (e.g. for sampling, ranking or writing the primitives).
+// Like sdf_primitives.h, the scalar type T can also be a type with the sdf operator overloads (e.g. Interval).
+
+namespace lmu
+{
+	namespace sdf
+	{
+		inline double vmin(double a, double b) { return std::min(a, b); }
+		inline float vmin(float a, float b) { return std::min(a, b); }
+
+		template<typename T>
+		inline T vmin(const T& a, const T& b)
+		{
+			return -vmax(-a, -b);
+		}
+
+		class PrimitiveExpression
+		{
+		public:
+
+			const Eigen::Affine3d& transform() const
+			{
+				return _transform;
+			}
+
+			const std::string& name() const
+			{
+				return _name;
+			}
+
+		protected:
+
+			PrimitiveExpression(const Eigen::Affine3d& transform, const std::string& name) :
+				_transform(transform),
+				_name(name)
+			{
+				//Same layout as the SIMD kernels (see sdf::transformPoint()).
+				Eigen::Matrix<double, 3, 4, Eigen::RowMajor> invTrans = transform.inverse().matrix().topRows(3);
+				std::copy(invTrans.data(), invTrans.data() + 12, _invTrans);
+			}
+
+			template<typename T>
+			inline void toLocal(const T& x, const T& y, const T& z, T& lx, T& ly, T& lz) const
+			{
+				transformPoint(x, y, z, _invTrans, lx, ly, lz);
+			}
+
+			Eigen::Affine3d _transform;
+			std::string _name;
+			double _invTrans[12];
+		};
+
+		class SphereExpression : public PrimitiveExpression
+		{
+		public:
+
+			SphereExpression(const Eigen::Affine3d& transform, double radius, const std::string& name, double displacement) :
+				PrimitiveExpression(transform, name),
+				_radius(radius),
+				_displacement(displacement)
+			{
+			}
+
+			template<typename T>
+			inline T operator()(const T& x, const T& y, const T& z) const
+			{
+				T lx, ly, lz;
+				toLocal(x, y, z, lx, ly, lz);
+
+				T d = sphereDistance(lx, ly, lz, _radius);
+
+				return _displacement != 0.0 ? d + displacement(lx, ly, lz, _displacement) : d;
+			}
+
+			CSGNode toCSGNode() const
+			{
+				return geo<IFSphere>(_transform, _radius, _name, _displacement);
+			}
+
+		private:
+
+			double _radius;
+			double _displacement;
+		};
+
+		class BoxExpression : public PrimitiveExpression
+		{
+		public:
+
+			BoxExpression(const Eigen::Affine3d& transform, const Eigen::Vector3d& size, int numSubdivisions, const std::string& name, double displacement) :
+				PrimitiveExpression(transform, name),
+				_size(size),
+				_numSubdivisions(numSubdivisions),
+				_displacement(displacement)
+			{
+			}
+
+			template<typename T>
+			inline T operator()(const T& x, const T& y, const T& z) const
+			{
+				T lx, ly, lz;
+				toLocal(x, y, z, lx, ly, lz);
+
+				T d = boxDistance(lx, ly, lz, _size.x() / 2.0, _size.y() / 2.0, _size.z() / 2.0);
+
+				return _displacement != 0.0 ? d + displacement(lx, ly, lz, _displacement) : d;
+			}
+
+			CSGNode toCSGNode() const
+			{
+				return geo<IFBox>(_transform, _size, _numSubdivisions, _name, _displacement);
+			}
+
+		private:
+
+			Eigen::Vector3d _size;
+			int _numSubdivisions;
+			double _displacement;
+		};
+
+		class CylinderExpression : public PrimitiveExpression
+		{
+		public:
+
+			CylinderExpression(const Eigen::Affine3d& transform, double radius, double height, const std::string& name) :
+				PrimitiveExpression(transform, name),
+				_radius(radius),
+				_height(height)
+			{
+			}
+
+			template<typename T>
+			inline T operator()(const T& x, const T& y, const T& z) const
+			{
+				T lx, ly, lz;
+				toLocal(x, y, z, lx, ly, lz);
+
+				return cylinderDistance(lx, ly, lz, _radius, _height / 2.0);
+			}
+
+			CSGNode toCSGNode() const
+			{
+				return geo<IFCylinder>(_transform, _radius, _height, _name);
+			}
+
+		private:
+
+			double _radius;
+			double _height;
+		};
+
+		class ConeExpression : public PrimitiveExpression
+		{
+		public:
+
+			ConeExpression(const Eigen::Affine3d& transform, const Eigen::Vector3d& c, const std::string& name) :
+				PrimitiveExpression(transform, name),
+				_c(c)
+			{
+			}
+
+			template<typename T>
+			inline T operator()(const T& x, const T& y, const T& z) const
+			{
+				T lx, ly, lz;
+				toLocal(x, y, z, lx, ly, lz);
+
+				return coneDistance(lx, ly, lz, _c.x(), _c.y(), _c.z());
+			}
+
+			CSGNode toCSGNode() const
+			{
+				return geo<IFCone>(_transform, _c, _name);
+			}
+
+		private:
+
+			Eigen::Vector3d _c;
+		};
+
+		// Combination of the child results, same as the operations of CSGNode.
+
+		struct UnionCombiner
+		{
+			template<typename T>
+			static inline T apply(const T& a)
+			{
+				return a;
+			}
+
+			template<typename T, typename... Rest>
+			static inline T apply(const T& a, const T& b, const Rest&... rest)
+			{
+				return apply(vmin(a, b), rest...);
+			}
+
+			static CSGNode toCSGNode(const std::vector<CSGNode>& childs)
+			{
+				return opUnion(childs);
+			}
+		};
+
+		struct IntersectionCombiner
+		{
+			template<typename T>
+			static inline T apply(const T& a)
+			{
+				return a;
+			}
+
+			template<typename T, typename... Rest>
+			static inline T apply(const T& a, const T& b, const Rest&... rest)
+			{
+				return apply(vmax(a, b), rest...);
+			}
+
+			static CSGNode toCSGNode(const std::vector<CSGNode>& childs)
+			{
+				return opInter(childs);
+			}
+		};
+
+		struct DifferenceCombiner
+		{
+			template<typename T>
+			static inline T apply(const T& a, const T& b)
+			{
+				return vmax(a, -b);
+			}
+
+			static CSGNode toCSGNode(const std::vector<CSGNode>& childs)
+			{
+				return opDiff(childs);
+			}
+		};
+
+		struct ComplementCombiner
+		{
+			template<typename T>
+			static inline T apply(const T& a)
+			{
+				return -a;
+			}
+
+			static CSGNode toCSGNode(const std::vector<CSGNode>& childs)
+			{
+				return opComp(childs);
+			}
+		};
+
+		template<typename Combiner, typename... Childs>
+		class OperationExpression
+		{
+		public:
+
+			explicit OperationExpression(const Childs&... childs) :
+				_childs(childs...)
+			{
+			}
+
+			template<typename T>
+			inline T operator()(const T& x, const T& y, const T& z) const
+			{
+				return evaluate(x, y, z, std::index_sequence_for<Childs...>());
+			}
+
+			CSGNode toCSGNode() const
+			{
+				return toCSGNode(std::index_sequence_for<Childs...>());
+			}
+
+		private:
+
+			template<typename T, size_t... I>
+			inline T evaluate(const T& x, const T& y, const T& z, std::index_sequence<I...>) const
+			{
+				return Combiner::apply(std::get<I>(_childs)(x, y, z)...);
+			}
+
+			template<size_t... I>
+			CSGNode toCSGNode(std::index_sequence<I...>) const
+			{
+				return Combiner::toCSGNode({ std::get<I>(_childs).toCSGNode()... });
+			}
+
+			std::tuple<Childs...> _childs;
+		};
+
+		inline SphereExpression sphere(const Eigen::Affine3d& transform, double radius, const std::string& name, double displacement = 0.0)
+		{
+			return SphereExpression(transform, radius, name, displacement);
+		}
+
+		inline BoxExpression box(const Eigen::Affine3d& transform, const Eigen::Vector3d& size, int numSubdivisions, const std::string& name, double displacement = 0.0)
+		{
+			return BoxExpression(transform, size, numSubdivisions, name, displacement);
+		}
+
+		inline CylinderExpression cylinder(const Eigen::Affine3d& transform, double radius, double height, const std::string& name)
+		{
+			return CylinderExpression(transform, radius, height, name);
+		}
+
+		inline ConeExpression cone(const Eigen::Affine3d& transform, const Eigen::Vector3d& c, const std::string& name)
+		{
+			return ConeExpression(transform, c, name);
+		}
+
+		template<typename... Childs>
+		inline OperationExpression<UnionCombiner, Childs...> union_(const Childs&... childs)
+		{
+			static_assert(sizeof...(Childs) > 0, "A union needs at least one child.");
+			return OperationExpression<UnionCombiner, Childs...>(childs...);
+		}
+
+		template<typename... Childs>
+		inline OperationExpression<IntersectionCombiner, Childs...> intersection(const Childs&... childs)
+		{
+			static_assert(sizeof...(Childs) > 0, "An intersection needs at least one child.");
+			return OperationExpression<IntersectionCombiner, Childs...>(childs...);
+		}
+
+		template<typename Left, typename Right>
+		inline OperationExpression<DifferenceCombiner, Left, Right> difference(const Left& left, const Right& right)
+		{
+			return OperationExpression<DifferenceCombiner, Left, Right>(left, right);
+		}
+
+		template<typename Child>
+		inline OperationExpression<ComplementCombiner, Child> complement(const Child& child)
+		{
+			return OperationExpression<ComplementCombiner, Child>(child);
+		}
+
+		// Bridge to the runtime tree.
+		template<typename Expression>
+		CSGNode toCSGNode(const Expression& expression)
+		{
+			return expression.toCSGNode();
+		}
+
+		// ps is N x 3 (one point per row).
+		template<typename Expression, typename Scalar>
+		Eigen::Matrix<Scalar, Eigen::Dynamic, 1> signedDistances(const Expression& expression, const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps)
+		{
+			Eigen::Matrix<Scalar, Eigen::Dynamic, 1> res(ps.rows());
+
+			#pragma omp parallel for
+			for (int i = 0; i < ps.rows(); ++i)
+				res(i) = expression(ps(i, 0), ps(i, 1), ps(i, 2));
+
+			return res;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SDF_KERNELS_H
+#define SDF_KERNELS_H
+
+#include <string>
+
+namespace lmu
+{
+	enum class SIMDLevel
+	{
+		Scalar = 0,
+		AVX2,
+		AVX512
+	};
+
+	std::string simdLevelToString(SIMDLevel level);
+
+	// Highest instruction set supported by the CPU and compiled into the library (see CSG_PLAYGROUND_SIMD).
+	SIMDLevel detectSIMDLevel();
+
+	// Scalar type used for batched distance evaluation (see [Sampling] Precision). 
+	// Float doubles the SIMD width and halves the memory traffic.
+	enum class Precision
+	{
+		Double = 0,
+		Float
+	};
+
+	std::string precisionToString(Precision precision);
+	Precision precisionFromString(std::string precision);
+
+	// Distance kernel over SoA coordinate arrays x, y, z with n entries each.
+	// invTrans is the row-major 3x4 world->local transform. params holds the primitive parameters:
+	// sphere: radius, box: half size x,y,z, cylinder: radius and half height, cone: c x,y,z.
+	template<typename Scalar>
+	using SDFKernel = void(*)(const Scalar* x, const Scalar* y, const Scalar* z, int n, const double* invTrans, const double* params, Scalar* out);
+
+	template<typename Scalar>
+	struct SDFKernelSet
+	{
+		SDFKernel<Scalar> sphere;
+		SDFKernel<Scalar> box;
+		SDFKernel<Scalar> cylinder;
+		SDFKernel<Scalar> cone;
+	};
+
+	struct SDFKernels
+	{
+		template<typename Scalar>
+		const SDFKernelSet<Scalar>& get() const;
+
+		SDFKernelSet<double> doubles;
+		SDFKernelSet<float> floats;
+		SIMDLevel level;
+	};
+
+	template<>
+	inline const SDFKernelSet<double>& SDFKernels::get<double>() const
+	{
+		return doubles;
+	}
+
+	template<>
+	inline const SDFKernelSet<float>& SDFKernels::get<float>() const
+	{
+		return floats;
+	}
+
+	// Kernels for a specific level. Falls back to scalar kernels if the level is not available.
+	SDFKernels sdfKernels(SIMDLevel level);
+
+	// Kernels for detectSIMDLevel(), selected on first use.
+	const SDFKernels& sdfKernels();
+
+#ifdef CSG_PLAYGROUND_SIMD
+	// Defined in translation units compiled with the corresponding instruction set enabled.
+	SDFKernels sdfKernelsAVX2();
+	SDFKernels sdfKernelsAVX512();
+#endif
+}
+
+#endif
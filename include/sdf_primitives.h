@@ -0,0 +1,187 @@
+#ifndef SDF_PRIMITIVES_H
+#define SDF_PRIMITIVES_H
+
+#include <cmath>
+#include <algorithm>
+
+// Signed distance formulas of the primitives in local coordinates.
+// T is either a scalar (double or float), a SIMD pack type, an Interval (see interval.h) or a HyperDual (see hyperdual.h). Parameters are always passed as double.
+// Non-scalar types provide the arithmetic operators and overloads of vsqr, vsqrt, vabs, vmax and vsign (found via ADL), 
+// types that support the displacement also vsin.
+// Squares use vsqr so that intervals stay tight.
+// Kept free of Eigen so that the SIMD kernel translation units can include it.
+
+namespace lmu
+{
+	namespace sdf
+	{
+		inline double vsqr(double v) { return v * v; }
+		inline double vsqrt(double v) { return std::sqrt(v); }
+		inline double vabs(double v) { return std::abs(v); }
+		inline double vmax(double a, double b) { return std::max(a, b); }
+		inline double vsign(double v) { return v < 0.0 ? -1.0 : (v > 0.0 ? 1.0 : 0.0); }
+		inline double vsin(double v) { return std::sin(v); }
+
+		inline float vsqr(float v) { return v * v; }
+		inline float vsqrt(float v) { return std::sqrt(v); }
+		inline float vabs(float v) { return std::abs(v); }
+		inline float vmax(float a, float b) { return std::max(a, b); }
+		inline float vsign(float v) { return v < 0.0f ? -1.0f : (v > 0.0f ? 1.0f : 0.0f); }
+		inline float vsin(float v) { return std::sin(v); }
+
+		// Applies a row-major 3x4 affine transform.
+		template<typename T>
+		inline void transformPoint(const T& x, const T& y, const T& z, const double* m, T& lx, T& ly, T& lz)
+		{
+			lx = T(m[0]) * x + T(m[1]) * y + T(m[2]) * z + T(m[3]);
+			ly = T(m[4]) * x + T(m[5]) * y + T(m[6]) * z + T(m[7]);
+			lz = T(m[8]) * x + T(m[9]) * y + T(m[10]) * z + T(m[11]);
+		}
+
+		template<typename T>
+		inline T sphereDistance(const T& x, const T& y, const T& z, double radius)
+		{
+			return vsqrt(vsqr(x) + vsqr(y) + vsqr(z)) - T(radius);
+		}
+
+		template<typename T>
+		inline T boxDistance(const T& x, const T& y, const T& z, double halfX, double halfY, double halfZ)
+		{
+			return vmax(vabs(x) - T(halfX), vmax(vabs(y) - T(halfY), vabs(z) - T(halfZ)));
+		}
+
+		template<typename T>
+		inline T cylinderDistance(const T& x, const T& y, const T& z, double radius, double halfHeight)
+		{
+			return vmax(vsqrt(vsqr(x) + vsqr(z)) - T(radius), vabs(y) - T(halfHeight));
+		}
+
+		template<typename T>
+		inline T coneDistance(const T& x, const T& y, const T& z, double cx, double cy, double cz)
+		{
+			const double vx = cz * cy / cx;
+			const double vy = -cz;
+			const double vvx = vx * vx + vy * vy;
+			const double vvy = vx * vx;
+
+			T qx = vsqrt(vsqr(x) + vsqr(z));
+			T qy = y;
+			T wx = T(vx) - qx;
+			T wy = T(vy) - qy;
+			T qvx = T(vx) * wx + T(vy) * wy;
+			T qvy = T(vx) * wx;
+			T dx = vmax(qvx, T(0.0)) * qvx / T(vvx);
+			T dy = vmax(qvy, T(0.0)) * qvy / T(vvy);
+
+			//Clamped since rounding can make the squared distance slightly negative close to the surface (NaN otherwise).
+			return vsqrt(vmax(vsqr(wx) + vsqr(wy) - vmax(dx, dy), T(0.0))) * vsign(vmax(qy * T(vx) - qx * T(vy), wy));
+		}
+
+		// Sine displacement of spheres and boxes (not available for SIMD packs and intervals).
+		template<typename T>
+		inline T displacement(const T& x, const T& y, const T& z, double d)
+		{
+			return vsin(T(d) * x) * vsin(T(d) * y) * vsin(T(d) * z);
+		}
+
+		// Analytic gradients of the formulas above (scalar only).
+		// Piecewise by the term that is active in the max(); the gradient is zero where it is not defined.
+
+		inline void boxGradient(double x, double y, double z, double halfX, double halfY, double halfZ, double& gx, double& gy, double& gz)
+		{
+			const double dx = std::abs(x) - halfX;
+			const double dy = std::abs(y) - halfY;
+			const double dz = std::abs(z) - halfZ;
+
+			gx = gy = gz = 0.0;
+			if (dx >= dy && dx >= dz)
+				gx = vsign(x);
+			else if (dy >= dz)
+				gy = vsign(y);
+			else
+				gz = vsign(z);
+		}
+
+		inline void cylinderGradient(double x, double y, double z, double radius, double halfHeight, double& gx, double& gy, double& gz)
+		{
+			const double q = std::sqrt(x * x + z * z);
+
+			gx = gy = gz = 0.0;
+			if (q - radius >= std::abs(y) - halfHeight)
+			{
+				//Radial region.
+				if (q > 0.0)
+				{
+					gx = x / q;
+					gz = z / q;
+				}
+			}
+			else
+			{
+				//Cap region.
+				gy = vsign(y);
+			}
+		}
+
+		inline void coneGradient(double x, double y, double z, double cx, double cy, double cz, double& gx, double& gy, double& gz)
+		{
+			const double vx = cz * cy / cx;
+			const double vy = -cz;
+			const double vvx = vx * vx + vy * vy;
+			const double vvy = vx * vx;
+
+			const double qx = std::sqrt(x * x + z * z);
+			const double qy = y;
+			const double wx = vx - qx;
+			const double wy = vy - qy;
+			const double qvx = vx * wx + vy * wy;
+			const double qvy = vx * wx;
+			const double dx = std::max(qvx, 0.0) * qvx / vvx;
+			const double dy = std::max(qvy, 0.0) * qvy / vvy;
+
+			const double d2 = wx * wx + wy * wy - std::max(dx, dy);
+			const double s = vsign(std::max(qy * vx - qx * vy, wy));
+
+			gx = gy = gz = 0.0;
+			if (d2 <= 0.0)
+				return;
+
+			//Gradient of the squared distance w.r.t. (qx, qy), depending on which projection is subtracted.
+			double gqx = -2.0 * wx;
+			double gqy = -2.0 * wy;
+			if (dx >= dy && dx > 0.0)
+			{
+				gqx += 2.0 * qvx / vvx * vx;
+				gqy += 2.0 * qvx / vvx * vy;
+			}
+			else if (dy > 0.0)
+			{
+				gqx += 2.0 * wx;
+			}
+
+			//d = s * sqrt(d2)
+			const double f = s / (2.0 * std::sqrt(d2));
+			gqx *= f;
+			gqy *= f;
+
+			//(qx, qy) -> (x, y, z)
+			if (qx > 0.0)
+			{
+				gx = gqx * x / qx;
+				gz = gqx * z / qx;
+			}
+			gy = gqy;
+		}
+
+		inline void displacementGradient(double x, double y, double z, double d, double& gx, double& gy, double& gz)
+		{
+			const double sx = std::sin(d * x), sy = std::sin(d * y), sz = std::sin(d * z);
+
+			gx = d * std::cos(d * x) * sy * sz;
+			gy = d * sx * std::cos(d * y) * sz;
+			gz = d * sx * sy * std::cos(d * z);
+		}
+	}
+}
+
+#endif
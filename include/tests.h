@@ -6,6 +6,21 @@
 #include "csgnode_evo.h"
 #include "csgnode_helper.h"
 #include "evolution.h"
+#include "csgtape.h"
+#include "csgarena.h"
+#include "csgnode_pool.h"
+#include "csgnode_cache.h"
+#include "csgnode_egraph.h"
+#include "sdf_expressions.h"
+#include "primitive_set.h"
+#include "csgnode_jit.h"
+#include "marching_cubes.h"
+#include "curvature.h"
+#include "csgnode_evo.h"
+
+#include <random>
+
+#include <igl/copyleft/marching_cubes.h>
 
 using namespace lmu;
 
@@ -19,6 +34,69 @@ std::unordered_map<std::string, ImplicitFunctionPtr> geometries(const std::vecto
 	return map;
 }
 
+//Points uniformly distributed in [lo, hi]^3, one per row.
+Eigen::MatrixXd randomPoints(int n, unsigned int seed = 0, double lo = -1.5, double hi = 1.5)
+{
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<double> dist(lo, hi);
+
+	Eigen::MatrixXd ps(n, 3);
+	for (int i = 0; i < n; ++i)
+		ps.row(i) << dist(gen), dist(gen), dist(gen);
+
+	return ps;
+}
+
+//Overlapping spheres with radius 0.5 along the x axis.
+std::vector<ImplicitFunctionPtr> sphereRow(int n)
+{
+	std::vector<ImplicitFunctionPtr> f;
+	for (int i = 0; i < n; ++i)
+		f.push_back(std::make_shared<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.3 * i, 0.0, 0.0), 0.5, "Sphere" + std::to_string(i)));
+
+	return f;
+}
+
+//Points in [-1.5, 1.5]^3 with random unit normals. Different seeds give different clouds.
+PointCloud randomPointCloud(int n, unsigned int seed = 0)
+{
+	PointCloud pc(n, 6);
+	pc.leftCols(3) = randomPoints(n, 2 * seed);
+	pc.rightCols(3) = randomPoints(n, 2 * seed + 1).rowwise().normalized();
+
+	return pc;
+}
+
+//Closed: each directed edge is matched by the opposite edge of exactly one other triangle.
+bool isClosedMesh(const Mesh& mesh)
+{
+	std::map<std::pair<int, int>, int> edges;
+	for (int i = 0; i < mesh.indices.rows(); ++i)
+		for (int j = 0; j < 3; ++j)
+			edges[std::make_pair(mesh.indices(i, j), mesh.indices(i, (j + 1) % 3))]++;
+
+	bool closed = true;
+	for (const auto& e : edges)
+		closed = closed && e.second == 1 && edges.count(std::make_pair(e.first.second, e.first.first)) == 1;
+
+	return closed;
+}
+
+//Enclosed volume of a closed mesh, positive if the triangles face outwards.
+double meshVolume(const Mesh& mesh)
+{
+	double volume = 0.0;
+	for (int i = 0; i < mesh.indices.rows(); ++i)
+	{
+		Eigen::Vector3d v0 = mesh.vertices.row(mesh.indices(i, 0)).transpose();
+		Eigen::Vector3d v1 = mesh.vertices.row(mesh.indices(i, 1)).transpose();
+		Eigen::Vector3d v2 = mesh.vertices.row(mesh.indices(i, 2)).transpose();
+		volume += v0.dot(v1.cross(v2)) / 6.0;
+	}
+
+	return volume;
+}
+
 //TESTS 
 TEST(CSGNodeTest)
 {
@@ -152,4 +230,1024 @@ TEST(CSGNodeTest)
 	mergedNode = mergeCSGNodeCliqueSimple(clique);
 }
 
-#endif
\ No newline at end of file
+TEST(GradientTest)
+{
+	using namespace lmu;
+
+	Eigen::Affine3d t = Eigen::Affine3d::Identity();
+	t.translate(Eigen::Vector3d(0.2, -0.1, 0.3));
+	t.rotate(Eigen::AngleAxisd(0.7, Eigen::Vector3d(1.0, 2.0, 0.5).normalized()));
+
+	std::vector<ImplicitFunctionPtr> functions =
+	{
+		std::make_shared<IFBox>(t, Eigen::Vector3d(0.8, 0.5, 1.2), 1, "Box"),
+		std::make_shared<IFBox>(t, Eigen::Vector3d(0.8, 0.5, 1.2), 1, "DisplacedBox", 2.0),
+		std::make_shared<IFCylinder>(t, 0.4, 1.0, "Cylinder"),
+		std::make_shared<IFCone>(t, Eigen::Vector3d(0.5, 0.5, 0.8), "Cone")
+	};
+
+	//Small step size: only points within h of a region boundary can disagree.
+	const double h = 1e-6;
+	const int numPoints = 1000;
+
+	Eigen::MatrixXd points = randomPoints(numPoints);
+
+	for (const auto& f : functions)
+	{
+		int numMismatches = 0;
+		for (int i = 0; i < numPoints; ++i)
+		{
+			Eigen::Vector3d p = points.row(i).transpose();
+
+			f->setGradientMode(GradientMode::Analytic);
+			Eigen::Vector4d analytic = f->signedDistanceAndGradient(p, h);
+
+			f->setGradientMode(GradientMode::FiniteDifference);
+			Eigen::Vector4d fd = f->signedDistanceAndGradient(p, h);
+
+			ASSERT_EQ(analytic.x(), fd.x());
+			if ((analytic - fd).cwiseAbs().maxCoeff() > 1e-4)
+				numMismatches++;
+		}
+
+		f->setGradientMode(GradientMode::Analytic);
+		
+		ASSERT_TRUE(numMismatches <= numPoints / 100);
+	}
+
+	//Operations only compute the gradient of the active primitive, scalar and batched.
+	CSGNode node = opUnion({ opDiff({ geometry(functions[0]), geometry(functions[2]) }), opInter({ geometry(functions[3]), opComp({ geometry(functions[1]) }) }) });
+
+	Eigen::MatrixXd ps = randomPoints(numPoints, 1);
+
+	Eigen::MatrixXd batched = node.signedDistanceAndGradients(ps, h);
+	for (int i = 0; i < numPoints; ++i)
+	{
+		Eigen::Vector3d p = ps.row(i).transpose();
+
+		Eigen::Vector4d dg = node.signedDistanceAndGradient(p, h);
+		HyperDual d = node.signedDistanceDerivatives(p, h);
+
+		ASSERT_EQ(dg.x(), node.signedDistance(p));
+		ASSERT_TRUE((dg.tail<3>() - d.g).cwiseAbs().maxCoeff() < 1e-12);
+		ASSERT_TRUE((batched.row(i).transpose() - dg).cwiseAbs().maxCoeff() < 1e-12);
+	}
+
+	//On ties, the first child wins, whatever the bounds.
+	CSGNode sphere = geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(-1.0, 0.0, 0.0), 0.5, "Sphere");
+	CSGNode box = geo<IFBox>((Eigen::Affine3d)Eigen::Translation3d(1.0, 0.0, 0.0), Eigen::Vector3d(1.0, 1.0, 1.0), 1, "Box");
+	for (const auto& n : { opUnion({ sphere, box }), opInter({ sphere, box }) })
+		ASSERT_TRUE(std::abs(n.signedDistanceAndGradient(Eigen::Vector3d::Zero(), h).y() - 1.0) < 1e-9);
+	for (const auto& n : { opUnion({ box, sphere }), opInter({ box, sphere }) })
+		ASSERT_TRUE(std::abs(n.signedDistanceAndGradient(Eigen::Vector3d::Zero(), h).y() + 1.0) < 1e-9);
+}
+
+TEST(IntervalTest)
+{
+	using namespace lmu;
+
+	Eigen::Affine3d t = Eigen::Affine3d::Identity();
+	t.translate(Eigen::Vector3d(0.2, -0.1, 0.3));
+	t.rotate(Eigen::AngleAxisd(0.7, Eigen::Vector3d(1.0, 2.0, 0.5).normalized()));
+
+	auto sphere = std::make_shared<IFSphere>(t, 0.6, "Sphere");
+	auto box = std::make_shared<IFBox>(t, Eigen::Vector3d(0.8, 0.5, 1.2), 1, "DisplacedBox", 2.0);
+	auto cylinder = std::make_shared<IFCylinder>(t, 0.4, 1.0, "Cylinder");
+	auto cone = std::make_shared<IFCone>(t, Eigen::Vector3d(0.5, 0.5, 0.8), "Cone");
+
+	CSGNode node = 
+		opUnion(
+		{
+			opDiff(
+			{
+				geometry(box),
+				geometry(sphere)
+			}),
+			opInter(
+			{
+				geometry(cylinder),
+				opComp({ geometry(cone) })
+			})
+		});
+
+	std::vector<CSGNode> nodes = { geometry(sphere), geometry(box), geometry(cylinder), geometry(cone), node };
+
+	const int numBoxes = 200;
+	const int numPoints = 50;
+
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<double> center(-1.5, 1.5);
+	std::uniform_real_distribution<double> extent(0.0, 0.5);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	//All sampled distances must lie within the bounds of the box they are sampled from.
+	for (const auto& n : nodes)
+	{
+		for (int i = 0; i < numBoxes; ++i)
+		{
+			Eigen::Vector3d c(center(gen), center(gen), center(gen));
+			Eigen::Vector3d e(extent(gen), extent(gen), extent(gen));
+
+			Interval bounds = n.signedDistanceInterval(c - e, c + e);
+			ASSERT_TRUE(bounds.lo <= bounds.hi);
+
+			for (int j = 0; j < numPoints; ++j)
+			{
+				Eigen::Vector3d p = c + Eigen::Vector3d(2.0 * unit(gen) - 1.0, 2.0 * unit(gen) - 1.0, 2.0 * unit(gen) - 1.0).cwiseProduct(e);
+				
+				ASSERT_TRUE(bounds.contains(n.signedDistance(p)));
+			}
+		}
+	}
+}
+
+TEST(BoundsTest)
+{
+	using namespace lmu;
+
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<double> pos(-2.0, 2.0);
+	std::uniform_real_distribution<double> size(0.1, 0.5);
+	std::uniform_real_distribution<double> angle(0.0, 3.0);
+
+	auto randomTransform = [&]()
+	{
+		Eigen::Affine3d t = Eigen::Affine3d::Identity();
+		t.translate(Eigen::Vector3d(pos(gen), pos(gen), pos(gen)));
+		t.rotate(Eigen::AngleAxisd(angle(gen), Eigen::Vector3d(pos(gen), pos(gen), pos(gen)).normalized()));
+		return t;
+	};
+
+	std::vector<ImplicitFunctionPtr> functions;
+	for (int i = 0; i < 10; ++i)
+	{
+		functions.push_back(std::make_shared<IFSphere>(randomTransform(), size(gen), "Sphere" + std::to_string(i), i % 2 == 0 ? 0.0 : 3.0));
+		functions.push_back(std::make_shared<IFBox>(randomTransform(), Eigen::Vector3d(size(gen), size(gen), size(gen)) * 2.0, 1, "Box" + std::to_string(i), i % 2 == 0 ? 0.0 : 3.0));
+		functions.push_back(std::make_shared<IFCylinder>(randomTransform(), size(gen), size(gen) * 2.0, "Cylinder" + std::to_string(i)));
+		functions.push_back(std::make_shared<IFCone>(randomTransform(), Eigen::Vector3d(size(gen), size(gen), size(gen) * 2.0), "Cone" + std::to_string(i)));
+	}
+
+	std::vector<CSGNode> childs;
+	for (int i = 0; i + 3 < functions.size(); i += 4)
+	{
+		childs.push_back(opDiff({ geometry(functions[i]), geometry(functions[i + 1]) }));
+		childs.push_back(opInter({ geometry(functions[i + 2]), opComp({ geometry(functions[i + 3]) }) }));
+		childs.push_back(geometry(functions[i + 3]));
+	}
+	CSGNode node = opUnion(childs);
+
+	std::vector<CSGNode> nodes = { node };
+	for (const auto& f : functions)
+		nodes.push_back(geometry(f));
+
+	const int numPoints = 2000;
+	Eigen::MatrixXd ps = randomPoints(numPoints, 1, -2.0, 2.0);
+
+	//Bounds must hold for all points.
+	for (const auto& n : nodes)
+	{
+		DistanceBounds bounds = n.bounds();
+		for (int i = 0; i < numPoints; ++i)
+		{
+			double d = n.signedDistance(ps.row(i).transpose());
+			ASSERT_TRUE(bounds.lowerBound(ps.row(i).transpose()) <= d);
+			ASSERT_TRUE(std::abs(d) <= bounds.upperBound(ps.row(i).transpose()));
+		}
+	}
+
+	//Skipping childs must not change the result (the tape evaluates all of them).
+	CSGTape tape(node);
+	Eigen::VectorXd expected = tape.signedDistances(ps);
+	Eigen::VectorXd batched = node.signedDistances(ps);
+	for (int i = 0; i < numPoints; ++i)
+	{
+		ASSERT_TRUE(std::abs(node.signedDistance(ps.row(i).transpose()) - expected(i)) < 1e-9);
+		ASSERT_TRUE(std::abs(batched(i) - expected(i)) < 1e-9);
+	}
+}
+
+TEST(HyperDualTest)
+{
+	using namespace lmu;
+
+	Eigen::Affine3d t = Eigen::Affine3d::Identity();
+	t.translate(Eigen::Vector3d(0.2, -0.1, 0.3));
+	t.rotate(Eigen::AngleAxisd(0.7, Eigen::Vector3d(1.0, 2.0, 0.5).normalized()));
+
+	std::vector<ImplicitFunctionPtr> functions =
+	{
+		std::make_shared<IFSphere>(t, 0.6, "Sphere"),
+		std::make_shared<IFSphere>(t, 0.6, "DisplacedSphere", 2.0),
+		std::make_shared<IFBox>(t, Eigen::Vector3d(0.8, 0.5, 1.2), 1, "DisplacedBox", 2.0),
+		std::make_shared<IFCylinder>(t, 0.4, 1.0, "Cylinder"),
+		std::make_shared<IFCone>(t, Eigen::Vector3d(0.5, 0.5, 0.8), "Cone")
+	};
+
+	//The finite difference Hessian (of the analytic gradient) is only compared away from kinks.
+	const double h = 1e-5;
+	const int numPoints = 1000;
+
+	Eigen::MatrixXd ps = randomPoints(numPoints);
+
+	for (const auto& f : functions)
+	{
+		int numMismatches = 0;
+		for (int i = 0; i < numPoints; ++i)
+		{
+			Eigen::Vector3d p = ps.row(i).transpose();
+
+			HyperDual d = f->signedDistanceDerivatives(p, h);
+			Eigen::Vector4d dg = f->signedDistanceAndGradient(p, h);
+
+			f->setGradientMode(GradientMode::FiniteDifference);
+			HyperDual fd = f->signedDistanceDerivatives(p, h);
+			f->setGradientMode(GradientMode::Analytic);
+
+			ASSERT_TRUE(std::abs(d.v - dg.x()) < 1e-12);
+			if ((d.g - fd.g).cwiseAbs().maxCoeff() > 1e-4 || (d.H - fd.H).cwiseAbs().maxCoeff() > 1e-2)
+				numMismatches++;
+		}
+
+		ASSERT_TRUE(numMismatches <= numPoints / 50);
+	}
+
+	//The tree selects the derivatives of the active primitive.
+	CSGNode node = opUnion({ opDiff({ geometry(functions[3]), geometry(functions[0]) }), geometry(functions[4]) });
+	for (int i = 0; i < numPoints; ++i)
+	{
+		Eigen::Vector3d p = ps.row(i).transpose();
+
+		HyperDual d = node.signedDistanceDerivatives(p, h);
+		ASSERT_TRUE(std::abs(d.v - node.signedDistance(p)) < 1e-12);
+	}
+
+	//Curvature is exact on smooth surfaces and large close to the edges of a box, where the edge filters look for outliers.
+	auto deviationFromFlatness = [](const Curvature& c) { return std::sqrt(c.k1 * c.k1 + c.k2 * c.k2); };
+	const double edgeH = 0.001;
+
+	CSGNode sphere = geo<IFSphere>(Eigen::Affine3d::Identity(), 0.6, "Sphere");
+	ASSERT_TRUE(std::abs(deviationFromFlatness(curvature(Eigen::Vector3d(0.6, 0.0, 0.0), sphere, edgeH)) - std::sqrt(2.0) / 0.6) < 1e-6);
+
+	CSGNode box = geo<IFBox>(Eigen::Affine3d::Identity(), Eigen::Vector3d(1.0, 1.0, 1.0), 1, "Box");
+	ASSERT_TRUE(deviationFromFlatness(curvature(Eigen::Vector3d(0.5, 0.5 - 0.5 * edgeH, 0.1), box, edgeH)) > 0.1 / edgeH);
+	ASSERT_TRUE(deviationFromFlatness(curvature(Eigen::Vector3d(0.5, 0.1, 0.1), box, edgeH)) < 1e-9);
+}
+
+TEST(CopyOnWriteTest)
+{
+	using namespace lmu;
+
+	auto g = geometries({ "A", "B", "C", "D" });
+
+	CSGNode n1 = opUnion({ opDiff({ geometry(g["A"]), geometry(g["B"]) }), opInter({ geometry(g["C"]), geometry(g["D"]) }) });
+	size_t h1 = n1.hash(0);
+
+	//Copies share the tree.
+	CSGNode n2 = n1;
+	ASSERT_TRUE(n1.nodePtr() == n2.nodePtr());
+
+	//Changing a node copies only the path to it.
+	CSGNode* b = nodePtrAt(n2, 3);
+	ASSERT_TRUE(b->function() == g["B"]);
+	*b = geometry(g["C"]);
+
+	ASSERT_TRUE(n1.nodePtr() != n2.nodePtr());
+	ASSERT_TRUE(n1.childsCRef()[0].nodePtr() != n2.childsCRef()[0].nodePtr());
+	ASSERT_TRUE(n1.childsCRef()[1].nodePtr() == n2.childsCRef()[1].nodePtr());
+	ASSERT_TRUE(n1.childsCRef()[0].childsCRef()[0].nodePtr() == n2.childsCRef()[0].childsCRef()[0].nodePtr());
+
+	//The original is unchanged.
+	ASSERT_EQ(n1.hash(0), h1);
+	ASSERT_TRUE(n1.childsCRef()[0].childsCRef()[1].function() == g["B"]);
+	ASSERT_TRUE(n2.childsCRef()[0].childsCRef()[1].function() == g["C"]);
+
+	//A const visit copies nothing, a visit of matching nodes only the paths to them.
+	CSGNode n3 = n1;
+	int numVisited = 0;
+	visit(static_cast<const CSGNode&>(n3), [&numVisited](const CSGNode&) { numVisited++; });
+	ASSERT_EQ(numVisited, 7);
+	ASSERT_TRUE(n3.nodePtr() == n1.nodePtr());
+
+	visit(n3, [&g](const CSGNode& n) { return n.function() == g["D"]; }, [&g](CSGNode& n) { n = geometry(g["A"]); });
+	ASSERT_TRUE(n3.childsCRef()[0].nodePtr() == n1.childsCRef()[0].nodePtr());
+	ASSERT_TRUE(n3.childsCRef()[1].childsCRef()[1].function() == g["A"]);
+	ASSERT_TRUE(n1.childsCRef()[1].childsCRef()[1].function() == g["D"]);
+
+	n2.addChild(geometry(g["A"]));
+	ASSERT_EQ(n1.childsCRef().size(), 2);
+	ASSERT_EQ(n2.childsCRef().size(), 3);
+}
+
+TEST(ArenaTest)
+{
+	using namespace lmu;
+
+	auto f = sphereRow(4);
+
+	//Union with three childs (overflow childs), shared function and a no-op.
+	CSGNode node = opUnion({ opDiff({ geometry(f[0]), opComp({ geometry(f[1]) }) }), opInter({ geometry(f[2]), geometry(f[0]) }), geometry(f[3]), opNo() });
+	node.setAttribute("score", 1.5);
+
+	CSGArena arena(node);
+
+	ASSERT_EQ(arena.numNodes(), numNodes(node));
+	ASSERT_EQ(arena.depth(), depth(node));
+	ASSERT_EQ(arena.functions().size(), 4);
+	ASSERT_EQ(arena.hash(0), node.hash(0));
+	ASSERT_EQ(boost::any_cast<double>(arena.attributes(arena.root())->at("score")), 1.5);
+
+	//Arena indices are the indices of nodePtrAt().
+	for (int i = 0; i < arena.numNodes(); ++i)
+	{
+		CSGNode* n = nodePtrAt(node, i);
+		ASSERT_EQ(arena.numNodes(i), numNodes(*n));
+		ASSERT_EQ(arena.depthAt(i), depthAt(node, i));
+		ASSERT_EQ(arena.hash(i, 0), n->hash(0));
+		ASSERT_TRUE(arena.function(i) == n->function());
+	}
+
+	CSGNode converted = arena.toCSGNode();
+	ASSERT_EQ(converted.hash(0), node.hash(0));
+	ASSERT_EQ(converted.attribute<double>("score"), 1.5);
+
+	Eigen::MatrixXd ps = randomPoints(100);
+	for (int i = 0; i < ps.rows(); ++i)
+	{
+		Eigen::Vector3d p = ps.row(i).transpose();
+		ASSERT_EQ(arena.signedDistance(p), node.signedDistance(p));
+		ASSERT_EQ(converted.signedDistance(p), node.signedDistance(p));
+	}
+
+	//Replacing a subtree.
+	CSGArena replaced = arena.replaced(1, arena.subtree(6));
+	*nodePtrAt(node, 1) = *nodePtrAt(node, 6);
+	ASSERT_EQ(replaced.numNodes(), numNodes(node));
+	ASSERT_EQ(replaced.hash(0), node.hash(0));
+
+	//An invalid replacement removes an operand of a union, the subtrahend of a difference becomes empty.
+	ASSERT_EQ(arena.replaced(8, CSGArena()).node(0).numChilds, 3);
+
+	CSGArena emptied = arena.replaced(3, CSGArena());
+	ASSERT_EQ(emptied.node(1).numChilds, 2);
+	ASSERT_EQ(emptied.numNodes(), arena.numNodes() - 1);
+	for (int i = 0; i < ps.rows(); ++i)
+		ASSERT_EQ(emptied.signedDistance(1, ps.row(i).transpose()), f[0]->signedDistance(ps.row(i).transpose()));
+}
+
+
+TEST(PoolTest)
+{
+	using namespace lmu;
+
+	auto g = geometries({ "A", "B", "C" });
+
+	//Separately built trees with the same Difference(A, B) subtree.
+	CSGNode n1 = opUnion({ opDiff({ geometry(g["A"]), geometry(g["B"]) }), geometry(g["C"]) });
+	CSGNode n2 = opInter({ geometry(g["C"]), opDiff({ geometry(g["A"]), geometry(g["B"]) }) });
+	CSGNode n3 = opUnion({ opDiff({ geometry(g["A"]), geometry(g["B"]) }), geometry(g["C"]) });
+	size_t h1 = n1.hash(0);
+
+	CSGNodePool pool;
+	CSGNode i1 = pool.intern(n1);
+	CSGNode i2 = pool.intern(n2);
+	CSGNode i3 = pool.intern(n3);
+
+	//A, B, C, Diff, Union and Intersection.
+	ASSERT_EQ(pool.size(), 6);
+	ASSERT_TRUE(i1.nodePtr() == i3.nodePtr());
+	ASSERT_TRUE(i1.nodePtr() != i2.nodePtr());
+	ASSERT_TRUE(i1.childsCRef()[0].nodePtr() == i2.childsCRef()[1].nodePtr());
+	ASSERT_EQ(pool.id(i1), pool.id(i3));
+	ASSERT_EQ(pool.id(n2), -1);
+	ASSERT_EQ(i1.hash(0), h1);
+
+	//Changing an interned tree copies the path and leaves the pool unchanged.
+	*nodePtrAt(i3, 1) = geometry(g["A"]);
+	ASSERT_EQ(pool.id(i3), -1);
+	ASSERT_EQ(i1.hash(0), h1);
+
+	//Only nodes that are still used survive pruning.
+	n1 = n2 = n3 = i2 = i3 = CSGNode::invalidNode;
+	pool.prune();
+	ASSERT_EQ(pool.size(), 5);
+	ASSERT_TRUE(pool.intern(opUnion({ opDiff({ geometry(g["A"]), geometry(g["B"]) }), geometry(g["C"]) })).nodePtr() == i1.nodePtr());
+
+	//Pruning only runs again once the pool doubled.
+	pool.intern(opInter({ geometry(g["A"]), geometry(g["C"]) }));
+	pool.pruneIfGrown();
+	ASSERT_EQ(pool.size(), 6);
+}
+
+
+TEST(SubtreeCacheTest)
+{
+	using namespace lmu;
+
+	auto f = sphereRow(4);
+	for (int i = 0; i < f.size(); ++i)
+		f[i]->setPoints(randomPointCloud(50, i));
+
+	CSGNode node = opUnion({ opDiff({ geometry(f[0]), opComp({ geometry(f[1]) }) }), opInter({ geometry(f[2]), geometry(f[0]) }), geometry(f[3]), opNo() });
+
+	//Same results as the tape.
+	CSGNodeResultCache cache(f[0]->pointsCRef().leftCols(3), 0.001, Precision::Double, 1024 * 1024);
+	Eigen::MatrixXd expected = CSGTape(node).signedDistanceAndGradients(Eigen::MatrixXd(f[0]->pointsCRef().leftCols(3)), 0.001);
+	ASSERT_TRUE(*cache.evaluate(node) == expected);
+	ASSERT_EQ(cache.statistics().numHits, 1); //Second Sphere0.
+	ASSERT_TRUE(*cache.evaluate(node) == expected);
+	ASSERT_EQ(cache.statistics().numHits, 2);
+
+	//Same ranks as without the cache.
+	CSGNodeRanker ranker(1.0, 0.01, 0.5, 0.001, f);
+	CSGNodeRanker cachedRanker(1.0, 0.01, 0.5, 0.001, f, Graph(), Precision::Double, 1024 * 1024);
+	ASSERT_EQ(cachedRanker.rank(node), ranker.rank(node));
+
+	//A changed tree only evaluates the path to the root, the other subtrees are cached.
+	long long numTries = cachedRanker.cacheStatistics().numTries;
+	*nodePtrAt(node, 1) = geometry(f[1]);
+	ASSERT_EQ(cachedRanker.rank(node), ranker.rank(node));
+	ASSERT_EQ(cachedRanker.cacheStatistics().numTries - numTries, 5);
+	ASSERT_EQ(cachedRanker.cacheStatistics().numHits, 5);
+
+	//With precomputed primitives, the cache takes the results of the leaves from them (here of other points, to tell them apart).
+	Eigen::MatrixXd otherPs = f[0]->pointsCRef().leftCols(3).array() + 0.1;
+	auto otherPrimitives = std::make_shared<const PrecomputedPrimitives>(f, otherPs, 0.001);
+	CSGNodeResultCache primitivesCache(f[0]->pointsCRef().leftCols(3), 0.001, Precision::Double, 1024 * 1024, true, otherPrimitives);
+	ASSERT_TRUE(*primitivesCache.evaluate(geometry(f[2])) == otherPrimitives->signedDistanceAndGradients(f[2]));
+
+	CSGNodeRanker cachedPrecomputedRanker(1.0, 0.01, 0.5, 0.001, f, Graph(), Precision::Double, 1024 * 1024, 1024 * 1024);
+	ASSERT_EQ(cachedPrecomputedRanker.rank(node), ranker.rank(node));
+
+	//Operands are keyed in their order, so ties are resolved like in the tape.
+	CSGNodeResultCache orderCache(f[0]->pointsCRef().leftCols(3), 0.001, Precision::Double, 1024 * 1024);
+	for (const auto& n : { opUnion({ geometry(f[0]), opInter({ geometry(f[1]), geometry(f[2]) }) }), opUnion({ opInter({ geometry(f[2]), geometry(f[1]) }), geometry(f[0]) }),
+		opDiff({ geometry(f[0]), geometry(f[1]) }), opDiff({ geometry(f[1]), geometry(f[0]) }) })
+		ASSERT_TRUE(*orderCache.evaluate(n) == CSGTape(n).signedDistanceAndGradients(Eigen::MatrixXd(f[0]->pointsCRef().leftCols(3)), 0.001));
+
+	//Entries keep their functions, so addresses of evaluated functions are not reused.
+	std::weak_ptr<ImplicitFunction> evaluated;
+	{
+		ImplicitFunctionPtr temporary = std::make_shared<IFSphere>(Eigen::Affine3d::Identity(), 0.5, "Temporary");
+		evaluated = temporary;
+		orderCache.evaluate(geometry(temporary));
+	}
+	ASSERT_TRUE(!evaluated.expired());
+
+	//Keys count towards the size: nine distinct subtrees.
+	ASSERT_TRUE(cache.statistics().numBytes > 9 * 50 * 4 * sizeof(double));
+
+	//The cache stays within its size.
+	CSGNodeResultCache smallCache(f[0]->pointsCRef().leftCols(3), 0.001, Precision::Double, 3 * 50 * 4 * sizeof(double));
+	smallCache.evaluate(node);
+	ASSERT_TRUE(smallCache.statistics().numBytes <= 3 * 50 * 4 * sizeof(double));
+	ASSERT_TRUE(*smallCache.evaluate(node) == CSGTape(node).signedDistanceAndGradients(Eigen::MatrixXd(f[0]->pointsCRef().leftCols(3)), 0.001));
+}
+
+
+TEST(PrecomputedPrimitivesTest)
+{
+	using namespace lmu;
+
+	auto f = sphereRow(3);
+	for (int i = 0; i < f.size(); ++i)
+		f[i]->setPoints(randomPointCloud(50, i));
+
+	CSGNode node = opUnion({ opDiff({ geometry(f[0]), opComp({ geometry(f[1]) }) }), opInter({ geometry(f[2]), geometry(f[0]) }), opNo() });
+	CSGTape tape(node);
+	Eigen::MatrixXd ps = f[1]->pointsCRef().leftCols(3);
+
+	PrecomputedPrimitives primitives(f, ps, 0.001);
+	ASSERT_EQ(primitives.memory(), PrecomputedPrimitives::memoryEstimate(3, 50));
+	ASSERT_TRUE(primitives.contains(tape));
+	ASSERT_TRUE(tape.signedDistanceAndGradients(primitives) == tape.signedDistanceAndGradients(ps, 0.001));
+
+	PrecomputedPrimitives floatPrimitives(f, ps, 0.001, Precision::Float);
+	ASSERT_TRUE(tape.signedDistanceAndGradients(floatPrimitives) == tape.signedDistanceAndGradients(Eigen::MatrixXf(ps.cast<float>()), 0.001).cast<double>());
+
+	PrecomputedPrimitives otherPrimitives({ f[0], f[1] }, ps, 0.001);
+	ASSERT_TRUE(!otherPrimitives.contains(tape));
+
+	//Same ranks as without precomputation, also if the budget is too small.
+	CSGNodeRanker ranker(1.0, 0.01, 0.5, 0.001, f);
+	CSGNodeRanker precomputedRanker(1.0, 0.01, 0.5, 0.001, f, Graph(), Precision::Double, 0, 1024 * 1024);
+	CSGNodeRanker fallbackRanker(1.0, 0.01, 0.5, 0.001, f, Graph(), Precision::Double, 0, 1024);
+	ASSERT_EQ(precomputedRanker.rank(node), ranker.rank(node));
+	ASSERT_EQ(fallbackRanker.rank(node), ranker.rank(node));
+
+	//Float rankers convert the points once, precomputed float results rank the same.
+	CSGNodeRanker floatRanker(1.0, 0.01, 0.5, 0.001, f, Graph(), Precision::Float);
+	CSGNodeRanker floatPrecomputedRanker(1.0, 0.01, 0.5, 0.001, f, Graph(), Precision::Float, 0, 1024 * 1024);
+	ASSERT_EQ(floatPrecomputedRanker.rank(node), floatRanker.rank(node));
+	ASSERT_TRUE(std::abs(floatRanker.rank(node) - ranker.rank(node)) < 1e-3 * std::abs(ranker.rank(node)));
+}
+
+TEST(EGraphTest)
+{
+	using namespace lmu;
+
+	auto g = geometries({ "A", "B", "C" });
+	CSGNode a = geometry(g["A"]);
+	CSGNode b = geometry(g["B"]);
+	CSGNode c = geometry(g["C"]);
+
+	//Absorption, double complement, flattening and idempotence.
+	ASSERT_TRUE(optimizeCSGNodeWithEGraph(opUnion({ a, opInter({ a, b }) })).function() == g["A"]);
+	ASSERT_TRUE(optimizeCSGNodeWithEGraph(opComp({ opComp({ a }) })).function() == g["A"]);
+	ASSERT_EQ(numNodes(optimizeCSGNodeWithEGraph(opUnion({ opUnion({ a, b }), a }))), 3);
+
+	//Intersection with a complement is a difference.
+	CSGNode diff = optimizeCSGNodeWithEGraph(opInter({ a, opComp({ b }) }));
+	ASSERT_TRUE(diff.operationType() == CSGNodeOperationType::Difference);
+
+	//A difference of equal operands and a contradiction are only empty as sets.
+	CSGNode selfDiff = opDiff({ opUnion({ a, b }), opUnion({ b, a }) });
+	ASSERT_TRUE(numNodes(optimizeCSGNodeWithEGraph(selfDiff)) > 1);
+	ASSERT_EQ(numNodes(optimizeCSGNodeWithEGraph(selfDiff, CSGNodeCost::NumNodes, 8, 5000, true)), 1);
+	ASSERT_TRUE(numNodes(optimizeCSGNodeWithEGraph(opInter({ a, opComp({ a }) }))) > 1);
+	ASSERT_EQ(numNodes(optimizeCSGNodeWithEGraph(opInter({ a, opComp({ a }) }), CSGNodeCost::NumNodes, 8, 5000, true)), 1);
+
+	//De Morgan.
+	ASSERT_EQ(numNodes(optimizeCSGNodeWithEGraph(opInter({ opComp({ a }), opComp({ b }) }))), 4);
+
+	//Same distances and gradients as the original tree, never more expensive.
+	auto f = sphereRow(3);
+	Eigen::MatrixXd ps = randomPoints(200);
+
+	CSGNode node = opUnion({ opInter({ geometry(f[0]), opComp({ geometry(f[1]) }) }), opComp({ opUnion({ opComp({ geometry(f[2]) }), opComp({ geometry(f[0]) }) }) }), geometry(f[0]) });
+	for (CSGNodeCost cost : { CSGNodeCost::NumNodes, CSGNodeCost::Evaluation })
+	{
+		CSGNode optimized = optimizeCSGNodeWithEGraph(node, cost);
+		ASSERT_TRUE(CSGEGraph::cost(optimized, cost) < CSGEGraph::cost(node, cost));
+		ASSERT_TRUE(CSGTape(optimized).signedDistanceAndGradients(ps, 0.001) == CSGTape(node).signedDistanceAndGradients(ps, 0.001));
+	}
+
+	//Ties between operands keep the order of the input tree.
+	CSGNode ordered = optimizeCSGNodeWithEGraph(opUnion({ opUnion({ geometry(f[2]), geometry(f[1]) }), geometry(f[0]), geometry(f[2]) }));
+	ASSERT_TRUE(ordered.childsCRef()[0].function() == f[2] && ordered.childsCRef()[1].function() == f[1] && ordered.childsCRef()[2].function() == f[0]);
+
+	//Differences and unions that do not cancel out keep their distances.
+	CSGNode mixed = opUnion({ opDiff({ geometry(f[1]), geometry(f[0]) }), opInter({ geometry(f[2]), opComp({ geometry(f[1]) }) }) });
+	ASSERT_TRUE(CSGTape(optimizeCSGNodeWithEGraph(mixed)).signedDistances(ps) == CSGTape(mixed).signedDistances(ps));
+
+	//Saturation stops at the node limit.
+	CSGEGraph graph(node);
+	graph.saturate(100, 10);
+	ASSERT_TRUE(graph.numNodes() < 100);
+}
+
+TEST(StaticModelTest)
+{
+	using namespace lmu;
+
+	Eigen::AngleAxisd rot90x(M_PI / 2.0, Eigen::Vector3d(0.0, 0.0, 1.0));
+
+	auto model = sdf::difference(
+		sdf::union_(
+			sdf::box(Eigen::Affine3d::Identity(), Eigen::Vector3d(0.6, 0.6, 0.6), 2, "Box_0", 2.0),
+			sdf::sphere((Eigen::Affine3d)Eigen::Translation3d(0, -0.3, 0), 0.3, "Sphere_0"),
+			sdf::intersection(
+				sdf::cylinder((Eigen::Affine3d)(Eigen::Translation3d(0, 0, -0.2) * rot90x), 0.2, 1.0, "Cylinder_0"),
+				sdf::complement(sdf::cone((Eigen::Affine3d)Eigen::Translation3d(0.3, 0, -0.5), Eigen::Vector3d(0.6, 0.6, 0.6), "Cone_0")))),
+		sdf::sphere((Eigen::Affine3d)Eigen::Translation3d(0, 0.7, 0), 0.4, "Sphere_1"));
+
+	CSGNode node = sdf::toCSGNode(model);
+	ASSERT_EQ(numNodes(node), 9);
+	ASSERT_TRUE(node.operationType() == CSGNodeOperationType::Difference);
+	ASSERT_EQ(node.childsCRef()[0].childsCRef().size(), 3);
+
+	Eigen::MatrixXd ps = randomPoints(200);
+
+	//Same distances as the runtime tree, up to rounding of the transforms.
+	Eigen::VectorXd ds = sdf::signedDistances(model, ps);
+	for (int i = 0; i < ps.rows(); ++i)
+	{
+		ASSERT_TRUE(std::abs(ds(i) - node.signedDistance(ps.row(i).transpose())) < 1e-9);
+		ASSERT_TRUE(std::abs(model((float)ps(i, 0), (float)ps(i, 1), (float)ps(i, 2)) - ds(i)) < 1e-4);
+	}
+}
+
+TEST(PrimitiveSetTest)
+{
+	using namespace lmu;
+
+	Eigen::AngleAxisd rot(0.3, Eigen::Vector3d(1.0, 2.0, 0.5).normalized());
+
+	std::vector<ImplicitFunctionPtr> f = 
+	{
+		std::make_shared<IFBox>((Eigen::Affine3d)(Eigen::Translation3d(0.1, 0.2, 0.0) * rot), Eigen::Vector3d(0.6, 0.8, 0.4), 2, "Box_0", 2.0),
+		std::make_shared<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.0, -0.3, 0.0), 0.3, "Sphere_0"),
+		std::make_shared<IFCone>((Eigen::Affine3d)(Eigen::Translation3d(0.3, 0.0, -0.5) * rot), Eigen::Vector3d(0.6, 0.6, 0.6), "Cone_0"),
+		std::make_shared<IFNull>("Null_0"),
+		std::make_shared<IFCylinder>((Eigen::Affine3d)rot, 0.2, 1.0, "Cylinder_0"),
+		std::make_shared<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.0, 0.7, 0.0), 0.4, "Sphere_1", 3.0)
+	};
+
+	PrimitiveSet set(f);
+	ASSERT_EQ(set.size(), 6);
+	ASSERT_EQ(set.numFallbacks(), 0);
+
+	Eigen::MatrixXd ps = randomPoints(100);
+	Eigen::MatrixXf psf = ps.cast<float>();
+
+	//Same results as the facade, in the order of the functions.
+	auto ds = set.signedDistances(ps);
+	auto dsf = set.signedDistances(psf);
+	for (int i = 0; i < f.size(); ++i)
+	{
+		ASSERT_TRUE(ds[i] == f[i]->signedDistances(ps));
+		ASSERT_TRUE(dsf[i] == f[i]->signedDistances(psf));
+	}
+
+	//Primitives of a subset are copied from the converted set, other functions are converted.
+	auto g = sphereRow(1);
+	PrimitiveSet subset({ g[0], f[4], f[1] }, set);
+	auto dsSubset = subset.signedDistances(ps);
+	ASSERT_EQ(subset.size(), 3);
+	ASSERT_TRUE(dsSubset[0] == g[0]->signedDistances(ps) && dsSubset[1] == ds[4] && dsSubset[2] == ds[1]);
+
+	CSGNode node = opUnion({ geometry(f[1]), opDiff({ geometry(f[0]), geometry(f[5]) }) });
+	ASSERT_TRUE(CSGTape(node, set).signedDistances(ps) == CSGTape(node).signedDistances(ps));
+	ASSERT_EQ(CSGTape(node, set).primitiveSet().size(), 3);
+
+	Primitive cone;
+	ASSERT_TRUE(Primitive::fromFunction(*f[2], cone));
+	ASSERT_TRUE(cone.type == ImplicitFunctionType::Cone);
+	for (int i = 0; i < ps.rows(); ++i)
+		ASSERT_TRUE(std::abs(cone.signedDistance(ps(i, 0), ps(i, 1), ps(i, 2)) - f[2]->signedDistance(ps.row(i).transpose())) < 1e-9);
+}
+
+TEST(JITTest)
+{
+	using namespace lmu;
+
+	Eigen::AngleAxisd rot(0.3, Eigen::Vector3d(1.0, 2.0, 0.5).normalized());
+
+	CSGNode node = opDiff({
+		opUnion({
+			geo<IFBox>((Eigen::Affine3d)(Eigen::Translation3d(0.1, 0.2, 0.0) * rot), Eigen::Vector3d(0.6, 0.8, 0.4), 2, "Box_0", 2.0),
+			geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.0, -0.3, 0.0), 0.3, "Sphere_0"),
+			opInter({ geo<IFCylinder>((Eigen::Affine3d)rot, 0.2, 1.0, "Cylinder_0"), opComp({ geo<IFCone>((Eigen::Affine3d)Eigen::Translation3d(0.3, 0.0, -0.5), Eigen::Vector3d(0.6, 0.6, 0.6), "Cone_0") }) }), 
+			opNo() }),
+		geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.0, 0.7, 0.0), 0.4, "Sphere_1") });
+
+	std::string source = CSGNodeCompiler::generateSource(node);
+	ASSERT_TRUE(source.find("Cone_0") != std::string::npos);
+	ASSERT_TRUE(source == CSGNodeCompiler::generateSource(node));
+
+	if (!CSGNodeCompiler::isAvailable())
+		return;
+
+	Eigen::MatrixXd ps = randomPoints(200);
+
+	CSGNodeCompiler compiler("/tmp");
+	auto compiled = compiler.compile(node);
+	ASSERT_TRUE((compiled->signedDistances(ps) - CSGTape(node).signedDistances(ps)).cwiseAbs().maxCoeff() < 1e-9);
+
+	//The second compile loads the cached library.
+	ASSERT_TRUE(compiler.compile(node)->libraryPath() == compiled->libraryPath());
+
+	//Other flags build another library.
+	CSGNodeCompiler otherCompiler("/tmp", "c++", "-O1");
+	ASSERT_TRUE(otherCompiler.compile(node)->libraryPath() != compiled->libraryPath());
+
+	//A library whose stored unit does not match (e.g. a hash collision) is built again.
+	std::string sourcePath = compiled->libraryPath().substr(0, compiled->libraryPath().size() - 3) + ".cpp";
+	std::ofstream(sourcePath) << "// Other tree";
+	auto recompiled = compiler.compile(node);
+	ASSERT_TRUE((recompiled->signedDistances(ps) - CSGTape(node).signedDistances(ps)).cwiseAbs().maxCoeff() < 1e-9);
+
+	std::ifstream stored(sourcePath);
+	std::string firstLine;
+	std::getline(stored, firstLine);
+	ASSERT_TRUE(firstLine == "// c++ -O3 -march=native");
+}
+
+TEST(TilingTest)
+{
+	using namespace lmu;
+
+	//Sphere grid of model 2 in main_sampling.cpp and a small tree with all operations.
+	std::vector<CSGNode> spheres;
+	for (int i = 0; i < 20; ++i)
+		spheres.push_back(geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.3 * (i / 4), 0.3 * (i % 4), 0.0), 0.25, "Sphere_" + std::to_string(i)));
+
+	CSGNode node = opUnion({
+		opUnion(spheres),
+		opDiff({ geo<IFBox>((Eigen::Affine3d)Eigen::Translation3d(0.6, 0.5, 0.8), Eigen::Vector3d(0.6, 0.6, 0.6), 2, "Box_0"), 
+			opInter({ geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.6, 0.5, 1.0), 0.3, "Sphere_20"), opComp({ geo<IFCylinder>(Eigen::Affine3d::Identity(), 0.1, 4.0, "Cylinder_0") }) }) }) });
+
+	//Only the spheres close to a small box remain.
+	CSGNode pruned = pruneCSGNode(node, Eigen::Vector3d(-0.05, -0.05, -0.05), Eigen::Vector3d(0.05, 0.05, 0.05));
+	ASSERT_TRUE(numNodes(pruned) < 5);
+
+	//Nothing can be removed for the whole scene.
+	ASSERT_TRUE(pruneCSGNode(node, Eigen::Vector3d(-1.0, -1.0, -1.0), Eigen::Vector3d(2.0, 2.0, 2.0)).nodePtr() == node.nodePtr());
+
+	Eigen::MatrixXd ps = randomPoints(2000, 0, -0.5, 1.5);
+
+	CSGTape tape(node);
+	for (double tileSize : { 0.05, 0.2, 10.0 })
+	{
+		ASSERT_TRUE(signedDistancesTiled(node, ps, tileSize) == tape.signedDistances(ps));
+
+		Eigen::MatrixXf psf = ps.cast<float>();
+		ASSERT_TRUE((signedDistancesTiled(node, psf, tileSize) - tape.signedDistances(psf)).cwiseAbs().maxCoeff() < 1e-6f);
+	}
+}
+
+TEST(TransformClassTest)
+{
+	using namespace lmu;
+
+	Eigen::Affine3d rotation = (Eigen::Affine3d)Eigen::AngleAxisd(0.5, Eigen::Vector3d(1.0, 1.0, 0.0).normalized());
+	rotation.translation() = Eigen::Vector3d(0.1, 0.2, 0.3);
+
+	IFSphere identity(Eigen::Affine3d::Identity(), 0.5, "Sphere_0");
+	IFSphere translated((Eigen::Affine3d)Eigen::Translation3d(0.3, -0.2, 0.1), 0.5, "Sphere_1");
+	IFBox rotated(rotation, Eigen::Vector3d(0.6, 0.4, 0.8), 2, "Box_0", 2.0);
+	IFBox scaled(rotation * Eigen::Scaling(1.0, 2.0, 0.5), Eigen::Vector3d(0.6, 0.4, 0.8), 2, "Box_1");
+
+	ASSERT_TRUE(identity.transformClass() == TransformClass::Identity);
+	ASSERT_TRUE(translated.transformClass() == TransformClass::Translation);
+	ASSERT_TRUE(rotated.transformClass() == TransformClass::Rigid);
+	ASSERT_TRUE(scaled.transformClass() == TransformClass::Affine);
+
+	Eigen::MatrixXd ps = randomPoints(500, 0, -1.0, 1.0);
+
+	for (int i = 0; i < ps.rows(); ++i)
+	{
+		Eigen::Vector3d p = ps.row(i).transpose();
+
+		ASSERT_TRUE(std::abs(identity.signedDistance(p) - (p.norm() - 0.5)) < 1e-12);
+		ASSERT_TRUE(std::abs(translated.signedDistance(p) - ((p - Eigen::Vector3d(0.3, -0.2, 0.1)).norm() - 0.5)) < 1e-12);
+		ASSERT_TRUE((translated.signedDistanceAndGradient(p).tail(3) - (p - Eigen::Vector3d(0.3, -0.2, 0.1)).normalized()).norm() < 1e-12);
+	}
+
+	//Specialized single point and batch paths agree.
+	for (ImplicitFunction* f : std::vector<ImplicitFunction*>{ &identity, &translated, &rotated, &scaled })
+	{
+		Eigen::VectorXd ds = f->signedDistances(ps);
+		Eigen::MatrixXd dgs = f->signedDistanceAndGradients(ps);
+		for (int i = 0; i < ps.rows(); ++i)
+		{
+			ASSERT_TRUE(std::abs(f->signedDistance(ps.row(i).transpose()) - ds(i)) < 1e-9);
+			ASSERT_TRUE((f->signedDistanceAndGradient(ps.row(i).transpose()) - dgs.row(i).transpose()).norm() < 1e-9);
+		}
+
+		//Interval bounds stay conservative.
+		Interval d = f->signedDistanceInterval(Eigen::Vector3d(-1.0, -1.0, -1.0), Eigen::Vector3d(1.0, 1.0, 1.0));
+		ASSERT_TRUE(d.lo <= ds.minCoeff() && ds.maxCoeff() <= d.hi);
+	}
+}
+
+TEST(AdaptiveMeshingTest)
+{
+	using namespace lmu;
+
+	CSGNode sphere = geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.1, 0.0, -0.1), 0.6, "Sphere_0");
+	CSGNode node = opUnion({ 
+		opDiff({ geo<IFBox>((Eigen::Affine3d)Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ()), Eigen::Vector3d(1.0, 0.8, 0.6), 2, "Box_0"), 
+			geo<IFCylinder>(Eigen::Affine3d::Identity(), 0.2, 2.0, "Cylinder_0") }),
+		geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.6, 0.5, 0.0), 0.3, "Sphere_1") });
+
+	Eigen::Vector3d min(-1.0, -1.0, -1.0), max(1.0, 1.0, 1.0);
+	double stepSize = (max - min).maxCoeff() * 1.1 / 64;
+
+	for (const CSGNode& n : { sphere, node })
+	{
+		for (Precision precision : { Precision::Double, Precision::Float })
+		{
+			Mesh mesh = computeMeshAdaptive(n, Eigen::Vector3i(64, 64, 64), min, max, precision);
+			ASSERT_TRUE(mesh.indices.rows() > 0);
+			ASSERT_TRUE(isClosedMesh(mesh));
+
+			double maxDistance = 0.0;
+			for (int i = 0; i < mesh.vertices.rows(); ++i)
+				maxDistance = std::max(maxDistance, std::abs(n.signedDistance(mesh.vertices.row(i).transpose())));
+			ASSERT_TRUE(maxDistance < stepSize);
+
+			//Triangles face outwards, so the enclosed volume is positive.
+			double volume = meshVolume(mesh);
+			ASSERT_TRUE(volume > 0.0);
+
+			if (n.nodePtr() == sphere.nodePtr())
+				ASSERT_TRUE(std::abs(volume - 4.0 / 3.0 * M_PI * 0.6 * 0.6 * 0.6) < 0.01);
+		}
+	}
+}
+
+TEST(MarchingCubesTest)
+{
+	using namespace lmu;
+
+	//Random values (with all ambiguous configurations) inside a positive border.
+	Eigen::Vector3i numSamples(12, 11, 13);
+	std::mt19937 gen(0);
+	std::uniform_int_distribution<int> dist(-2, 2);
+
+	Eigen::VectorXd grid(numSamples.prod());
+	for (int z = 0; z < numSamples.z(); ++z)
+		for (int y = 0; y < numSamples.y(); ++y)
+			for (int x = 0; x < numSamples.x(); ++x)
+			{
+				bool border = x == 0 || y == 0 || z == 0 || x == numSamples.x() - 1 || y == numSamples.y() - 1 || z == numSamples.z() - 1;
+				grid(x + numSamples.x() * (y + numSamples.y() * z)) = border ? 1.0 : 0.5 * dist(gen);
+			}
+
+	auto sample = [&grid, &numSamples](int z0, int z1, const Eigen::MatrixXd& points) -> Eigen::VectorXd
+	{
+		return grid.segment(z0 * numSamples.x() * numSamples.y(), points.rows());
+	};
+
+	Mesh mesh = marchingCubes(numSamples, Eigen::Vector3d::Zero(), Eigen::Vector3d::Ones(), 4, sample);
+	ASSERT_TRUE(mesh.indices.rows() > 0);
+
+	//Same mesh as libigl.
+	Eigen::MatrixXd points(numSamples.prod(), 3);
+	for (int z = 0; z < numSamples.z(); ++z)
+		for (int y = 0; y < numSamples.y(); ++y)
+			for (int x = 0; x < numSamples.x(); ++x)
+				points.row(x + numSamples.x() * (y + numSamples.y() * z)) << x, y, z;
+
+	Eigen::MatrixXd iglVertices;
+	Eigen::MatrixXi iglIndices;
+	igl::copyleft::marching_cubes(grid, points, numSamples.x(), numSamples.y(), numSamples.z(), iglVertices, iglIndices);
+	ASSERT_TRUE(mesh.vertices == iglVertices);
+	ASSERT_TRUE(mesh.indices == iglIndices);
+
+	//The mesh does not depend on the slabs.
+	for (int slabSize : { 1, 3, 100 })
+	{
+		Mesh slabMesh = marchingCubes(numSamples, Eigen::Vector3d::Zero(), Eigen::Vector3d::Ones(), slabSize, sample);
+		ASSERT_TRUE(slabMesh.vertices == mesh.vertices);
+		ASSERT_TRUE(slabMesh.indices == mesh.indices);
+	}
+
+	CSGNode sphere = geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.1, 0.0, -0.1), 0.6, "Sphere_0");
+	Mesh sphereMesh = computeMesh(sphere, Eigen::Vector3i(64, 64, 64), Eigen::Vector3d(-1.0, -1.0, -1.0), Eigen::Vector3d(1.0, 1.0, 1.0));
+	ASSERT_TRUE(isClosedMesh(sphereMesh));
+	ASSERT_TRUE(std::abs(meshVolume(sphereMesh) - 4.0 / 3.0 * M_PI * 0.6 * 0.6 * 0.6) < 0.01);
+}
+
+TEST(StreamingMeshTest)
+{
+	using namespace lmu;
+
+	CSGNode node = opUnion({ 
+		opDiff({ geo<IFBox>((Eigen::Affine3d)Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ()), Eigen::Vector3d(1.0, 0.8, 0.6), 2, "Box_0"), 
+			geo<IFCylinder>(Eigen::Affine3d::Identity(), 0.2, 2.0, "Cylinder_0") }),
+		geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.6, 0.5, 0.0), 0.3, "Sphere_0") });
+
+	Eigen::Vector3i numSamples(40, 48, 56);
+	Eigen::Vector3d min(-1.0, -1.0, -1.0), max(1.0, 1.0, 1.0);
+
+	Mesh mesh = computeMesh(node, numSamples, min, max);
+	int64_t numTriangles = computeMeshToOBJ(node, numSamples, "/tmp/streaming_mesh_test.obj", min, max);
+	ASSERT_EQ(numTriangles, (int64_t)mesh.indices.rows());
+
+	//The file holds the same mesh (up to the printed precision).
+	std::ifstream f("/tmp/streaming_mesh_test.obj");
+	std::vector<Eigen::Vector3d> vertices;
+	std::vector<Eigen::Vector3i> indices;
+	std::string type;
+	while (f >> type)
+	{
+		if (type == "v")
+		{
+			Eigen::Vector3d v;
+			f >> v.x() >> v.y() >> v.z();
+			vertices.push_back(v);
+		}
+		else if (type == "f")
+		{
+			Eigen::Vector3i i;
+			f >> i.x() >> i.y() >> i.z();
+			indices.push_back(i - Eigen::Vector3i(1, 1, 1));
+		}
+	}
+
+	ASSERT_EQ((int)vertices.size(), (int)mesh.vertices.rows());
+	ASSERT_EQ((int)indices.size(), (int)mesh.indices.rows());
+
+	double maxError = 0.0;
+	for (int i = 0; i < vertices.size(); ++i)
+		maxError = std::max(maxError, (vertices[i] - mesh.vertices.row(i).transpose()).norm());
+	ASSERT_TRUE(maxError < 1e-8);
+
+	bool sameIndices = true;
+	for (int i = 0; i < indices.size(); ++i)
+		sameIndices = sameIndices && indices[i] == mesh.indices.row(i).transpose();
+	ASSERT_TRUE(sameIndices);
+}
+
+TEST(MeshIOTest)
+{
+	using namespace lmu;
+
+	PointCloud pc = randomPointCloud(1000);
+
+	writePointCloudPLY("/tmp/mesh_io_test.ply", pc);
+	ASSERT_TRUE(readPointCloudPLY("/tmp/mesh_io_test.ply") == pc);
+	ASSERT_TRUE(readPointCloudPLY("/tmp/mesh_io_test.ply", 2.0).leftCols(3) == 2.0 * pc.leftCols(3));
+
+	CSGNode node = geo<IFSphere>((Eigen::Affine3d)Eigen::Translation3d(0.1, 0.0, -0.1), 0.6, "Sphere_0");
+	Mesh mesh = computeMesh(node, Eigen::Vector3i(32, 32, 32), Eigen::Vector3d(-1.0, -1.0, -1.0), Eigen::Vector3d(1.0, 1.0, 1.0));
+	mesh.normals = mesh.vertices.rowwise().normalized();
+
+	writeMeshPLY("/tmp/mesh_io_test.ply", mesh);
+	Mesh plyMesh = fromPLYFile("/tmp/mesh_io_test.ply");
+	ASSERT_TRUE(plyMesh.vertices == mesh.vertices);
+	ASSERT_TRUE(plyMesh.normals == mesh.normals);
+	ASSERT_TRUE(plyMesh.indices == mesh.indices);
+
+	//STL stores floats and no shared vertices.
+	writeMeshSTL("/tmp/mesh_io_test.stl", mesh);
+	Mesh stlMesh = fromSTLFile("/tmp/mesh_io_test.stl");
+	ASSERT_EQ((int)stlMesh.vertices.rows(), (int)mesh.vertices.rows());
+	ASSERT_EQ((int)stlMesh.indices.rows(), (int)mesh.indices.rows());
+
+	double maxError = 0.0;
+	for (int i = 0; i < mesh.indices.rows(); ++i)
+		for (int j = 0; j < 3; ++j)
+			maxError = std::max(maxError, (stlMesh.vertices.row(stlMesh.indices(i, j)) - mesh.vertices.row(mesh.indices(i, j))).norm());
+	ASSERT_TRUE(maxError < 1e-6);
+
+	bool thrown = false;
+	try
+	{
+		fromPLYFile("/tmp/mesh_io_test.stl");
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE(thrown);
+}
+
+TEST(PrimitiveMeshPoolTest)
+{
+	using namespace lmu;
+
+	Eigen::Affine3d t = (Eigen::Affine3d)Eigen::Translation3d(0.5, -0.2, 0.1) * Eigen::AngleAxisd(0.3, Eigen::Vector3d(1.0, 1.0, 0.0).normalized());
+
+	auto s0 = std::make_shared<IFSphere>(t, 0.6, "Sphere_0");
+	auto s1 = std::make_shared<IFSphere>(t, 0.6, "Sphere_1");
+	auto s2 = std::make_shared<IFSphere>(t, 0.7, "Sphere_2");
+	auto c0 = s0->clone();
+
+	//Equal parameters share one mesh, also with clones.
+	ASSERT_TRUE(&s0->meshCRef() == &s1->meshCRef());
+	ASSERT_TRUE(&s0->meshCRef() == &c0->meshCRef());
+	ASSERT_TRUE(&s0->meshCRef() != &s2->meshCRef());
+
+	//Primitives that only differ in the translation have their own meshes.
+	IFSphere moved0((Eigen::Affine3d)Eigen::Translation3d(1.0, 2.0, 3.0), 0.6, "Sphere_3");
+	IFSphere moved1((Eigen::Affine3d)Eigen::Translation3d(-5.0, 7.0, 9.0), 0.6, "Sphere_4");
+	ASSERT_TRUE(&moved0.meshCRef() != &moved1.meshCRef());
+	ASSERT_TRUE((moved1.meshCRef().vertices.colwise().minCoeff() + moved1.meshCRef().vertices.colwise().maxCoeff() - Eigen::RowVector3d(-10.0, 14.0, 18.0)).norm() < 0.01);
+	ASSERT_TRUE(s0->meshCRef().vertices.rows() > 0);
+	ASSERT_EQ((int)IFNull("Null").meshCRef().vertices.rows(), 0);
+
+	std::vector<std::shared_ptr<ImplicitFunction>> shapes = 
+	{
+		s0, 
+		std::make_shared<IFBox>(t, Eigen::Vector3d(0.4, 0.8, 1.2), 2, "Box_0"),
+		std::make_shared<IFCylinder>(t, 0.3, 1.1, "Cylinder_0"),
+		std::make_shared<IFNull>("Null_0")
+	};
+
+	//The analytic AABBs contain the meshes and are tight for boxes.
+	for (const auto& shape : shapes)
+	{
+		if (shape->type() == ImplicitFunctionType::Null)
+		{
+			ASSERT_TRUE(shape->aabb().isEmpty());
+			continue;
+		}
+
+		AABB box = shape->aabb();
+		Eigen::Vector3d meshMin = shape->meshCRef().vertices.colwise().minCoeff();
+		Eigen::Vector3d meshMax = shape->meshCRef().vertices.colwise().maxCoeff();
+
+		ASSERT_TRUE((box.min.array() <= meshMin.array() + 1e-9).all());
+		ASSERT_TRUE((box.max.array() >= meshMax.array() - 1e-9).all());
+
+		if (shape->type() == ImplicitFunctionType::Box)
+		{
+			ASSERT_TRUE(box.min.isApprox(meshMin, 1e-9));
+			ASSERT_TRUE(box.max.isApprox(meshMax, 1e-9));
+		}
+	}
+
+	Eigen::Vector3d min, max;
+	std::tie(min, max) = computeDimensions(shapes);
+
+	AABB box;
+	for (const auto& shape : shapes)
+		box = box.merged(shape->aabb());
+
+	ASSERT_TRUE(min == box.min);
+	ASSERT_TRUE(max == box.max);
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include <random>
+#include <numeric>
 
 #include "..\include\congraph.h"
 #include "..\include\mesh.h"
@@ -117,37 +118,54 @@ lmu::Graph lmu::createConnectionGraph(const std::vector<std::shared_ptr<lmu::Imp
 	return graph;
 }
 
-void createConnectionGraphRec(const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs, const Eigen::Vector3d & min, const Eigen::Vector3d & max, double minCellSize, std::vector<boost::dynamic_bitset<>>& overlaps)
+void createConnectionGraphRec(const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs, const std::vector<int>& candidates, const Eigen::Vector3d & min, const Eigen::Vector3d & max, double minCellSize, std::vector<boost::dynamic_bitset<>>& overlaps)
 {
 	//std::cout << "part: " << std::endl << min << std::endl << max << std::endl;
 
 	if ((max - min).norm() < minCellSize)
 		return;
 
+	//Only functions that are not provably outside of the cell can contain a point of it.
+	std::vector<int> cellCandidates;
+	bool allInside = true;
+	for (int i : candidates)
+	{
+		lmu::Interval d = funcs[i]->signedDistanceInterval(min, max);
+		if (d.lo < 0.0)
+		{
+			cellCandidates.push_back(i);
+			allInside = allInside && d.hi < 0.0;
+		}
+	}
+
+	//No new overlaps can be found in this cell.
+	if (cellCandidates.size() < 2)
+		return;
+
 	Eigen::Vector3d s = (max - min);
 	Eigen::Vector3d p = min + 0.5 * s;
 	
 	boost::dynamic_bitset<> isIn(funcs.size());
 	
-	for (int i = 0; i < funcs.size(); ++i)	
+	for (int i : cellCandidates)
 		isIn[i] = funcs[i]->signedDistance(p) < 0.0;	
 	
-	for (int i = 0; i < funcs.size(); ++i)
+	for (int i : cellCandidates)
 		overlaps[i] = isIn[i] ? overlaps[i] | isIn : overlaps[i]; // overlaps[i] | isIn;
+
+	//All candidates contain the whole cell, the center already found all their overlaps.
+	if (allInside)
+		return;
 		
-	createConnectionGraphRec(funcs, min, min + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, 0.0, 0.0),			min + Eigen::Vector3d(s.x() * 0.5, 0.0, 0.0) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(0.0, s.y() * 0.5, 0.0),			min + Eigen::Vector3d(0.0, s.y() * 0.5, 0.0) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, 0.0),	min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, 0.0) + 0.5 * s, minCellSize, overlaps);
-
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(0.0, 0.0, s.z() * 0.5),			min + Eigen::Vector3d(0.0, 0.0, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, 0.0, s.z() * 0.5),	min + Eigen::Vector3d(s.x() * 0.5, 0.0, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(0.0, s.y() * 0.5, s.z() * 0.5),	min + Eigen::Vector3d(0.0, s.y() * 0.5, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, s.z() * 0.5), min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-		
-	//All bits are set.
-	if (isIn.count() == funcs.size())
-		return; 
+	createConnectionGraphRec(funcs, cellCandidates, min, min + 0.5 * s, minCellSize, overlaps);
+	createConnectionGraphRec(funcs, cellCandidates, min + Eigen::Vector3d(s.x() * 0.5, 0.0, 0.0),			min + Eigen::Vector3d(s.x() * 0.5, 0.0, 0.0) + 0.5 * s, minCellSize, overlaps);
+	createConnectionGraphRec(funcs, cellCandidates, min + Eigen::Vector3d(0.0, s.y() * 0.5, 0.0),			min + Eigen::Vector3d(0.0, s.y() * 0.5, 0.0) + 0.5 * s, minCellSize, overlaps);
+	createConnectionGraphRec(funcs, cellCandidates, min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, 0.0),	min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, 0.0) + 0.5 * s, minCellSize, overlaps);
+
+	createConnectionGraphRec(funcs, cellCandidates, min + Eigen::Vector3d(0.0, 0.0, s.z() * 0.5),			min + Eigen::Vector3d(0.0, 0.0, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
+	createConnectionGraphRec(funcs, cellCandidates, min + Eigen::Vector3d(s.x() * 0.5, 0.0, s.z() * 0.5),	min + Eigen::Vector3d(s.x() * 0.5, 0.0, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
+	createConnectionGraphRec(funcs, cellCandidates, min + Eigen::Vector3d(0.0, s.y() * 0.5, s.z() * 0.5),	min + Eigen::Vector3d(0.0, s.y() * 0.5, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
+	createConnectionGraphRec(funcs, cellCandidates, min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, s.z() * 0.5), min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
 }
 
 lmu::Graph lmu::createConnectionGraph(const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& impFuncs, const Eigen::Vector3d & min, const Eigen::Vector3d & max, double minCellSize)
@@ -162,7 +180,10 @@ lmu::Graph lmu::createConnectionGraph(const std::vector<std::shared_ptr<lmu::Imp
 		overlaps[i++] = boost::dynamic_bitset<>(impFuncs.size(), false);
 	}
 
-	createConnectionGraphRec(impFuncs, min, max, minCellSize, overlaps);
+	std::vector<int> candidates(impFuncs.size());
+	std::iota(candidates.begin(), candidates.end(), 0);
+
+	createConnectionGraphRec(impFuncs, candidates, min, max, minCellSize, overlaps);
 
 	boost::graph_traits<GraphStructure>::vertex_iterator vi1, vi1_end;
 
@@ -0,0 +1,331 @@
+#include "../include/csgarena.h"
+#include "../include/csgnode_helper.h"
+
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include <boost/functional/hash.hpp>
+
+using namespace lmu;
+
+lmu::CSGArena::CSGArena()
+{
+}
+
+lmu::CSGArena::CSGArena(const CSGNode& node)
+{
+	if (node.isValid())
+		append(node, -1);
+}
+
+int lmu::CSGArena::append(const CSGNode& node, int parent)
+{
+	bool isGeometry = node.type() == CSGNodeType::Geometry;
+
+	int idx = addNode(CSGArenaNode(node.type(), node.operationType(), isGeometry ? functionIndex(node.function()) : -1, parent));
+
+	if (!isGeometry && !node.name().empty())
+		_names[idx] = node.name();
+
+	auto attributes = node.attributes();
+	if (!attributes.empty())
+		_attributes[idx] = attributes;
+
+	std::vector<int> childs;
+	for (const auto& child : node.childsCRef())
+		childs.push_back(append(child, idx));
+
+	setChilds(idx, childs);
+	_nodes[idx].subtreeSize = _nodes.size() - idx;
+
+	return idx;
+}
+
+//An invalid replacement removes an operand of a union or intersection. Operands of other operations have fixed positions,
+//so they are replaced by a NoOperation (empty) node.
+int lmu::CSGArena::append(const CSGArena& other, int otherIdx, int parent, int replaceIdx, const CSGArena* replacement)
+{
+	if (otherIdx == replaceIdx)
+	{
+		if (replacement->isValid())
+			return append(*replacement, replacement->root(), parent);
+
+		if (parent < 0 || _nodes[parent].operationType == CSGNodeOperationType::Union || _nodes[parent].operationType == CSGNodeOperationType::Intersection)
+			return -1;
+
+		return addNode(CSGArenaNode(CSGNodeType::Operation, CSGNodeOperationType::Identity, -1, parent));
+	}
+
+	const CSGArenaNode& otherNode = other.node(otherIdx);
+
+	int function = otherNode.function >= 0 ? functionIndex(other.function(otherIdx)) : -1;
+	int idx = addNode(CSGArenaNode(otherNode.type, otherNode.operationType, function, parent));
+
+	auto name = other._names.find(otherIdx);
+	if (name != other._names.end())
+		_names[idx] = name->second;
+
+	auto attributes = other._attributes.find(otherIdx);
+	if (attributes != other._attributes.end())
+		_attributes[idx] = attributes->second;
+
+	std::vector<int> childs;
+	for (int i = 0; i < otherNode.numChilds; ++i)
+	{
+		int childIdx = append(other, other.child(otherIdx, i), idx, replaceIdx, replacement);
+		if (childIdx >= 0)
+			childs.push_back(childIdx);
+	}
+
+	setChilds(idx, childs);
+	_nodes[idx].subtreeSize = _nodes.size() - idx;
+
+	return idx;
+}
+
+int lmu::CSGArena::addNode(const CSGArenaNode& node)
+{
+	_nodes.push_back(node);
+	return _nodes.size() - 1;
+}
+
+//Childs are set after the subtrees were appended, so the overflow childs of a node stay contiguous.
+void lmu::CSGArena::setChilds(int idx, const std::vector<int>& childs)
+{
+	CSGArenaNode& node = _nodes[idx];
+	node.numChilds = childs.size();
+
+	for (int i = 0; i < childs.size(); ++i)
+	{
+		if (i < CSGArenaNode::NumInlineChilds)
+		{
+			node.childs[i] = childs[i];
+		}
+		else
+		{
+			if (node.extraChilds < 0)
+				node.extraChilds = _extraChilds.size();
+			_extraChilds.push_back(childs[i]);
+		}
+	}
+}
+
+int lmu::CSGArena::functionIndex(const ImplicitFunctionPtr& function)
+{
+	auto it = _functionLookup.find(function.get());
+	if (it != _functionLookup.end())
+		return it->second;
+
+	int idx = _functions.size();
+	_functions.push_back(function);
+	_functionLookup[function.get()] = idx;
+
+	return idx;
+}
+
+CSGNode lmu::CSGArena::toCSGNode() const
+{
+	return isValid() ? toCSGNode(root()) : CSGNode::invalidNode;
+}
+
+CSGNode lmu::CSGArena::toCSGNode(int idx) const
+{
+	const CSGArenaNode& n = _nodes[idx];
+
+	if (n.type == CSGNodeType::Geometry)
+	{
+		CSGNode res = geometry(function(idx));
+		if (auto attributes = this->attributes(idx))
+			res.attributesRef() = *attributes;
+		return res;
+	}
+
+	std::vector<CSGNode> childs;
+	childs.reserve(n.numChilds);
+	for (int i = 0; i < n.numChilds; ++i)
+		childs.push_back(toCSGNode(child(idx, i)));
+
+	//NoOperation reports itself as identity but has no childs.
+	CSGNode res = n.operationType == CSGNodeOperationType::Identity && childs.empty() ?
+		CSGNode(std::make_shared<NoOperation>(name(idx))) : createOperation(n.operationType, name(idx), childs);
+
+	if (auto attributes = this->attributes(idx))
+		res.attributesRef() = *attributes;
+
+	return res;
+}
+
+CSGArena lmu::CSGArena::subtree(int idx) const
+{
+	CSGArena res;
+	res.append(*this, idx, -1);
+
+	return res;
+}
+
+CSGArena lmu::CSGArena::replaced(int idx, const CSGArena& other) const
+{
+	CSGArena res;
+	if (isValid())
+		res.append(*this, root(), -1, idx, &other);
+
+	return res;
+}
+
+bool lmu::CSGArena::isValid() const
+{
+	return !_nodes.empty();
+}
+
+int lmu::CSGArena::root() const
+{
+	return 0;
+}
+
+int lmu::CSGArena::numNodes() const
+{
+	return isValid() ? _nodes[root()].subtreeSize : 0;
+}
+
+int lmu::CSGArena::numNodes(int idx) const
+{
+	return _nodes[idx].subtreeSize;
+}
+
+int lmu::CSGArena::depthAt(int idx) const
+{
+	int d = 0;
+	for (int parent = _nodes[idx].parent; parent >= 0; parent = _nodes[parent].parent)
+		d++;
+
+	return d;
+}
+
+int lmu::CSGArena::depth() const
+{
+	//Parents come before their childs in pre-order.
+	std::vector<int> depths(_nodes.size(), 0);
+	int maxDepth = 0;
+	for (int i = 0; i < _nodes.size(); ++i)
+	{
+		if (_nodes[i].parent >= 0)
+			depths[i] = depths[_nodes[i].parent] + 1;
+		maxDepth = std::max(maxDepth, depths[i]);
+	}
+
+	return maxDepth;
+}
+
+const CSGArenaNode& lmu::CSGArena::node(int idx) const
+{
+	return _nodes[idx];
+}
+
+int lmu::CSGArena::child(int idx, int i) const
+{
+	const CSGArenaNode& n = _nodes[idx];
+	return i < CSGArenaNode::NumInlineChilds ? n.childs[i] : _extraChilds[n.extraChilds + i - CSGArenaNode::NumInlineChilds];
+}
+
+ImplicitFunctionPtr lmu::CSGArena::function(int idx) const
+{
+	int f = _nodes[idx].function;
+	return f >= 0 ? _functions[f] : nullptr;
+}
+
+std::string lmu::CSGArena::name(int idx) const
+{
+	if (_nodes[idx].type == CSGNodeType::Geometry)
+	{
+		auto f = function(idx);
+		return f ? f->name() : "NullFunction";
+	}
+
+	auto it = _names.find(idx);
+	return it != _names.end() ? it->second : std::string();
+}
+
+const ICSGNode::Attributes* lmu::CSGArena::attributes(int idx) const
+{
+	auto it = _attributes.find(idx);
+	return it != _attributes.end() ? &it->second : nullptr;
+}
+
+const std::vector<CSGArenaNode>& lmu::CSGArena::nodes() const
+{
+	return _nodes;
+}
+
+const std::vector<ImplicitFunctionPtr>& lmu::CSGArena::functions() const
+{
+	return _functions;
+}
+
+double lmu::CSGArena::signedDistance(const Eigen::Vector3d& p) const
+{
+	return signedDistance(root(), p);
+}
+
+double lmu::CSGArena::signedDistance(int idx, const Eigen::Vector3d& p) const
+{
+	const CSGArenaNode& n = _nodes[idx];
+
+	if (n.type == CSGNodeType::Geometry)
+		return _functions[n.function]->signedDistance(p);
+
+	switch (n.operationType)
+	{
+	case CSGNodeOperationType::Union:
+	{
+		double res = std::numeric_limits<double>::max();
+		for (int i = 0; i < n.numChilds; ++i)
+			res = std::min(res, signedDistance(child(idx, i), p));
+		return res;
+	}
+	case CSGNodeOperationType::Intersection:
+	{
+		double res = -std::numeric_limits<double>::max();
+		for (int i = 0; i < n.numChilds; ++i)
+			res = std::max(res, signedDistance(child(idx, i), p));
+		return res;
+	}
+	case CSGNodeOperationType::Difference:
+		return std::max(signedDistance(n.childs[0], p), -signedDistance(n.childs[1], p));
+
+	case CSGNodeOperationType::Complement:
+		return -signedDistance(n.childs[0], p);
+
+	case CSGNodeOperationType::Identity:
+		return n.numChilds == 0 ? std::numeric_limits<double>::max() : signedDistance(n.childs[0], p);
+
+	case CSGNodeOperationType::Noop:
+		return std::numeric_limits<double>::max();
+
+	default:
+		throw std::runtime_error("Operation type is not supported");
+	}
+}
+
+size_t lmu::CSGArena::hash(size_t seed) const
+{
+	return isValid() ? hash(root(), seed) : seed;
+}
+
+size_t lmu::CSGArena::hash(int idx, size_t seed) const
+{
+	const CSGArenaNode& n = _nodes[idx];
+
+	if (n.type == CSGNodeType::Geometry)
+	{
+		boost::hash_combine(seed, reinterpret_cast<std::uintptr_t>(_functions[n.function].get()));
+		return seed;
+	}
+
+	boost::hash_combine(seed, n.operationType);
+	for (int i = 0; i < n.numChilds; ++i)
+		seed = hash(child(idx, i), seed);
+
+	return seed;
+}
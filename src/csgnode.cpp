@@ -1,5 +1,7 @@
 #include "..\include\csgnode.h"
 #include "..\include\csgnode_helper.h"
+#include "..\include\csgtape.h"
+#include "..\include\marching_cubes.h"
 
 #include <limits>
 #include <fstream>
@@ -14,8 +16,6 @@
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/adjacency_list.hpp>
 
-#include <igl/copyleft/marching_cubes.h>
-
 
 #include "../include/constants.h"
 
@@ -24,36 +24,249 @@ using namespace lmu;
 
 CSGNode const CSGNode::invalidNode = CSGNode(nullptr);
 
+//The winner is decided on distances only, the gradient is computed just for the active primitive.
+Eigen::Vector4d CSGNodeOperation::signedDistanceAndGradient(const Eigen::Vector3d& p, double h) const
+{
+	ActivePrimitive active = activePrimitive(p);
+	if (!active.node)
+		return Eigen::Vector4d(active.distance, 0.0, 0.0, 0.0);
+
+	return active.node->signedDistanceAndGradient(p, h) * active.sign;
+}
+Eigen::MatrixXd CSGNodeOperation::signedDistanceAndGradients(const Eigen::MatrixXd& ps, double h) const
+{
+	std::vector<ActivePrimitive> active = activePrimitives(ps);
+
+	Eigen::MatrixXd res = Eigen::MatrixXd::Zero(ps.rows(), 4);
+	std::unordered_map<const ICSGNode*, std::vector<int>> pointsPerPrimitive;
+	for (int i = 0; i < ps.rows(); ++i)
+	{
+		res(i, 0) = active[i].distance;
+		if (active[i].node)
+			pointsPerPrimitive[active[i].node].push_back(i);
+	}
+
+	//One batch per primitive with the points it is active for.
+	for (const auto& primitivePoints : pointsPerPrimitive)
+	{
+		const auto& indices = primitivePoints.second;
+
+		Eigen::MatrixXd primitivePs(indices.size(), 3);
+		for (int j = 0; j < indices.size(); ++j)
+			primitivePs.row(j) = ps.row(indices[j]);
+
+		Eigen::MatrixXd primitiveRes = primitivePoints.first->signedDistanceAndGradients(primitivePs, h);
+		for (int j = 0; j < indices.size(); ++j)
+			res.row(indices[j]) = primitiveRes.row(j) * active[indices[j]].sign;
+	}
+
+	return res;
+}
+
 CSGNodePtr UnionOperation::clone() const
 {
 	return std::make_shared<UnionOperation>(*this);
 }
-Eigen::Vector4d UnionOperation::signedDistanceAndGradient(const Eigen::Vector3d& p, double h) const
+//Index of the child with the smallest (largest) bound at p. 
+//Evaluating it first lets the bounds of the other childs skip most of them.
+int childWithMinLowerBound(const std::vector<CSGNode>& childs, const Eigen::Vector3d& p)
 {
-	Eigen::Vector4d res(0, 0, 0, 0);
+	int minIdx = 0;
+	double minBound = std::numeric_limits<double>::max();
+	for (int i = 0; i < childs.size(); ++i)
+	{
+		double bound = childs[i].bounds().lowerBound(p);
+		if (bound < minBound)
+		{
+			minBound = bound;
+			minIdx = i;
+		}
+	}
+
+	return minIdx;
+}
+int childWithMaxLowerBound(const std::vector<CSGNode>& childs, const Eigen::Vector3d& p)
+{
+	int maxIdx = 0;
+	double maxBound = -std::numeric_limits<double>::max();
+	for (int i = 0; i < childs.size(); ++i)
+	{
+		double bound = childs[i].bounds().lowerBound(p);
+		if (bound > maxBound)
+		{
+			maxBound = bound;
+			maxIdx = i;
+		}
+	}
+
+	return maxIdx;
+}
+
+//Orders (value, child index) pairs. Ties go to the lower child index, as without bounds, so skipping childs never changes the winner.
+inline bool isLess(double d, int i, double resD, int resIdx)
+{
+	return d < resD || (d == resD && i < resIdx);
+}
+inline bool isGreater(double d, int i, double resD, int resIdx)
+{
+	return d > resD || (d == resD && i < resIdx);
+}
+
+//True if the child cannot go below (above) the current result at any of the points.
+bool isAboveAll(const DistanceBounds& bounds, const Eigen::MatrixXd& ps, const Eigen::VectorXd& res)
+{
+	for (int i = 0; i < ps.rows(); ++i)
+	{
+		if (bounds.lowerBound(ps.row(i).transpose()) < res(i))
+			return false;
+	}
+
+	return true;
+}
+bool isBelowAll(const DistanceBounds& bounds, const Eigen::MatrixXd& ps, const Eigen::VectorXd& res)
+{
+	for (int i = 0; i < ps.rows(); ++i)
+	{
+		if (bounds.upperBound(ps.row(i).transpose()) > res(i))
+			return false;
+	}
+
+	return true;
+}
+
+double UnionOperation::signedDistance(const Eigen::Vector3d& p) const
+{
+	if (_childs.empty())
+		return std::numeric_limits<double>::max();
+
+	int first = childWithMinLowerBound(_childs, p);
+	double res = _childs[first].signedDistance(p);
+	int resIdx = first;
+
+	for (int i = 0; i < _childs.size(); ++i)
+	{
+		//Childs that cannot go below the current minimum are skipped.
+		if (i == first || !isLess(_childs[i].bounds().lowerBound(p), i, res, resIdx))
+			continue;
+
+		auto childRes = _childs[i].signedDistance(p);
+		if (isLess(childRes, i, res, resIdx))
+		{
+			res = childRes;
+			resIdx = i;
+		}
+	}
+
+	return res;
+}
+Eigen::VectorXd UnionOperation::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	Eigen::VectorXd res = Eigen::VectorXd::Constant(ps.rows(), std::numeric_limits<double>::max());
 
-	res[0] = std::numeric_limits<double>::max();
 	for (const auto& child : _childs)
 	{
-		auto childRes = child.signedDistanceAndGradient(p,h);
-		res = childRes[0] < res[0] ? childRes : res;
+		if (!isAboveAll(child.bounds(), ps, res))
+			res = res.cwiseMin(child.signedDistances(ps));
+	}
+	
+	return res;
+}
+ActivePrimitive UnionOperation::activePrimitive(const Eigen::Vector3d& p) const
+{
+	if (_childs.empty())
+		return ActivePrimitive(std::numeric_limits<double>::max());
+
+	int first = childWithMinLowerBound(_childs, p);
+	ActivePrimitive res = _childs[first].activePrimitive(p);
+	int resIdx = first;
+
+	for (int i = 0; i < _childs.size(); ++i)
+	{
+		//Childs that cannot go below the current minimum are skipped.
+		if (i == first || !isLess(_childs[i].bounds().lowerBound(p), i, res.distance, resIdx))
+			continue;
+
+		ActivePrimitive childRes = _childs[i].activePrimitive(p);
+		if (isLess(childRes.distance, i, res.distance, resIdx))
+		{
+			res = childRes;
+			resIdx = i;
+		}
 	}
 
 	return res;
 }
-double UnionOperation::signedDistance(const Eigen::Vector3d& p) const
+std::vector<ActivePrimitive> UnionOperation::activePrimitives(const Eigen::MatrixXd& ps) const
 {
-	double res = 0.0;
+	std::vector<ActivePrimitive> res(ps.rows(), ActivePrimitive(std::numeric_limits<double>::max()));
+	Eigen::VectorXd ds = Eigen::VectorXd::Constant(ps.rows(), std::numeric_limits<double>::max());
 
-	res = std::numeric_limits<double>::max();
 	for (const auto& child : _childs)
 	{
-		auto childRes = child.signedDistance(p);
-		res = childRes < res ? childRes : res;
+		if (isAboveAll(child.bounds(), ps, ds))
+			continue;
+
+		auto childRes = child.activePrimitives(ps);
+		for (int i = 0; i < ps.rows(); ++i)
+		{
+			if (childRes[i].distance < ds(i))
+			{
+				res[i] = childRes[i];
+				ds(i) = childRes[i].distance;
+			}
+		}
 	}
 
 	return res;
 }
+HyperDual UnionOperation::signedDistanceDerivatives(const Eigen::Vector3d& p, double h) const
+{
+	if (_childs.empty())
+		return HyperDual(std::numeric_limits<double>::max());
+
+	int first = childWithMinLowerBound(_childs, p);
+	HyperDual res = _childs[first].signedDistanceDerivatives(p, h);
+	int resIdx = first;
+
+	for (int i = 0; i < _childs.size(); ++i)
+	{
+		if (i == first || !isLess(_childs[i].bounds().lowerBound(p), i, res.v, resIdx))
+			continue;
+
+		HyperDual childRes = _childs[i].signedDistanceDerivatives(p, h);
+		if (isLess(childRes.v, i, res.v, resIdx))
+		{
+			res = childRes;
+			resIdx = i;
+		}
+	}
+
+	return res;
+}
+Interval UnionOperation::signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const
+{
+	Interval res(std::numeric_limits<double>::max());
+
+	for (const auto& child : _childs)
+		res = vmin(res, child.signedDistanceInterval(min, max));
+
+	return res;
+}
+DistanceBounds UnionOperation::computeBounds() const
+{
+	//The minimum is bounded by the merged boxes of all childs.
+	DistanceBounds res(AABB(), AABB(), 1.0, 0.0);
+	for (const auto& child : _childs)
+	{
+		DistanceBounds b = child.bounds();
+		res.inner = res.inner.merged(b.inner);
+		res.outer = res.outer.merged(b.outer);
+		res.scale = std::min(res.scale, b.scale);
+		res.slack = std::max(res.slack, b.slack);
+	}
+
+	return _childs.empty() ? DistanceBounds::unbounded() : res;
+}
 CSGNodeOperationType UnionOperation::operationType() const
 {
 	return CSGNodeOperationType::Union;
@@ -92,32 +305,143 @@ CSGNodePtr IntersectionOperation::clone() const
 {
 	return std::make_shared<IntersectionOperation>(*this);
 }
-Eigen::Vector4d IntersectionOperation::signedDistanceAndGradient(const Eigen::Vector3d & p, double h) const
+double IntersectionOperation::signedDistance(const Eigen::Vector3d & p) const
 {
-	Eigen::Vector4d res(0, 0, 0, 0);
+	if (_childs.empty())
+		return -std::numeric_limits<double>::max();
+
+	int first = childWithMaxLowerBound(_childs, p);
+	double res = _childs[first].signedDistance(p);
+	int resIdx = first;
+
+	for (int i = 0; i < _childs.size(); ++i)
+	{
+		//Childs that cannot go above the current maximum are skipped.
+		if (i == first || !isGreater(_childs[i].bounds().upperBound(p), i, res, resIdx))
+			continue;
+
+		auto childRes = _childs[i].signedDistance(p);
+		if (isGreater(childRes, i, res, resIdx))
+		{
+			res = childRes;
+			resIdx = i;
+		}
+	}
+
+	return res;
+}
+Eigen::VectorXd IntersectionOperation::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	Eigen::VectorXd res = Eigen::VectorXd::Constant(ps.rows(), -std::numeric_limits<double>::max());
 
-	res[0] = -std::numeric_limits<double>::max();
 	for (const auto& child : _childs)
 	{
-		auto childRes = child.signedDistanceAndGradient(p, h);
-		res = childRes[0] > res[0] ? childRes : res;
+		if (!isBelowAll(child.bounds(), ps, res))
+			res = res.cwiseMax(child.signedDistances(ps));
 	}
 
 	return res;
 }
-double IntersectionOperation::signedDistance(const Eigen::Vector3d & p) const
+ActivePrimitive IntersectionOperation::activePrimitive(const Eigen::Vector3d& p) const
 {
-	double res = 0.0;
+	if (_childs.empty())
+		return ActivePrimitive(-std::numeric_limits<double>::max());
+
+	int first = childWithMaxLowerBound(_childs, p);
+	ActivePrimitive res = _childs[first].activePrimitive(p);
+	int resIdx = first;
+
+	for (int i = 0; i < _childs.size(); ++i)
+	{
+		//Childs that cannot go above the current maximum are skipped.
+		if (i == first || !isGreater(_childs[i].bounds().upperBound(p), i, res.distance, resIdx))
+			continue;
+
+		ActivePrimitive childRes = _childs[i].activePrimitive(p);
+		if (isGreater(childRes.distance, i, res.distance, resIdx))
+		{
+			res = childRes;
+			resIdx = i;
+		}
+	}
+
+	return res;
+}
+std::vector<ActivePrimitive> IntersectionOperation::activePrimitives(const Eigen::MatrixXd& ps) const
+{
+	std::vector<ActivePrimitive> res(ps.rows(), ActivePrimitive(-std::numeric_limits<double>::max()));
+	Eigen::VectorXd ds = Eigen::VectorXd::Constant(ps.rows(), -std::numeric_limits<double>::max());
 
-	res = -std::numeric_limits<double>::max();
 	for (const auto& child : _childs)
 	{
-		auto childRes = child.signedDistance(p);
-		res = childRes > res ? childRes : res;
+		if (isBelowAll(child.bounds(), ps, ds))
+			continue;
+
+		auto childRes = child.activePrimitives(ps);
+		for (int i = 0; i < ps.rows(); ++i)
+		{
+			if (childRes[i].distance > ds(i))
+			{
+				res[i] = childRes[i];
+				ds(i) = childRes[i].distance;
+			}
+		}
 	}
 
 	return res;
 }
+HyperDual IntersectionOperation::signedDistanceDerivatives(const Eigen::Vector3d& p, double h) const
+{
+	if (_childs.empty())
+		return HyperDual(-std::numeric_limits<double>::max());
+
+	int first = childWithMaxLowerBound(_childs, p);
+	HyperDual res = _childs[first].signedDistanceDerivatives(p, h);
+	int resIdx = first;
+
+	for (int i = 0; i < _childs.size(); ++i)
+	{
+		if (i == first || !isGreater(_childs[i].bounds().upperBound(p), i, res.v, resIdx))
+			continue;
+
+		HyperDual childRes = _childs[i].signedDistanceDerivatives(p, h);
+		if (isGreater(childRes.v, i, res.v, resIdx))
+		{
+			res = childRes;
+			resIdx = i;
+		}
+	}
+
+	return res;
+}
+Interval IntersectionOperation::signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const
+{
+	Interval res(-std::numeric_limits<double>::max());
+
+	for (const auto& child : _childs)
+		res = vmax(res, child.signedDistanceInterval(min, max));
+
+	return res;
+}
+DistanceBounds IntersectionOperation::computeBounds() const
+{
+	//The maximum is above the lower bound of each child, the smallest inner box of the childs gives the tightest one.  
+	//The boxes of the childs cannot simply be intersected since the maximum is not an exact distance.
+	DistanceBounds res(AABB::infinite(), AABB(), 1.0, 0.0);
+	for (const auto& child : _childs)
+	{
+		DistanceBounds b = child.bounds();
+		if (b.inner.isFinite() && (!res.inner.isFinite() || b.inner.volume() < res.inner.volume()))
+		{
+			res.inner = b.inner;
+			res.scale = b.scale;
+		}
+		res.outer = res.outer.merged(b.outer);
+		res.slack = std::max(res.slack, b.slack);
+	}
+
+	return _childs.empty() ? DistanceBounds::unbounded() : res;
+}
 CSGNodeOperationType IntersectionOperation::operationType() const
 {
 	return CSGNodeOperationType::Intersection;
@@ -156,30 +480,14 @@ CSGNodePtr DifferenceOperation::clone() const
 {
 	return std::make_shared<DifferenceOperation>(*this);
 }
-Eigen::Vector4d DifferenceOperation::signedDistanceAndGradient(const Eigen::Vector3d& p, double h) const
-{
-	auto left = _childs[0].signedDistanceAndGradient(p, h);
-	auto right = _childs[1].signedDistanceAndGradient(p, h);
-
-	Eigen::Vector3d grad;	
-	double value;
-
-	if (left.x() > -right.x())
-	{
-		value = left.x();
-		grad = Eigen::Vector3d(left.y(), left.z(), left.w());
-	}
-	else
-	{
-		value = -right.x();
-		grad = Eigen::Vector3d(-right.y(), -right.z(), -right.w());
-	}
-	
-	return Eigen::Vector4d(value, grad.x(), grad.y(), grad.z());
-}
 double DifferenceOperation::signedDistance(const Eigen::Vector3d& p) const
 {
 	auto left = _childs[0].signedDistance(p);
+
+	//The subtracted child cannot win.
+	if (-_childs[1].bounds().lowerBound(p) < left)
+		return left;
+
 	auto right = _childs[1].signedDistance(p);
 
 	Eigen::Vector3d grad;
@@ -197,6 +505,60 @@ double DifferenceOperation::signedDistance(const Eigen::Vector3d& p) const
 
 	return value;
 }
+Eigen::VectorXd DifferenceOperation::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	auto left = _childs[0].signedDistances(ps);
+	auto right = _childs[1].signedDistances(ps);
+
+	return left.cwiseMax(-right);
+}
+ActivePrimitive DifferenceOperation::activePrimitive(const Eigen::Vector3d& p) const
+{
+	ActivePrimitive left = _childs[0].activePrimitive(p);
+
+	//The subtracted child cannot win.
+	if (-_childs[1].bounds().lowerBound(p) < left.distance)
+		return left;
+
+	ActivePrimitive right = _childs[1].activePrimitive(p).negated();
+
+	return left.distance > right.distance ? left : right;
+}
+std::vector<ActivePrimitive> DifferenceOperation::activePrimitives(const Eigen::MatrixXd& ps) const
+{
+	auto res = _childs[0].activePrimitives(ps);
+	auto right = _childs[1].activePrimitives(ps);
+
+	for (int i = 0; i < ps.rows(); ++i)
+	{
+		if (res[i].distance <= -right[i].distance)
+			res[i] = right[i].negated();
+	}
+
+	return res;
+}
+HyperDual DifferenceOperation::signedDistanceDerivatives(const Eigen::Vector3d& p, double h) const
+{
+	HyperDual left = _childs[0].signedDistanceDerivatives(p, h);
+
+	if (-_childs[1].bounds().lowerBound(p) < left.v)
+		return left;
+
+	HyperDual right = _childs[1].signedDistanceDerivatives(p, h);
+
+	return left.v > -right.v ? left : -right;
+}
+Interval DifferenceOperation::signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const
+{
+	return vmax(_childs[0].signedDistanceInterval(min, max), -_childs[1].signedDistanceInterval(min, max));
+}
+DistanceBounds DifferenceOperation::computeBounds() const
+{
+	DistanceBounds left = _childs[0].bounds();
+	DistanceBounds right = _childs[1].bounds();
+
+	return DistanceBounds(left.inner, left.outer.merged(right.outer), left.scale, std::max(left.slack, right.slack));
+}
 CSGNodeOperationType DifferenceOperation::operationType() const
 {
 	return CSGNodeOperationType::Difference;
@@ -227,14 +589,41 @@ CSGNodePtr ComplementOperation::clone() const
 {
 	return std::make_shared<ComplementOperation>(*this);
 }
-Eigen::Vector4d ComplementOperation::signedDistanceAndGradient(const Eigen::Vector3d& p, double h) const
-{	
-	return _childs[0].signedDistanceAndGradient(p,h) * -1.0;
-}
 double ComplementOperation::signedDistance(const Eigen::Vector3d& p) const
 {
 	return _childs[0].signedDistance(p) * -1.0;
 }
+Eigen::VectorXd ComplementOperation::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	return _childs[0].signedDistances(ps) * -1.0;
+}
+ActivePrimitive ComplementOperation::activePrimitive(const Eigen::Vector3d& p) const
+{
+	return _childs[0].activePrimitive(p).negated();
+}
+std::vector<ActivePrimitive> ComplementOperation::activePrimitives(const Eigen::MatrixXd& ps) const
+{
+	auto res = _childs[0].activePrimitives(ps);
+	for (auto& a : res)
+		a = a.negated();
+
+	return res;
+}
+HyperDual ComplementOperation::signedDistanceDerivatives(const Eigen::Vector3d& p, double h) const
+{
+	return -_childs[0].signedDistanceDerivatives(p, h);
+}
+Interval ComplementOperation::signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const
+{
+	return -_childs[0].signedDistanceInterval(min, max);
+}
+DistanceBounds ComplementOperation::computeBounds() const
+{
+	//The complement is negative outside of the child, only the absolute value is bounded.
+	DistanceBounds b = _childs[0].bounds();
+
+	return DistanceBounds(AABB::infinite(), b.outer, 1.0, b.slack);
+}
 CSGNodeOperationType ComplementOperation::operationType() const
 {
 	return CSGNodeOperationType::Complement;
@@ -252,14 +641,34 @@ CSGNodePtr IdentityOperation::clone() const
 {
 	return std::make_shared<IdentityOperation>(*this);
 }
-Eigen::Vector4d IdentityOperation::signedDistanceAndGradient(const Eigen::Vector3d& p, double h) const
-{
-	return _childs[0].signedDistanceAndGradient(p, h);
-}
 double IdentityOperation::signedDistance(const Eigen::Vector3d& p) const
 {
 	return _childs[0].signedDistance(p);
 }
+Eigen::VectorXd IdentityOperation::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	return _childs[0].signedDistances(ps);
+}
+ActivePrimitive IdentityOperation::activePrimitive(const Eigen::Vector3d& p) const
+{
+	return _childs[0].activePrimitive(p);
+}
+std::vector<ActivePrimitive> IdentityOperation::activePrimitives(const Eigen::MatrixXd& ps) const
+{
+	return _childs[0].activePrimitives(ps);
+}
+HyperDual IdentityOperation::signedDistanceDerivatives(const Eigen::Vector3d& p, double h) const
+{
+	return _childs[0].signedDistanceDerivatives(p, h);
+}
+Interval IdentityOperation::signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const
+{
+	return _childs[0].signedDistanceInterval(min, max);
+}
+DistanceBounds IdentityOperation::computeBounds() const
+{
+	return _childs[0].bounds();
+}
 CSGNodeOperationType IdentityOperation::operationType() const
 {
 	return CSGNodeOperationType::Identity;
@@ -277,14 +686,34 @@ CSGNodePtr NoOperation::clone() const
 {
 	return std::make_shared<NoOperation>(*this);
 }
-Eigen::Vector4d NoOperation::signedDistanceAndGradient(const Eigen::Vector3d& p, double h) const
-{
-	return Eigen::Vector4d(std::numeric_limits<double>::max(), 0.0, 0.0, 0.0);
-}
 double NoOperation::signedDistance(const Eigen::Vector3d& p) const
 {
 	return std::numeric_limits<double>::max();
 }
+Eigen::VectorXd NoOperation::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	return Eigen::VectorXd::Constant(ps.rows(), std::numeric_limits<double>::max());
+}
+ActivePrimitive NoOperation::activePrimitive(const Eigen::Vector3d& p) const
+{
+	return ActivePrimitive(std::numeric_limits<double>::max());
+}
+std::vector<ActivePrimitive> NoOperation::activePrimitives(const Eigen::MatrixXd& ps) const
+{
+	return std::vector<ActivePrimitive>(ps.rows(), ActivePrimitive(std::numeric_limits<double>::max()));
+}
+HyperDual NoOperation::signedDistanceDerivatives(const Eigen::Vector3d& p, double h) const
+{
+	return HyperDual(std::numeric_limits<double>::max());
+}
+Interval NoOperation::signedDistanceInterval(const Eigen::Vector3d& min, const Eigen::Vector3d& max) const
+{
+	return Interval(std::numeric_limits<double>::max());
+}
+DistanceBounds NoOperation::computeBounds() const
+{
+	return DistanceBounds::unbounded();
+}
 CSGNodeOperationType NoOperation::operationType() const
 {
 	return CSGNodeOperationType::Identity;
@@ -467,6 +896,33 @@ void lmu::visit(CSGNode& node, const std::function<void(CSGNode&node)>& f)
 		visit(child, f);
 }
 
+bool containsMatch(const CSGNode& node, const std::function<bool(const CSGNode&)>& match)
+{
+	if (match(node))
+		return true;
+
+	for (const auto& child : node.childsCRef())
+	{
+		if (containsMatch(child, match))
+			return true;
+	}
+
+	return false;
+}
+
+//Childs are checked read-only first, f can replace the node (its new childs are visited).
+void lmu::visit(CSGNode& node, const std::function<bool(const CSGNode&)>& match, const std::function<void(CSGNode&)>& f)
+{
+	if (match(node))
+		f(node);
+
+	for (int i = 0; i < node.childsCRef().size(); ++i)
+	{
+		if (containsMatch(node.childsCRef()[i], match))
+			visit(node.childsRef()[i], match, f);
+	}
+}
+
 /*double lmu::computeGeometryScore(const CSGNode& node, double epsilon, double alpha, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs) 
 {
 	auto dims = computeDimensions(node);
@@ -508,45 +964,7 @@ void lmu::visit(CSGNode& node, const std::function<void(CSGNode&node)>& f)
 
 double lmu::computeGeometryScore(const CSGNode& node, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs)
 {	
-	int num = 0; 
-
-	double score = 0.0;
-	for (const auto& func : funcs)
-	{
-		for (int i = 0; i < func->pointsCRef().rows(); ++i)
-		{
-			num++;
-
-			//const double* data = func->pointsCRef().data() + i * 6;
-			//Eigen::Vector3d p(data[0], data[1], data[2]);
-			//Eigen::Vector3d n(data[3], data[4], data[5]);
-
-			auto row = func->pointsCRef().row(i);
-			Eigen::Vector3d p = row.head<3>();
-			Eigen::Vector3d n = row.tail<3>();
-
-			Eigen::Vector4d distAndGrad = node.signedDistanceAndGradient(p,h);
-
-			double d = distAndGrad[0] / epsilon;
-			
-			Eigen::Vector3d grad = distAndGrad.tail<3>();
-			grad.normalize();			
-			if (std::isnan(grad.norm()))
-			{	
-				continue;
-			}
-
-			double gradientDotN = lmu::clamp(grad.dot(n), -1.0, 1.0); //clamp is necessary, acos is only defined in [-1,1].
-						
-			double theta = std::acos(gradientDotN) / alpha;
-
-			double scoreDelta = (std::exp(-(d*d)) + std::exp(-(theta*theta)));
-
-			score += scoreDelta;
-		}
-	}
-
-	return score;
+	return computeGeometryScore(CSGTape(node), epsilon, alpha, h, funcs);
 }
 
 double lmu::computeRawDistanceScore(const CSGNode & node, const Eigen::MatrixXd & points)
@@ -592,27 +1010,39 @@ int lmu::numPoints(const CSGNode& node)
 	return n;
 }
 
-CSGNode* nodeRec(CSGNode& node, int idx, int& curIdx)
+//Child indices on the path to the node with index idx (pre-order). Only nodes up to it are visited.
+bool nodePathRec(const CSGNode& node, int idx, int& curIdx, std::vector<int>& path)
 {
 	if (idx == curIdx)
-		return &node;
+		return true;
 
 	curIdx++;
 
-	for (auto& child : node.childsRef())
+	const auto& childs = node.childsCRef();
+	for (int i = 0; i < childs.size(); ++i)
 	{
-		auto foundTree = nodeRec(child, idx, curIdx);
-		if (foundTree)
-			return foundTree;
+		path.push_back(i);
+		if (nodePathRec(childs[i], idx, curIdx, path))
+			return true;
+		path.pop_back();
 	}
 
-	return nullptr;
+	return false;
 }
 
 CSGNode* lmu::nodePtrAt(CSGNode& node, int idx)
 {
 	int curIdx = 0;
-	return nodeRec(node, idx, curIdx);
+	std::vector<int> path;
+	if (!nodePathRec(node, idx, curIdx, path))
+		return nullptr;
+
+	//Only the childs on the path are accessed mutably, so only the path is copied if the tree is shared.
+	CSGNode* res = &node;
+	for (int i : path)
+		res = &res->childsRef()[i];
+
+	return res;
 }
 
 int nodeDepthRec(const CSGNode& node, int idx, int& curIdx, int depth)
@@ -946,103 +1376,67 @@ MergeResult lmu::mergeNodes(const CommonSubgraph& lcs, bool allowIntersections)
 	}
 }
 
-//Note that this function assumes that a convex hull mesh exists for each function.
+//Uses the analytic AABBs of the functions (see ImplicitFunction::aabb()), functions without one are ignored.
 std::tuple<Eigen::Vector3d, Eigen::Vector3d> 
 lmu::computeDimensions(const std::vector<std::shared_ptr<ImplicitFunction>>& shapes)
 {
-  double minS = std::numeric_limits<double>::max();
-  double maxS = -std::numeric_limits<double>::max();
-
-  Eigen::Vector3d min(minS, minS, minS);
-  Eigen::Vector3d max(maxS, maxS, maxS);
-	
-  for (const auto& shape : shapes) {    
-    Eigen::Vector3d minCandidate = shape->meshCRef().vertices.colwise().minCoeff();
-    Eigen::Vector3d maxCandidate = shape->meshCRef().vertices.colwise().maxCoeff();
-    
-    min(0) = min(0) < minCandidate(0) ? min(0) : minCandidate(0);
-    min(1) = min(1) < minCandidate(1) ? min(1) : minCandidate(1);
-    min(2) = min(2) < minCandidate(2) ? min(2) : minCandidate(2);
-    
-    max(0) = max(0) > maxCandidate(0) ? max(0) : maxCandidate(0);
-    max(1) = max(1) > maxCandidate(1) ? max(1) : maxCandidate(1);
-    max(2) = max(2) > maxCandidate(2) ? max(2) : maxCandidate(2);
-  }
-  
-  return std::make_tuple(min, max);
-}
-
-//Note that this function assumes that a convex hull mesh exists for each function.
-std::tuple<Eigen::Vector3d, Eigen::Vector3d> lmu::computeDimensions(const CSGNode& node)
-{	
-	auto geos = allGeometryNodePtrs(node);
-
-	double minS = std::numeric_limits<double>::max();
-	double maxS = -std::numeric_limits<double>::max();
+  AABB box;
 
-	Eigen::Vector3d min(minS, minS, minS);
-	Eigen::Vector3d max(maxS, maxS, maxS);
-	
-	for (const auto& geo : geos)
-	{
-		//Transform vertices.
-		//auto vertices = geo->function()->meshCRef().vertices;
-		//for (int i = 0; i < vertices.rows(); i++) {
-		//	Eigen::Vector3d v = vertices.row(i);
-		//	v = geo->function()->transform() * v;
-		//	vertices.row(i) = v;
-		//}
+  for (const auto& shape : shapes)
+    box = box.merged(shape->aabb());
 
-		Eigen::Vector3d minCandidate = geo->function()->meshCRef().vertices.colwise().minCoeff();
-		Eigen::Vector3d maxCandidate = geo->function()->meshCRef().vertices.colwise().maxCoeff();
+  return std::make_tuple(box.min, box.max);
+}
 
-		min(0) = min(0) < minCandidate(0) ? min(0) : minCandidate(0);
-		min(1) = min(1) < minCandidate(1) ? min(1) : minCandidate(1);
-		min(2) = min(2) < minCandidate(2) ? min(2) : minCandidate(2);
+//Uses the analytic AABBs of the functions (see ImplicitFunction::aabb()), functions without one are ignored.
+std::tuple<Eigen::Vector3d, Eigen::Vector3d> lmu::computeDimensions(const CSGNode& node)
+{	
+	AABB box;
 
-		max(0) = max(0) > maxCandidate(0) ? max(0) : maxCandidate(0);
-		max(1) = max(1) > maxCandidate(1) ? max(1) : maxCandidate(1);
-		max(2) = max(2) > maxCandidate(2) ? max(2) : maxCandidate(2);
-	}
+	for (const auto& geo : allGeometryNodePtrs(node))
+		box = box.merged(geo->function()->aabb());
 
-	return std::make_tuple(min, max);
+	return std::make_tuple(box.min, box.max);
 }
 
-CSGNode* lmu::findSmallestSubgraphWithImplicitFunctions(CSGNode& node, const std::vector<ImplicitFunctionPtr>& funcs)
+bool containsImplicitFunctions(const CSGNode& node, const std::vector<ImplicitFunctionPtr>& funcs)
 {
 	auto nfs = lmu::allDistinctFunctions(node);
 	std::unordered_set<ImplicitFunctionPtr> nodeFuncs(nfs.begin(), nfs.end());
-	
+
 	for (const auto& func : funcs)
 	{
 		if (nodeFuncs.count(func) == 0)
-			return nullptr;
-	}	
-	CSGNode* foundNode = &node;
-	
-	for (auto& child : node.childsRef())
-	{
-		auto childNode = findSmallestSubgraphWithImplicitFunctions(child, funcs);
-		if (childNode)
-		{	
-			foundNode = childNode;			
-		}
+			return false;
 	}
 
-	return foundNode;
+	return true;
 }
 
-Mesh lmu::computeMesh(const CSGNode& node, const Eigen::Vector3i& numSamples, const Eigen::Vector3d& minDim, const Eigen::Vector3d& maxDim)
+CSGNode* lmu::findSmallestSubgraphWithImplicitFunctions(CSGNode& node, const std::vector<ImplicitFunctionPtr>& funcs)
 {
-	Eigen::Vector3d min, max;
+	if (!containsImplicitFunctions(node, funcs))
+		return nullptr;
 
+	//Search the last child with all functions. Only it is accessed mutably (copies only its path if the tree is shared).
+	const auto& childs = node.childsCRef();
+	for (int i = (int)childs.size() - 1; i >= 0; --i)
+	{
+		if (containsImplicitFunctions(childs[i], funcs))
+			return findSmallestSubgraphWithImplicitFunctions(node.childsRef()[i], funcs);
+	}
+
+	return &node;
+}
+
+//Sampling domain of computeMesh() and computeMeshAdaptive(). A zero min and max means the dimensions of the node.
+void meshingDomain(const CSGNode& node, const Eigen::Vector3d& minDim, const Eigen::Vector3d& maxDim, Eigen::Vector3d& min, Eigen::Vector3d& max)
+{
 	if (minDim == Eigen::Vector3d(0.0,0.0,0.0) && maxDim == Eigen::Vector3d(0.0, 0.0, 0.0))
 	{
 		auto dims = computeDimensions(node);
 		min = std::get<0>(dims);
 		max = std::get<1>(dims);
-
-		std::cout << "Min: " << min << " Max: " << max << std::endl;
 	}
 	else
 	{
@@ -1053,36 +1447,350 @@ Mesh lmu::computeMesh(const CSGNode& node, const Eigen::Vector3i& numSamples, co
 	//Add a bit dimensions to avoid cuts (TODO: do it right with modulo stepSize).
 	min -= (max - min) * 0.05;
 	max += (max - min) * 0.05;
+}
+
+//Gathers the samples at indices (converted to Scalar while gathering) and evaluates them tile by tile into values.
+template<typename Scalar>
+void evaluateSamplesTiled(const CSGNode& node, const Eigen::MatrixXd& points, const std::vector<int>& indices, double tileSize, Eigen::VectorXd& values)
+{
+	Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> ps(indices.size(), 3);
+	for (int i = 0; i < indices.size(); ++i)
+		ps.row(i) = points.row(indices[i]).template cast<Scalar>();
+
+	Eigen::Matrix<Scalar, Eigen::Dynamic, 1> res = signedDistancesTiled(node, ps, tileSize);
+
+	for (int i = 0; i < indices.size(); ++i)
+		values(indices[i]) = res(i);
+}
+
+//Sampler of computeMesh() and computeMeshToOBJ().
+//Skips bricks of samples whose bounds (dilated by one sample) provably exclude the surface. 
+//No cell touching such a brick can contain the surface, so any value with the right sign results in the same mesh.
+//Bricks are aligned to the grid, so a layer gets the same values in all slabs that contain it.
+SlabSampler meshSampler(const CSGNode& node, const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, 
+	int brickSize, Precision precision)
+{
+	return [node, numSamples, min, stepSize, brickSize, precision](int z0, int z1, const Eigen::MatrixXd& points)
+	{
+		Eigen::VectorXd values(points.rows());
+		std::vector<int> evalIndices;
+
+		for (int bz = (z0 / brickSize) * brickSize; bz <= z1; bz += brickSize)
+		{
+			for (int by = 0; by < numSamples(1); by += brickSize)
+			{
+				for (int bx = 0; bx < numSamples(0); bx += brickSize)
+				{
+					Eigen::Vector3i lo(bx, by, bz);
+					Eigen::Vector3i hi = (lo + Eigen::Vector3i(brickSize, brickSize, brickSize)).cwiseMin(numSamples);
+
+					Eigen::Vector3d brickMin = min + (lo - Eigen::Vector3i(1, 1, 1)).cast<double>().cwiseProduct(stepSize);
+					Eigen::Vector3d brickMax = min + hi.cast<double>().cwiseProduct(stepSize);
+
+					Interval bounds = node.signedDistanceInterval(brickMin, brickMax);
+					bool skip = bounds.lo > 0.0 || bounds.hi < 0.0;
+
+					for (int z = std::max(lo.z(), z0); z < std::min(hi.z(), z1 + 1); ++z)
+					{
+						for (int y = lo.y(); y < hi.y(); ++y)
+						{
+							for (int x = lo.x(); x < hi.x(); ++x)
+							{
+								int idx = numSamples(0) * numSamples(1) * (z - z0) + numSamples(0) * y + x;
+								if (skip)
+									values(idx) = bounds.lo > 0.0 ? bounds.lo : bounds.hi;
+								else
+									evalIndices.push_back(idx);
+							}
+						}
+					}
+				}
+			}
+		}
+
+		//Evaluate the remaining samples brick by brick, each with the tree pruned to the brick.
+		double tileSize = brickSize * stepSize.maxCoeff();
+
+		if (precision == Precision::Float)
+			evaluateSamplesTiled<float>(node, points, evalIndices, tileSize, values);
+		else
+			evaluateSamplesTiled<double>(node, points, evalIndices, tileSize, values);
+
+		return values;
+	};
+}
+
+Mesh lmu::computeMesh(const CSGNode& node, const Eigen::Vector3i& numSamples, const Eigen::Vector3d& minDim, const Eigen::Vector3d& maxDim, Precision precision)
+{
+	Eigen::Vector3d min, max;
+	meshingDomain(node, minDim, maxDim, min, max);
 
 	Eigen::Vector3d stepSize((max(0) - min(0)) / numSamples(0), (max(1) - min(1)) / numSamples(1), (max(2) - min(2)) / numSamples(2));
 
-	int num = numSamples(0)*numSamples(1)*numSamples(2);
-	Eigen::MatrixXd samplingPoints(num, 3);
-	Eigen::VectorXd samplingValues(num);
-		
-	for (int x = 0; x < numSamples(0); ++x)
+	const int brickSize = 8;
+
+	//Slabs of one brick layer are sampled and polygonized in parallel.
+	return marchingCubes(numSamples, min, stepSize, brickSize, meshSampler(node, numSamples, min, stepSize, brickSize, precision));
+}
+
+int64_t lmu::computeMeshToOBJ(const CSGNode& node, const Eigen::Vector3i& numSamples, const std::string& file, const Eigen::Vector3d& minDim, const Eigen::Vector3d& maxDim, Precision precision)
+{
+	Eigen::Vector3d min, max;
+	meshingDomain(node, minDim, maxDim, min, max);
+
+	Eigen::Vector3d stepSize((max(0) - min(0)) / numSamples(0), (max(1) - min(1)) / numSamples(1), (max(2) - min(2)) / numSamples(2));
+
+	const int brickSize = 8;
+
+	return marchingCubesToOBJ(numSamples, min, stepSize, meshSampler(node, numSamples, min, stepSize, brickSize, precision), file);
+}
+
+//Leaf of the octree of computeMeshAdaptive(): the cells [lo, hi) and the tree pruned to them.
+struct MeshingLeaf
+{
+	MeshingLeaf(const Eigen::Vector3i& lo, const Eigen::Vector3i& hi, const CSGNode& node) : 
+		lo(lo),
+		hi(hi),
+		node(node)
+	{
+	}
+
+	Eigen::Vector3i lo;
+	Eigen::Vector3i hi;
+	CSGNode node;
+};
+
+void collectMeshingLeaves(const CSGNode& node, const Eigen::Vector3i& lo, int size, const Eigen::Vector3i& numCells, int leafSize, 
+	const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, double tolerance, std::vector<MeshingLeaf>& leaves)
+{
+	Eigen::Vector3i hi = (lo + Eigen::Vector3i(size, size, size)).cwiseMin(numCells);
+	if ((hi.array() <= lo.array()).any())
+		return;
+
+	//AABB of the samples at the corners of the cells.
+	Eigen::Vector3d cellsMin = min + lo.cast<double>().cwiseProduct(stepSize);
+	Eigen::Vector3d cellsMax = min + hi.cast<double>().cwiseProduct(stepSize);
+
+	CSGNode pruned = pruneCSGNode(node, cellsMin, cellsMax, tolerance);
+
+	//No sign change, no triangles (also not with the rounding of the evaluation).
+	Interval bounds = pruned.signedDistanceInterval(cellsMin, cellsMax);
+	if (bounds.lo > tolerance || bounds.hi < -tolerance)
+		return;
+
+	if (size <= leafSize)
+	{
+		leaves.push_back(MeshingLeaf(lo, hi, pruned));
+		return;
+	}
+
+	int half = size / 2;
+	for (int i = 0; i < 8; ++i)
+		collectMeshingLeaves(pruned, lo + half * Eigen::Vector3i(i & 1, (i >> 1) & 1, (i >> 2) & 1), half, numCells, leafSize, min, stepSize, tolerance, leaves);
+}
+
+//Triangles of a leaf. Vertices are identified by the grid edge they lie on (the global indices of its samples).
+struct MeshingLeafTriangles
+{
+	std::vector<std::pair<int64_t, int64_t>> edges;
+	std::vector<Eigen::Vector3d> vertices;
+};
+
+//Values at the samples of a leaf (x fastest), the samples are created in Scalar.
+template<typename Scalar>
+Eigen::Matrix<Scalar, Eigen::Dynamic, 1> evaluateMeshingLeaf(const MeshingLeaf& leaf, const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, const PrimitiveSet& primitives)
+{
+	Eigen::Vector3i n = leaf.hi - leaf.lo + Eigen::Vector3i(1, 1, 1);
+
+	Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> ps(n.x() * n.y() * n.z(), 3);
+	for (int z = 0; z < n.z(); ++z)
+		for (int y = 0; y < n.y(); ++y)
+			for (int x = 0; x < n.x(); ++x)
+				ps.row(x + n.x() * (y + n.y() * z)) = (min + (leaf.lo + Eigen::Vector3i(x, y, z)).cast<double>().cwiseProduct(stepSize)).transpose().template cast<Scalar>();
+
+	return CSGTape(leaf.node, primitives).signedDistances(ps);
+}
+
+//Marching tetrahedra on the Kuhn decomposition of each cell (6 tetrahedra around the diagonal from corner 0 to corner 7). 
+//The decomposition is the same for all cells, so the faces of neighboring cells are split alike and the surface is crack-free.
+template<typename Vector>
+void polygonizeMeshingLeaf(const MeshingLeaf& leaf, const Vector& values, const Eigen::Vector3i& numSamples, 
+	const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, MeshingLeafTriangles& res)
+{
+	static const int tets[6][4] = { { 0, 1, 3, 7 }, { 0, 1, 5, 7 }, { 0, 2, 3, 7 }, { 0, 2, 6, 7 }, { 0, 4, 5, 7 }, { 0, 4, 6, 7 } };
+
+	Eigen::Vector3i n = leaf.hi - leaf.lo + Eigen::Vector3i(1, 1, 1);
+
+	auto localIndex = [&n, &leaf](const Eigen::Vector3i& s) { Eigen::Vector3i l = s - leaf.lo; return l.x() + n.x() * (l.y() + n.y() * l.z()); };
+	auto globalIndex = [&numSamples](const Eigen::Vector3i& s) { return (int64_t)s.x() + (int64_t)numSamples.x() * ((int64_t)s.y() + (int64_t)numSamples.y() * (int64_t)s.z()); };
+
+	for (int z = leaf.lo.z(); z < leaf.hi.z(); ++z)
 	{
-		for (int y= 0; y < numSamples(1); ++y)
+		for (int y = leaf.lo.y(); y < leaf.hi.y(); ++y)
 		{
-			for (int z = 0; z < numSamples(2); ++z)
+			for (int x = leaf.lo.x(); x < leaf.hi.x(); ++x)
 			{
-				int idx = numSamples(0) * numSamples(1) * z + numSamples(0) * y + x;
+				Eigen::Vector3i corners[8];
+				double cornerValues[8];
+				int numInside = 0;
+
+				for (int c = 0; c < 8; ++c)
+				{
+					corners[c] = Eigen::Vector3i(x + (c & 1), y + ((c >> 1) & 1), z + ((c >> 2) & 1));
+					cornerValues[c] = values(localIndex(corners[c]));
+					numInside += cornerValues[c] < 0.0 ? 1 : 0;
+				}
 
-				Eigen::Vector3d samplingPoint((double)x * stepSize(0) + min(0), (double)y * stepSize(1) + min(1), (double)z * stepSize(2) + min(2));
+				if (numInside == 0 || numInside == 8)
+					continue;
 
-				samplingPoints.row(idx) = samplingPoint;
-			
-				samplingValues(idx) = node.signedDistanceAndGradient(samplingPoint)(0);
-			
-				//if(samplingValues(idx)  < 0)
-				//	std::cout << samplingValues(idx) << std::endl;
+				for (const auto& tet : tets)
+				{
+					std::vector<int> inside, outside;
+					for (int c : tet)
+						(cornerValues[c] < 0.0 ? inside : outside).push_back(c);
+
+					if (inside.empty() || outside.empty())
+						continue;
+
+					//Vertex on the edge between two corners, interpolated from the sample with the lower global index.
+					auto vertex = [&](int c0, int c1)
+					{
+						int64_t g0 = globalIndex(corners[c0]);
+						int64_t g1 = globalIndex(corners[c1]);
+						if (g1 < g0)
+						{
+							std::swap(c0, c1);
+							std::swap(g0, g1);
+						}
+
+						Eigen::Vector3d p0 = min + corners[c0].cast<double>().cwiseProduct(stepSize);
+						Eigen::Vector3d p1 = min + corners[c1].cast<double>().cwiseProduct(stepSize);
+						double t = cornerValues[c0] / (cornerValues[c0] - cornerValues[c1]);
+
+						res.edges.push_back(std::make_pair(g0, g1));
+						res.vertices.push_back(p0 + t * (p1 - p0));
+					};
+
+					//Triangles point from the inside corners to the outside corners.
+					Eigen::Vector3d dir = Eigen::Vector3d::Zero();
+					for (int c : outside)
+						dir += corners[c].cast<double>().cwiseProduct(stepSize) / outside.size();
+					for (int c : inside)
+						dir -= corners[c].cast<double>().cwiseProduct(stepSize) / inside.size();
+
+					auto orient = [&res, &dir]()
+					{
+						size_t i = res.vertices.size() - 3;
+						Eigen::Vector3d normal = (res.vertices[i + 1] - res.vertices[i]).cross(res.vertices[i + 2] - res.vertices[i]);
+						if (normal.dot(dir) < 0.0)
+						{
+							std::swap(res.vertices[i + 1], res.vertices[i + 2]);
+							std::swap(res.edges[i + 1], res.edges[i + 2]);
+						}
+					};
+
+					if (inside.size() == 2)
+					{
+						//Quad around the tetrahedron.
+						vertex(inside[0], outside[0]); vertex(inside[0], outside[1]); vertex(inside[1], outside[1]);
+						orient();
+						vertex(inside[0], outside[0]); vertex(inside[1], outside[1]); vertex(inside[1], outside[0]);
+						orient();
+					}
+					else
+					{
+						const auto& single = inside.size() == 1 ? inside : outside;
+						const auto& others = inside.size() == 1 ? outside : inside;
+
+						for (int c : others)
+							vertex(single[0], c);
+						orient();
+					}
+				}
 			}
 		}
 	}
+}
+
+Mesh lmu::computeMeshAdaptive(const CSGNode& node, const Eigen::Vector3i& numSamples, const Eigen::Vector3d& minDim, const Eigen::Vector3d& maxDim, Precision precision)
+{
+	Eigen::Vector3d min, max;
+	meshingDomain(node, minDim, maxDim, min, max);
+
+	Eigen::Vector3d stepSize((max(0) - min(0)) / numSamples(0), (max(1) - min(1)) / numSamples(1), (max(2) - min(2)) / numSamples(2));
 
 	Mesh mesh;
+	mesh.vertices = Eigen::MatrixXd(0, 3);
+	mesh.indices = Eigen::MatrixXi(0, 3);
+
+	Eigen::Vector3i numCells = numSamples - Eigen::Vector3i(1, 1, 1);
+	if (numCells.minCoeff() < 1)
+		return mesh;
+
+	//Octree over the cells, refined only where the bounds of the (pruned) tree contain the surface.
+	const int leafSize = 8;
+	int rootSize = leafSize;
+	while (rootSize < numCells.maxCoeff())
+		rootSize *= 2;
+
+	//The bounds have to hold with the rounding of the evaluation (same tolerance as signedDistancesTiled()).
+	double tolerance = 64.0 * (precision == Precision::Float ? std::numeric_limits<float>::epsilon() : std::numeric_limits<double>::epsilon());
+
+	std::vector<MeshingLeaf> leaves;
+	collectMeshingLeaves(node, Eigen::Vector3i(0, 0, 0), rootSize, numCells, leafSize, min, stepSize, tolerance, leaves);
+
+	std::vector<MeshingLeafTriangles> triangles(leaves.size());
+
+	//Primitives are converted once for all leaves.
+	PrimitiveSet primitives(allDistinctFunctions(node));
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < leaves.size(); ++i)
+	{
+		const MeshingLeaf& leaf = leaves[i];
+
+		if (precision == Precision::Float)
+		{
+			Eigen::VectorXf values = evaluateMeshingLeaf<float>(leaf, min, stepSize, primitives);
+			polygonizeMeshingLeaf(leaf, values, numSamples, min, stepSize, triangles[i]);
+		}
+		else
+		{
+			Eigen::VectorXd values = evaluateMeshingLeaf<double>(leaf, min, stepSize, primitives);
+			polygonizeMeshingLeaf(leaf, values, numSamples, min, stepSize, triangles[i]);
+		}
+	}
+
+	//Weld the vertices of the leaves by their grid edge.
+	std::unordered_map<std::pair<int64_t, int64_t>, int, boost::hash<std::pair<int64_t, int64_t>>> vertexIndices;
+	std::vector<Eigen::Vector3d> vertices;
+	std::vector<Eigen::Vector3i> indices;
+
+	for (const auto& t : triangles)
+	{
+		for (int i = 0; i < t.edges.size(); i += 3)
+		{
+			Eigen::Vector3i tri;
+			for (int j = 0; j < 3; ++j)
+			{
+				auto it = vertexIndices.insert(std::make_pair(t.edges[i + j], (int)vertices.size()));
+				if (it.second)
+					vertices.push_back(t.vertices[i + j]);
+				tri(j) = it.first->second;
+			}
+
+			indices.push_back(tri);
+		}
+	}
 
-	igl::copyleft::marching_cubes(samplingValues, samplingPoints, numSamples(0), numSamples(1), numSamples(2), mesh.vertices, mesh.indices);
+	mesh.vertices.resize(vertices.size(), 3);
+	for (int i = 0; i < vertices.size(); ++i)
+		mesh.vertices.row(i) = vertices[i].transpose();
+
+	mesh.indices.resize(indices.size(), 3);
+	for (int i = 0; i < indices.size(); ++i)
+		mesh.indices.row(i) = indices[i].transpose();
 
 	return mesh;
 }
@@ -1223,6 +1931,111 @@ bool optimizeCSGNodeStructureRec(CSGNode& node, const std::shared_ptr<ImplicitFu
 	return insertedNullFunc;
 }
 
+//Returns the pruned node, bounds are the interval bounds of node over the box.
+CSGNode pruneCSGNode(const CSGNode& node, const Eigen::Vector3d& min, const Eigen::Vector3d& max, double tolerance, Interval& bounds)
+{
+	//a is above b for all points in the box, also with the rounding of the evaluation.
+	auto above = [tolerance](double a, double b) { return a > b + tolerance * (1.0 + std::abs(b)); };
+
+	if (node.type() == CSGNodeType::Geometry || node.childsCRef().empty())
+	{
+		bounds = node.signedDistanceInterval(min, max);
+		return node;
+	}
+
+	const auto& childs = node.childsCRef();
+
+	std::vector<CSGNode> prunedChilds;
+	std::vector<Interval> childBounds(childs.size());
+	for (int i = 0; i < childs.size(); ++i)
+		prunedChilds.push_back(pruneCSGNode(childs[i], min, max, tolerance, childBounds[i]));
+
+	switch (node.operationType())
+	{
+	case CSGNodeOperationType::Union:
+	case CSGNodeOperationType::Intersection:
+	{
+		bool isUnion = node.operationType() == CSGNodeOperationType::Union;
+
+		//The child with the lowest upper bound (highest lower bound) is kept, childs that cannot go below (above) it are removed.
+		int best = 0;
+		for (int i = 1; i < childs.size(); ++i)
+		{
+			if (isUnion ? childBounds[i].hi < childBounds[best].hi : childBounds[i].lo > childBounds[best].lo)
+				best = i;
+		}
+
+		std::vector<CSGNode> kept;
+		bounds = childBounds[best];
+		for (int i = 0; i < childs.size(); ++i)
+		{
+			if (i != best && (isUnion ? above(childBounds[i].lo, childBounds[best].hi) : above(childBounds[best].lo, childBounds[i].hi)))
+				continue;
+
+			kept.push_back(prunedChilds[i]);
+			bounds = isUnion ? vmin(bounds, childBounds[i]) : vmax(bounds, childBounds[i]);
+		}
+
+		if (kept.size() == 1)
+			return kept[0];
+
+		prunedChilds = kept;
+		break;
+	}
+
+	case CSGNodeOperationType::Difference:
+	{
+		Interval left = childBounds[0];
+		Interval right = -childBounds[1];
+
+		//The subtracted child cannot win.
+		if (above(left.lo, right.hi))
+		{
+			bounds = left;
+			return prunedChilds[0];
+		}
+
+		//The subtracted child always wins.
+		if (above(right.lo, left.hi))
+		{
+			bounds = right;
+			return opComp({ prunedChilds[1] });
+		}
+
+		bounds = vmax(left, right);
+		break;
+	}
+
+	case CSGNodeOperationType::Complement:
+		bounds = -childBounds[0];
+		break;
+
+	default:
+		bounds = node.signedDistanceInterval(min, max);
+		break;
+	}
+
+	bool changed = prunedChilds.size() != childs.size();
+	for (int i = 0; i < prunedChilds.size() && !changed; ++i)
+		changed = prunedChilds[i].nodePtr() != childs[i].nodePtr();
+
+	if (!changed)
+		return node;
+
+	CSGNode res = node;
+	res.childsRef() = prunedChilds;
+	return res;
+}
+
+CSGNode lmu::pruneCSGNode(const CSGNode& node, const Eigen::Vector3d& min, const Eigen::Vector3d& max, double tolerance)
+{
+	if (!node.isValid())
+		return node;
+
+	Interval bounds;
+	return ::pruneCSGNode(node, min, max, tolerance, bounds);
+}
+
 int lmu::optimizeCSGNodeStructure(CSGNode& node)
 {
 	auto nullFunc = std::make_shared<IFNull>("Null");
@@ -1364,25 +2177,73 @@ lmu::PointCloud lmu::computePointCloud(const CSGNode& node, const CSGNodeSamplin
 	std::normal_distribution<> dy{ 0.0 , params.errorSigma };
 	std::normal_distribution<> dz{ 0.0 , params.errorSigma };
 
+	//The grid is evaluated one x-slab at a time. 
+	//Tiles of a slab that are provably farther than maxDistance from the surface are skipped.
+	//Gradients are only computed for points close to the surface.
+	const int tileSize = 16;
+	Eigen::MatrixXd slabPoints;
+	std::vector<int> slabIndices;
+	
 	for (int x = 0; x < numSamples(0); ++x)
 	{
-		for (int y = 0; y < numSamples(1); ++y)
+		slabIndices.clear();
+
+		for (int ty = 0; ty < numSamples(1); ty += tileSize)
 		{
-			for (int z = 0; z < numSamples(2); ++z)
-			{	
-				Eigen::Vector3d samplingPoint((double)x * params.samplingStepSize + min(0), (double)y * params.samplingStepSize + min(1), (double)z * params.samplingStepSize + min(2));
+			for (int tz = 0; tz < numSamples(2); tz += tileSize)
+			{
+				int yEnd = std::min(ty + tileSize, numSamples(1));
+				int zEnd = std::min(tz + tileSize, numSamples(2));
 
-				auto samplingValue = node.signedDistanceAndGradient(samplingPoint);
-				
-				if (abs(samplingValue(0)) < params.maxDistance)
-				{
-					Eigen::Matrix<double, 1, 6> sp; 
-					sp.row(0) << samplingPoint(0) + dx(gen), samplingPoint(1) + dy(gen), samplingPoint(2) + dz(gen), samplingValue(1), samplingValue(2), samplingValue(3);
+				Eigen::Vector3d tileMin = min + Eigen::Vector3d(x, ty, tz) * params.samplingStepSize;
+				Eigen::Vector3d tileMax = min + Eigen::Vector3d(x, yEnd - 1, zEnd - 1) * params.samplingStepSize;
 
-					samplingPoints.push_back(sp);
-				}
+				Interval bounds = node.signedDistanceInterval(tileMin, tileMax);
+				if (bounds.lo >= params.maxDistance || bounds.hi <= -params.maxDistance)
+					continue;
+
+				for (int y = ty; y < yEnd; ++y)
+					for (int z = tz; z < zEnd; ++z)
+						slabIndices.push_back(y * numSamples(2) + z);
 			}
 		}
+
+		//Keep the original point order (noise is drawn per point).
+		std::sort(slabIndices.begin(), slabIndices.end());
+
+		slabPoints.resize(slabIndices.size(), 3);
+		for (int i = 0; i < slabIndices.size(); ++i)
+		{
+			int y = slabIndices[i] / numSamples(2);
+			int z = slabIndices[i] % numSamples(2);
+
+			slabPoints.row(i) << (double)x * params.samplingStepSize + min(0), (double)y * params.samplingStepSize + min(1), (double)z * params.samplingStepSize + min(2);
+		}
+
+		Eigen::VectorXd slabValues = signedDistancesTiled(node, slabPoints, tileSize * params.samplingStepSize);
+		
+		std::vector<int> nearSurface;
+		for (int i = 0; i < slabValues.rows(); ++i)
+		{
+			if (abs(slabValues(i)) < params.maxDistance)
+				nearSurface.push_back(i);
+		}
+
+		Eigen::MatrixXd nearSurfacePoints(nearSurface.size(), 3);
+		for (int i = 0; i < nearSurface.size(); ++i)
+			nearSurfacePoints.row(i) = slabPoints.row(nearSurface[i]);
+
+		Eigen::MatrixXd samplingValues = node.signedDistanceAndGradients(nearSurfacePoints);
+
+		for (int i = 0; i < nearSurface.size(); ++i)
+		{
+			Eigen::Vector3d samplingPoint = nearSurfacePoints.row(i).transpose();
+
+			Eigen::Matrix<double, 1, 6> sp;
+			sp.row(0) << samplingPoint(0) + dx(gen), samplingPoint(1) + dy(gen), samplingPoint(2) + dz(gen), samplingValues(i, 1), samplingValues(i, 2), samplingValues(i, 3);
+
+			samplingPoints.push_back(sp);
+		}
 	}
 
 	PointCloud res(samplingPoints.size(), 6);
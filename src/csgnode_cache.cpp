@@ -0,0 +1,275 @@
+#include "../include/csgnode_cache.h"
+#include "../include/csgtape.h"
+
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/functional/hash.hpp>
+
+using namespace lmu;
+
+lmu::CSGNodeResultCache::CSGNodeResultCache(const Eigen::MatrixXd& ps, double h, Precision precision, size_t maxBytes, bool gradients, 
+	const std::shared_ptr<const PrecomputedPrimitives>& primitives) :
+	_ps(ps),
+	_psFloat(precision == Precision::Float ? Eigen::MatrixXf(ps.cast<float>()) : Eigen::MatrixXf()),
+	_h(h),
+	_precision(precision),
+	_maxBytes(maxBytes),
+	_numCols(gradients ? 4 : 1),
+	_primitives(primitives),
+	_nextId(1)
+{
+}
+
+CSGNodeResultCache::Result lmu::CSGNodeResultCache::evaluate(const CSGNode& node)
+{
+	if (!node.isValid())
+		return std::make_shared<const Eigen::MatrixXd>(Eigen::MatrixXd::Zero(_ps.rows(), _numCols));
+
+	//Keys of all subtrees in pre-order.
+	std::vector<Subtree> subtrees;
+	computeKeys(node, subtrees);
+
+	return evaluate(subtrees, 0).result;
+}
+
+bool lmu::CSGNodeResultCache::Key::operator==(const Key& other) const
+{
+	return type == other.type && operationType == other.operationType && function == other.function && childs == other.childs;
+}
+
+size_t lmu::CSGNodeResultCache::KeyHash::operator()(const Key& key) const
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, key.type);
+	boost::hash_combine(seed, key.operationType);
+	boost::hash_combine(seed, reinterpret_cast<std::uintptr_t>(key.function));
+	boost::hash_range(seed, key.childs.begin(), key.childs.end());
+
+	return seed;
+}
+
+//The ids of the childs are looked up first, so a parent key is complete if all its childs are cached.
+int lmu::CSGNodeResultCache::computeKeys(const CSGNode& node, std::vector<Subtree>& subtrees)
+{
+	int idx = subtrees.size();
+	subtrees.push_back(Subtree{ &node, Key{ node.type(), CSGNodeOperationType::Invalid, nullptr, {} }, true, {} });
+
+	if (node.type() == CSGNodeType::Geometry)
+	{
+		subtrees[idx].key.function = node.function().get();
+		return idx;
+	}
+
+	//NoOperation is an identity without childs and evaluates like Noop.
+	subtrees[idx].key.operationType = node.operationType();
+	for (const auto& child : node.childsCRef())
+	{
+		int childIdx = computeKeys(child, subtrees);
+		std::uint64_t childId = subtrees[childIdx].isComplete ? findId(subtrees[childIdx].key) : 0;
+
+		subtrees[idx].childs.push_back(childIdx);
+		subtrees[idx].key.childs.push_back(childId);
+		subtrees[idx].isComplete &= childId != 0;
+	}
+
+	return idx;
+}
+
+//Childs are only evaluated if the node itself is not in the cache.
+CSGNodeResultCache::Evaluation lmu::CSGNodeResultCache::evaluate(std::vector<Subtree>& subtrees, int idx)
+{
+	if (subtrees[idx].isComplete)
+	{
+		Evaluation res = find(subtrees[idx].key);
+		if (res.result)
+			return res;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> l(_mutex);
+		_statistics.numTries++;
+	}
+
+	std::vector<Result> childResults;
+	childResults.reserve(subtrees[idx].childs.size());
+	bool childsCached = true;
+	for (int i = 0; i < subtrees[idx].childs.size(); ++i)
+	{
+		Evaluation child = evaluate(subtrees, subtrees[idx].childs[i]);
+		subtrees[idx].key.childs[i] = child.id;
+		childsCached &= child.id != 0;
+		childResults.push_back(child.result);
+	}
+
+	//Without ids for all childs, the key would not identify the subtree.
+	Result result = compute(subtrees, childResults, idx);
+	std::uint64_t id = childsCached ? insert(subtrees[idx].key, result, subtrees[idx].node->function()) : 0;
+
+	return Evaluation{ id, result };
+}
+
+//Same instructions as CSGTape, applied per node instead of on flattened unions and intersections.
+CSGNodeResultCache::Result lmu::CSGNodeResultCache::compute(const std::vector<Subtree>& subtrees, const std::vector<Result>& childResults, int idx)
+{
+	const CSGNode& node = *subtrees[idx].node;
+
+	if (node.type() == CSGNodeType::Geometry)
+	{
+		const auto& f = node.function();
+
+		if (_primitives && _primitives->contains(f))
+			return std::make_shared<const Eigen::MatrixXd>(_primitives->signedDistanceAndGradients(f).leftCols(_numCols));
+
+		//Results are stored in double.
+		if (_precision == Precision::Float)
+		{
+			if (_numCols == 1)
+				return std::make_shared<const Eigen::MatrixXd>(f->signedDistances(_psFloat).cast<double>());
+			else
+				return std::make_shared<const Eigen::MatrixXd>(f->signedDistanceAndGradients(_psFloat, _h).cast<double>());
+		}
+
+		if (_numCols == 1)
+			return std::make_shared<const Eigen::MatrixXd>(f->signedDistances(_ps));
+		else
+			return std::make_shared<const Eigen::MatrixXd>(f->signedDistanceAndGradients(_ps, _h));
+	}
+
+	Eigen::Array<bool, Eigen::Dynamic, 1> takeSrc(_ps.rows());
+
+	switch (node.operationType())
+	{
+	case CSGNodeOperationType::Union:
+	case CSGNodeOperationType::Intersection:
+	{
+		bool isUnion = node.operationType() == CSGNodeOperationType::Union;
+
+		if (childResults.empty())
+			return constant(isUnion ? std::numeric_limits<double>::max() : -std::numeric_limits<double>::max());
+
+		Eigen::MatrixXd res = *childResults[0];
+		for (int i = 1; i < childResults.size(); ++i)
+		{
+			const Eigen::MatrixXd& src = *childResults[i];
+			if (isUnion)
+				takeSrc = src.col(0).array() < res.col(0).array();
+			else
+				takeSrc = src.col(0).array() > res.col(0).array();
+
+			for (int k = 0; k < _numCols; ++k)
+				res.col(k) = takeSrc.select(src.col(k), res.col(k));
+		}
+
+		return std::make_shared<const Eigen::MatrixXd>(std::move(res));
+	}
+
+	case CSGNodeOperationType::Difference:
+	{
+		Eigen::MatrixXd res = *childResults[0];
+		const Eigen::MatrixXd& src = *childResults[1];
+
+		takeSrc = !(res.col(0).array() > -src.col(0).array());
+		for (int k = 0; k < _numCols; ++k)
+			res.col(k) = takeSrc.select(-src.col(k), res.col(k));
+
+		return std::make_shared<const Eigen::MatrixXd>(std::move(res));
+	}
+
+	case CSGNodeOperationType::Complement:
+		return std::make_shared<const Eigen::MatrixXd>(-*childResults[0]);
+
+	case CSGNodeOperationType::Identity:
+		//NoOperation reports itself as identity but has no childs.
+		return childResults.empty() ? constant(std::numeric_limits<double>::max()) : childResults[0];
+
+	case CSGNodeOperationType::Noop:
+		return constant(std::numeric_limits<double>::max());
+
+	default:
+		throw std::runtime_error("Operation type is not supported");
+	}
+}
+
+//Constants have to stay finite in single precision (see CSGTape).
+CSGNodeResultCache::Result lmu::CSGNodeResultCache::constant(double value) const
+{
+	if (_precision == Precision::Float)
+		value = lmu::clamp(value, -(double)std::numeric_limits<float>::max(), (double)std::numeric_limits<float>::max());
+
+	Eigen::MatrixXd res = Eigen::MatrixXd::Zero(_ps.rows(), _numCols);
+	res.col(0).setConstant(value);
+
+	return std::make_shared<const Eigen::MatrixXd>(std::move(res));
+}
+
+std::uint64_t lmu::CSGNodeResultCache::findId(const Key& key) const
+{
+	std::lock_guard<std::mutex> l(_mutex);
+
+	auto it = _entries.find(key);
+	return it != _entries.end() ? it->second.id : 0;
+}
+
+CSGNodeResultCache::Evaluation lmu::CSGNodeResultCache::find(const Key& key)
+{
+	std::lock_guard<std::mutex> l(_mutex);
+
+	_statistics.numTries++;
+
+	auto it = _entries.find(key);
+	if (it == _entries.end())
+		return Evaluation{ 0, nullptr };
+
+	_statistics.numHits++;
+	_lru.splice(_lru.begin(), _lru, it->second.lruPosition);
+
+	return Evaluation{ it->second.id, it->second.result };
+}
+
+//Returns the id of the entry, 0 if the result is too large to be cached.
+std::uint64_t lmu::CSGNodeResultCache::insert(const Key& key, const Result& result, const ImplicitFunctionPtr& function)
+{
+	//Key and entry are stored in the map, the key is also referenced by the LRU list.
+	size_t bytes = result->size() * sizeof(double) + sizeof(Key) + key.childs.size() * sizeof(std::uint64_t) + sizeof(Entry) + sizeof(const Key*);
+	if (bytes > _maxBytes)
+		return 0;
+
+	std::lock_guard<std::mutex> l(_mutex);
+
+	//Another thread may have computed the same subtree.
+	auto existing = _entries.find(key);
+	if (existing != _entries.end())
+		return existing->second.id;
+
+	while (!_lru.empty() && _statistics.numBytes + bytes > _maxBytes)
+	{
+		auto it = _entries.find(*_lru.back());
+		_statistics.numBytes -= it->second.numBytes;
+		_lru.pop_back();
+		_entries.erase(it);
+	}
+
+	auto it = _entries.emplace(key, Entry{ _nextId++, result, function, bytes, _lru.end() }).first;
+	_lru.push_front(&it->first);
+	it->second.lruPosition = _lru.begin();
+	_statistics.numBytes += bytes;
+
+	return it->second.id;
+}
+
+CacheStatistics lmu::CSGNodeResultCache::statistics() const
+{
+	std::lock_guard<std::mutex> l(_mutex);
+	return _statistics;
+}
+
+void lmu::CSGNodeResultCache::clear()
+{
+	std::lock_guard<std::mutex> l(_mutex);
+
+	_entries.clear();
+	_lru.clear();
+	_statistics.numBytes = 0;
+}
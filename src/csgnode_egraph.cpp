@@ -0,0 +1,560 @@
+#include "../include/csgnode_egraph.h"
+#include "../include/csgnode_helper.h"
+
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include <boost/functional/hash.hpp>
+
+using namespace lmu;
+
+using Op = CSGENode::Op;
+
+size_t lmu::CSGENodeHash::operator()(const CSGENode& node) const
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, node.op);
+	boost::hash_combine(seed, node.function);
+	boost::hash_range(seed, node.childs.begin(), node.childs.end());
+
+	return seed;
+}
+
+lmu::CSGEGraph::CSGEGraph(const CSGNode& node, bool setIdentities) :
+	_numInputNodes(0),
+	_numMerges(0),
+	_setIdentities(setIdentities)
+{
+	_root = add(node);
+}
+
+//Records the pre-order position of the node in the input tree, extract() orders operands by it.
+int lmu::CSGEGraph::add(const CSGNode& node)
+{
+	int position = _numInputNodes++;
+
+	int c = find(addInput(node));
+	_positions[c] = std::min(_positions[c], position);
+
+	return c;
+}
+
+int lmu::CSGEGraph::addInput(const CSGNode& node)
+{
+	if (node.type() == CSGNodeType::Geometry)
+	{
+		auto it = _functionLookup.find(node.function().get());
+		int function = it != _functionLookup.end() ? it->second : _functions.size();
+		if (it == _functionLookup.end())
+		{
+			_functions.push_back(node.function());
+			_functionLookup[node.function().get()] = function;
+		}
+
+		return add(CSGENode(Op::Geometry, {}, function));
+	}
+
+	std::vector<int> childs;
+	for (const auto& child : node.childsCRef())
+		childs.push_back(add(child));
+
+	switch (node.operationType())
+	{
+	case CSGNodeOperationType::Union:
+		return add(CSGENode(Op::Union, childs));
+
+	case CSGNodeOperationType::Intersection:
+		return add(CSGENode(Op::Intersection, childs));
+
+	case CSGNodeOperationType::Difference:
+		//Same as optimizeCSGNodeStructure() for incomplete differences.
+		if (childs.size() < 2)
+			return childs.empty() ? emptyClass() : childs[0];
+		return add(CSGENode(Op::Difference, { childs[0], childs[1] }));
+
+	case CSGNodeOperationType::Complement:
+		return add(CSGENode(Op::Complement, { childs[0] }));
+
+	case CSGNodeOperationType::Identity:
+		//NoOperation reports itself as identity but has no childs.
+		return childs.empty() ? emptyClass() : childs[0];
+
+	case CSGNodeOperationType::Noop:
+		return emptyClass();
+
+	default:
+		throw std::runtime_error("Operation type is not supported");
+	}
+}
+
+//Unions and intersections with a single child are the child itself, empty ones are the neutral element.
+int lmu::CSGEGraph::add(CSGENode node)
+{
+	canonicalize(node);
+
+	if (node.op == Op::Union || node.op == Op::Intersection)
+	{
+		if (node.childs.size() == 1)
+			return node.childs[0];
+		if (node.childs.empty())
+			return node.op == Op::Union ? emptyClass() : universeClass();
+	}
+
+	auto it = _memo.find(node);
+	if (it != _memo.end())
+		return find(it->second);
+
+	int c = _parents.size();
+	_parents.push_back(c);
+	_positions.push_back(std::numeric_limits<int>::max());
+	_classes.push_back({ node });
+	_memo[node] = c;
+
+	return c;
+}
+
+int lmu::CSGEGraph::find(int c) const
+{
+	while (_parents[c] != c)
+	{
+		_parents[c] = _parents[_parents[c]];
+		c = _parents[c];
+	}
+
+	return c;
+}
+
+bool lmu::CSGEGraph::merge(int c0, int c1)
+{
+	c0 = find(c0);
+	c1 = find(c1);
+	if (c0 == c1)
+		return false;
+
+	if (_classes[c0].size() < _classes[c1].size())
+		std::swap(c0, c1);
+
+	_parents[c1] = c0;
+	_positions[c0] = std::min(_positions[c0], _positions[c1]);
+	_classes[c0].insert(_classes[c0].end(), _classes[c1].begin(), _classes[c1].end());
+	_classes[c1].clear();
+	_numMerges++;
+
+	return true;
+}
+
+bool lmu::CSGEGraph::canonicalize(CSGENode& node) const
+{
+	auto old = node.childs;
+
+	for (auto& child : node.childs)
+		child = find(child);
+
+	if (node.op == Op::Union || node.op == Op::Intersection)
+	{
+		std::sort(node.childs.begin(), node.childs.end());
+		node.childs.erase(std::unique(node.childs.begin(), node.childs.end()), node.childs.end());
+	}
+
+	return node.childs != old;
+}
+
+//Restores the invariants after merges: nodes are canonical and equal nodes are in the same e-class (congruence).
+void lmu::CSGEGraph::rebuild()
+{
+	bool merged = true;
+	while (merged)
+	{
+		std::vector<std::pair<int, int>> merges;
+		_memo.clear();
+
+		for (int c = 0; c < _classes.size(); ++c)
+		{
+			if (find(c) != c)
+				continue;
+
+			std::vector<CSGENode> nodes;
+			for (auto node : _classes[c])
+			{
+				canonicalize(node);
+
+				if ((node.op == Op::Union || node.op == Op::Intersection) && node.childs.size() == 1)
+				{
+					merges.push_back(std::make_pair(c, node.childs[0]));
+					continue;
+				}
+
+				if (std::find(nodes.begin(), nodes.end(), node) != nodes.end())
+					continue;
+
+				nodes.push_back(node);
+
+				auto it = _memo.emplace(node, c);
+				if (!it.second)
+					merges.push_back(std::make_pair(it.first->second, c));
+			}
+
+			_classes[c] = nodes;
+		}
+
+		merged = false;
+		for (const auto& m : merges)
+			merged |= merge(m.first, m.second);
+	}
+}
+
+std::vector<CSGENode> lmu::CSGEGraph::nodes(int c, CSGENode::Op op) const
+{
+	std::vector<CSGENode> res;
+	for (const auto& node : _classes[find(c)])
+	{
+		if (node.op == op)
+			res.push_back(node);
+	}
+
+	return res;
+}
+
+int lmu::CSGEGraph::emptyClass()
+{
+	return add(CSGENode(Op::Empty));
+}
+
+int lmu::CSGEGraph::universeClass()
+{
+	return add(CSGENode(Op::Universe));
+}
+
+bool containsClass(const std::vector<int>& classes, int c)
+{
+	return std::find(classes.begin(), classes.end(), c) != classes.end();
+}
+
+//New nodes are added while the e-classes are visited, the e-classes they prove equal are merged afterwards.
+bool lmu::CSGEGraph::applyRules()
+{
+	int numNodesBefore = numNodes();
+	int numMergesBefore = _numMerges;
+
+	std::vector<std::pair<int, int>> merges;
+	auto equal = [&merges](int c0, int c1) { merges.push_back(std::make_pair(c0, c1)); };
+
+	int empty = emptyClass();
+	int universe = universeClass();
+
+	int numClasses = _classes.size();
+	for (int c = 0; c < numClasses; ++c)
+	{
+		if (find(c) != c)
+			continue;
+
+		std::vector<CSGENode> classNodes = _classes[c];
+		for (const auto& n : classNodes)
+		{
+			switch (n.op)
+			{
+			case Op::Union:
+			case Op::Intersection:
+			{
+				bool isUnion = n.op == Op::Union;
+				Op dual = isUnion ? Op::Intersection : Op::Union;
+				int neutral = isUnion ? empty : universe;
+				int absorbing = isUnion ? universe : empty;
+
+				std::vector<int> complemented;
+
+				for (int i = 0; i < n.childs.size(); ++i)
+				{
+					int s = n.childs[i];
+					std::vector<int> rest = n.childs;
+					rest.erase(rest.begin() + i);
+
+					if (find(s) == find(neutral))
+						equal(c, add(CSGENode(n.op, rest)));
+					if (find(s) == find(absorbing))
+						equal(c, absorbing);
+
+					//Associativity: x | (y | z) = x | y | z.
+					for (const auto& m : nodes(s, n.op))
+					{
+						std::vector<int> flat = rest;
+						flat.insert(flat.end(), m.childs.begin(), m.childs.end());
+						equal(c, add(CSGENode(n.op, flat)));
+					}
+
+					//Absorption: x | (x & y) = x.
+					for (const auto& m : nodes(s, dual))
+					{
+						if (std::any_of(m.childs.begin(), m.childs.end(), [this, &rest](int mc) { return containsClass(rest, find(mc)); }))
+							equal(c, add(CSGENode(n.op, rest)));
+					}
+
+					auto complements = nodes(s, Op::Complement);
+					for (const auto& m : complements)
+					{
+						//Excluded middle x | !x = universe and contradiction x & !x = empty.
+						if (_setIdentities && containsClass(rest, find(m.childs[0])))
+							equal(c, absorbing);
+
+						//x & !y = x - y
+						if (!isUnion)
+							equal(c, add(CSGENode(Op::Difference, { add(CSGENode(n.op, rest)), m.childs[0] })));
+					}
+
+					if (!complements.empty())
+						complemented.push_back(complements.front().childs[0]);
+				}
+
+				//De Morgan: !x | !y = !(x & y).
+				if (complemented.size() == n.childs.size())
+					equal(c, add(CSGENode(Op::Complement, { add(CSGENode(dual, complemented)) })));
+
+				break;
+			}
+
+			case Op::Difference:
+
+				if (_setIdentities && find(n.childs[0]) == find(n.childs[1]))
+					equal(c, empty);
+
+				//x - y = x & !y
+				equal(c, add(CSGENode(Op::Intersection, { n.childs[0], add(CSGENode(Op::Complement, { n.childs[1] })) })));
+
+				break;
+
+			case Op::Complement:
+			{
+				int x = n.childs[0];
+
+				//!!x = x
+				for (const auto& m : nodes(x, Op::Complement))
+					equal(c, m.childs[0]);
+
+				//De Morgan: !(x | y) = !x & !y.
+				for (Op op : { Op::Union, Op::Intersection })
+				{
+					for (const auto& m : nodes(x, op))
+					{
+						std::vector<int> complemented;
+						for (int mc : m.childs)
+							complemented.push_back(add(CSGENode(Op::Complement, { mc })));
+
+						equal(c, add(CSGENode(op == Op::Union ? Op::Intersection : Op::Union, complemented)));
+					}
+				}
+
+				if (find(x) == find(empty))
+					equal(c, universe);
+				if (find(x) == find(universe))
+					equal(c, empty);
+
+				break;
+			}
+
+			default:
+				break;
+			}
+		}
+	}
+
+	for (const auto& m : merges)
+		merge(m.first, m.second);
+
+	rebuild();
+
+	return numNodes() != numNodesBefore || _numMerges != numMergesBefore;
+}
+
+int lmu::CSGEGraph::saturate(int maxIterations, int maxNodes)
+{
+	int i = 0;
+	while (i < maxIterations && numNodes() <= maxNodes)
+	{
+		i++;
+		if (!applyRules())
+			break;
+	}
+
+	return i;
+}
+
+double lmu::CSGEGraph::nodeCost(const CSGENode& node, const std::vector<double>& childCosts, CSGNodeCost cost)
+{
+	double childCost = 0.0;
+	for (double c : childCosts)
+		childCost += c;
+
+	switch (node.op)
+	{
+	case Op::Geometry:
+		return cost == CSGNodeCost::NumNodes ? 1.0 : (double)PrimitiveCost;
+	case Op::Empty:
+		return 1.0;
+	case Op::Universe:
+		return 2.0;
+	case Op::Union:
+	case Op::Intersection:
+		//One min/max per additional child.
+		return (cost == CSGNodeCost::NumNodes ? 1.0 : (double)childCosts.size() - 1.0) + childCost;
+	default:
+		return 1.0 + childCost;
+	}
+}
+
+double lmu::CSGEGraph::cost(const CSGNode& node, CSGNodeCost cost)
+{
+	if (node.type() == CSGNodeType::Geometry)
+		return nodeCost(CSGENode(Op::Geometry), {}, cost);
+
+	std::vector<double> childCosts;
+	for (const auto& child : node.childsCRef())
+		childCosts.push_back(CSGEGraph::cost(child, cost));
+
+	switch (node.operationType())
+	{
+	case CSGNodeOperationType::Union:
+		return nodeCost(CSGENode(Op::Union), childCosts, cost);
+	case CSGNodeOperationType::Intersection:
+		return nodeCost(CSGENode(Op::Intersection), childCosts, cost);
+	case CSGNodeOperationType::Identity:
+		if (childCosts.empty())
+			return nodeCost(CSGENode(Op::Empty), {}, cost);
+		return (cost == CSGNodeCost::NumNodes ? 1.0 : 0.0) + childCosts[0];
+	case CSGNodeOperationType::Noop:
+		return nodeCost(CSGENode(Op::Empty), {}, cost);
+	default:
+		return nodeCost(CSGENode(Op::Complement), childCosts, cost);
+	}
+}
+
+CSGNode lmu::CSGEGraph::extract(CSGNodeCost cost) const
+{
+	//Costs of the e-classes are lowered until they do not change anymore (e-classes can contain cycles).
+	std::vector<double> costs(_classes.size(), std::numeric_limits<double>::infinity());
+	std::vector<int> best(_classes.size(), -1);
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		for (int c = 0; c < _classes.size(); ++c)
+		{
+			if (find(c) != c)
+				continue;
+
+			for (int i = 0; i < _classes[c].size(); ++i)
+			{
+				const CSGENode& node = _classes[c][i];
+
+				std::vector<double> childCosts;
+				for (int child : node.childs)
+					childCosts.push_back(costs[find(child)]);
+
+				double nodeCost = CSGEGraph::nodeCost(node, childCosts, cost);
+				if (nodeCost < costs[c])
+				{
+					costs[c] = nodeCost;
+					best[c] = i;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	//E-classes used more than once share their tree.
+	std::unordered_map<int, CSGNode> trees;
+	std::function<CSGNode(int)> build = [&](int c) -> CSGNode
+	{
+		c = find(c);
+
+		auto it = trees.find(c);
+		if (it != trees.end())
+			return it->second;
+
+		const CSGENode& node = _classes[c][best[c]];
+
+		//Childs of unions and intersections are sorted by e-class, they are built in the order of the input tree.
+		std::vector<int> order = node.childs;
+		if (node.op == Op::Union || node.op == Op::Intersection)
+		{
+			std::stable_sort(order.begin(), order.end(), [this](int c0, int c1)
+			{
+				return std::make_pair(_positions[find(c0)], find(c0)) < std::make_pair(_positions[find(c1)], find(c1));
+			});
+		}
+
+		std::vector<CSGNode> childs;
+		for (int child : order)
+			childs.push_back(build(child));
+
+		CSGNode res = CSGNode::invalidNode;
+		switch (node.op)
+		{
+		case Op::Geometry:
+			res = geometry(_functions[node.function]);
+			break;
+		case Op::Union:
+			res = opUnion(childs);
+			break;
+		case Op::Intersection:
+			res = opInter(childs);
+			break;
+		case Op::Difference:
+			res = opDiff(childs);
+			break;
+		case Op::Complement:
+			res = opComp(childs);
+			break;
+		case Op::Empty:
+			res = opNo();
+			break;
+		case Op::Universe:
+			res = opComp({ opNo() });
+			break;
+		}
+
+		trees.emplace(c, res);
+		return res;
+	};
+
+	return build(_root);
+}
+
+int lmu::CSGEGraph::root() const
+{
+	return find(_root);
+}
+
+int lmu::CSGEGraph::numClasses() const
+{
+	int num = 0;
+	for (int c = 0; c < _classes.size(); ++c)
+		num += find(c) == c ? 1 : 0;
+
+	return num;
+}
+
+int lmu::CSGEGraph::numNodes() const
+{
+	int num = 0;
+	for (const auto& nodes : _classes)
+		num += nodes.size();
+
+	return num;
+}
+
+CSGNode lmu::optimizeCSGNodeWithEGraph(const CSGNode& node, CSGNodeCost cost, int maxIterations, int maxNodes, bool setIdentities)
+{
+	if (!node.isValid())
+		return node;
+
+	CSGEGraph graph(node, setIdentities);
+	graph.saturate(maxIterations, maxNodes);
+
+	CSGNode res = graph.extract(cost);
+
+	return CSGEGraph::cost(res, cost) < CSGEGraph::cost(node, cost) ? res : node;
+}
@@ -1,6 +1,7 @@
 #include "../include/csgnode_evo.h"
 #include "../include/csgnode_helper.h"
 #include "../include/dnf.h"
+#include "../include/csgtape.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -15,7 +16,7 @@ CSGNode computeForTwoFunctions(const std::vector<ImplicitFunctionPtr>& functions
 CSGNode computeForTwoFunctions(const std::vector<ImplicitFunctionPtr>& functions, const lmu::CSGNodeRanker& ranker);
 
 
-lmu::CSGNodeRanker::CSGNodeRanker(double lambda, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions, const lmu::Graph& connectionGraph) :
+lmu::CSGNodeRanker::CSGNodeRanker(double lambda, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions, const lmu::Graph& connectionGraph, Precision precision, size_t subtreeCacheSize, size_t primitivesBudget) :
 	_lambda(lambda),
 	_epsilon(epsilon),
 	_alpha(alpha),
@@ -23,8 +24,46 @@ lmu::CSGNodeRanker::CSGNodeRanker(double lambda, double epsilon, double alpha, d
 	_functions(functions),
 	_earlyOutTest(!connectionGraph.structure.m_vertices.empty()),
 	_connectionGraph(connectionGraph),
-	_epsilonScale(computeEpsilonScale())
+	_epsilonScale(computeEpsilonScale()),
+	_precision(precision),
+	_primitiveSet(std::make_shared<const PrimitiveSet>(functions))
 {
+	if (_precision == Precision::Float)
+	{
+		auto floatPoints = std::make_shared<std::unordered_map<ImplicitFunction*, Eigen::MatrixXf>>();
+		for (const auto& f : _functions)
+			(*floatPoints)[f.get()] = f->pointsCRef().leftCols(3).cast<float>();
+
+		_floatPoints = floatPoints;
+	}
+
+	if (subtreeCacheSize == 0 && primitivesBudget == 0)
+		return;
+
+	int numPoints = 0;
+	for (const auto& f : _functions)
+		numPoints += f->pointsCRef().rows();
+
+	Eigen::MatrixXd ps(numPoints, 3);
+	int row = 0;
+	for (const auto& f : _functions)
+	{
+		ps.middleRows(row, f->pointsCRef().rows()) = f->pointsCRef().leftCols(3);
+		row += f->pointsCRef().rows();
+	}
+
+	if (primitivesBudget > 0)
+	{
+		size_t memory = PrecomputedPrimitives::memoryEstimate(_functions.size(), numPoints);
+		if (memory <= primitivesBudget)
+			_primitives = std::make_shared<const PrecomputedPrimitives>(_functions, ps, _h, _precision);
+		else
+			std::cout << "Precomputed primitives need " << memory << " bytes (budget: " << primitivesBudget << " bytes). Primitives are evaluated per tree." << std::endl;
+	}
+
+	//The cache takes the results of the leaves from the precomputed primitives.
+	if (subtreeCacheSize > 0)
+		_subtreeCache = std::make_shared<CSGNodeResultCache>(ps, _h, _precision, subtreeCacheSize, true, _primitives);
 }
 
 double lmu::CSGNodeRanker::computeEpsilonScale()
@@ -52,14 +91,57 @@ double lmu::CSGNodeRanker::computeEpsilonScale()
 	return (max - min).norm();
 }
 
+double lmu::CSGNodeRanker::computeGeometryScore(const Eigen::MatrixXd& distAndGrads) const
+{
+	//Rows are the points of all functions.
+	double score = 0.0;
+	int row = 0;
+	for (const auto& f : _functions)
+	{
+		score += lmu::computeGeometryScore(distAndGrads.middleRows(row, f->pointsCRef().rows()), f->pointsCRef(), _epsilon * _epsilonScale, _alpha);
+		row += f->pointsCRef().rows();
+	}
+
+	return score;
+}
+
 double lmu::CSGNodeRanker::rank(const lmu::CSGNode& node) const
 {	
+	if (_subtreeCache)
+	{
+		//Only subtrees that were not ranked before are evaluated.
+		return computeGeometryScore(*_subtreeCache->evaluate(node)) - _lambda * numNodes(node);
+	}
+
+	if (_primitives)
+	{
+		//Only min/max/negate over the precomputed primitive columns.
+		CSGTape tape(node, *_primitiveSet);
+		if (_primitives->contains(tape))
+			return computeGeometryScore(tape.signedDistanceAndGradients(*_primitives)) - _lambda * numNodes(node);
+	}
+
 	return rank(node, _functions);
 }
 
 double lmu::CSGNodeRanker::rank(const lmu::CSGNode& node, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions) const
 {
-	double geometryScore = computeGeometryScore(node, _epsilon * _epsilonScale, _alpha, _h, functions);
+	//Compile the tree once and evaluate it for the points of all functions.
+	CSGTape tape(node, *_primitiveSet);
+
+	if (_precision != Precision::Float)
+		return lmu::computeGeometryScore(tape, _epsilon * _epsilonScale, _alpha, _h, functions) - _lambda * numNodes(node);
+
+	//Points of functions the ranker was not built with are converted per call.
+	double geometryScore = 0.0;
+	for (const auto& f : functions)
+	{
+		auto it = _floatPoints->find(f.get());
+		Eigen::MatrixXf distAndGrads = it != _floatPoints->end() ? 
+			tape.signedDistanceAndGradients(it->second, _h) : tape.signedDistanceAndGradients(Eigen::MatrixXf(f->pointsCRef().leftCols(3).cast<float>()), _h);
+
+		geometryScore += lmu::computeGeometryScore(distAndGrads, f->pointsCRef(), _epsilon * _epsilonScale, _alpha);
+	}
 
 	double score = geometryScore - _lambda * numNodes(node);
 	
@@ -69,10 +151,15 @@ double lmu::CSGNodeRanker::rank(const lmu::CSGNode& node, const std::vector<std:
 std::string lmu::CSGNodeRanker::info() const
 {
 	std::stringstream ss;
-	ss << "CSGNode Ranker (lambda: " << _lambda << ", early out test: " << _earlyOutTest << ")";
+	ss << "CSGNode Ranker (lambda: " << _lambda << ", early out test: " << _earlyOutTest << ", precision: " << precisionToString(_precision) << ", subtree cache: " << (_subtreeCache != nullptr) << ", precomputed primitives: " << (_primitives ? _primitives->memory() : 0) << " bytes)";
 	return ss.str();
 }
 
+lmu::CacheStatistics lmu::CSGNodeRanker::cacheStatistics() const
+{
+	return _subtreeCache ? _subtreeCache->statistics() : CacheStatistics();
+}
+
 boost::dynamic_bitset<> getFunctionConnectionBitfield(const std::shared_ptr<lmu::ImplicitFunction>& func, const lmu::Graph& connectionGraph, const std::unordered_map<std::shared_ptr<lmu::ImplicitFunction>, int>& funcToIdx, int bitfieldSize)
 {
 	boost::dynamic_bitset<> bf(bitfieldSize);
@@ -400,7 +487,7 @@ lmu::CSGNodeOptimization lmu::optimizationTypeFromString(std::string type)
 	return CSGNodeOptimization::TRAVERSE;
 }
 
-lmu::CSGNodePopMan::CSGNodePopMan(double optimizationProb, double preOptimizationProb, int maxFunctions, int nodeSelectionTries, int randomIterations, CSGNodeOptimization type, const lmu::CSGNodeRanker& ranker, const lmu::Graph& connectionGraph) :
+lmu::CSGNodePopMan::CSGNodePopMan(double optimizationProb, double preOptimizationProb, int maxFunctions, int nodeSelectionTries, int randomIterations, CSGNodeOptimization type, const lmu::CSGNodeRanker& ranker, const lmu::Graph& connectionGraph, bool useEGraph) :
 	_optimizationProb(optimizationProb),
 	_preOptimizationProb(preOptimizationProb),
 	_maxFunctions(maxFunctions),
@@ -408,7 +495,8 @@ lmu::CSGNodePopMan::CSGNodePopMan(double optimizationProb, double preOptimizatio
 	_randomIterations(randomIterations),
 	_type(type),
 	_ranker(ranker),
-	_connectionGraph(connectionGraph)
+	_connectionGraph(connectionGraph),
+	_useEGraph(useEGraph)
 {
 	_rndEngine.seed(_rndDevice());
 }
@@ -499,6 +587,9 @@ void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGN
 			{
 				continue;
 			}
+
+			if (_useEGraph)
+				node = optimizeCSGNodeWithEGraph(node);
 		}
 		
 		if (db(_rndEngine, parmb_t{ _optimizationProb }))
@@ -510,14 +601,17 @@ void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGN
 			{
 			case CSGNodeOptimization::TRAVERSE:
 
-				lmu::visit(node, [this](CSGNode& n)
+				//Only the paths to the optimized nodes are copied.
+				lmu::visit(node, [](const CSGNode& n)
 				{
-					auto& childs = n.childsRef();
-					if (childs.size() == 2 && childs[0].type() == CSGNodeType::Geometry && childs[1].type() == CSGNodeType::Geometry)
-					{
-						std::vector<ImplicitFunctionPtr> funcs = getSuitableFunctions({ childs[0].function(), childs[1].function() });
-						n = getOptimizedTree(funcs);
-					}
+					const auto& childs = n.childsCRef();
+					return childs.size() == 2 && childs[0].type() == CSGNodeType::Geometry && childs[1].type() == CSGNodeType::Geometry;
+				},
+				[this](CSGNode& n)
+				{
+					const auto& childs = n.childsCRef();
+					std::vector<ImplicitFunctionPtr> funcs = getSuitableFunctions({ childs[0].function(), childs[1].function() });
+					n = getOptimizedTree(funcs);
 				});
 
 				break;
@@ -544,6 +638,11 @@ void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGN
 			}
 		}
 	}
+
+	//Identical subtrees of all creatures become one shared node.
+	for (auto& c : population)
+		c.creature = _pool.intern(c.creature);
+	_pool.pruneIfGrown();
 }
 
 std::string lmu::CSGNodePopMan::info() const
@@ -620,8 +719,13 @@ lmu::CSGNode lmu::createCSGNodeWithGA(const std::vector<std::shared_ptr<Implicit
 	double preOptimizationProb = p.getDouble("Optimization", "PreOptimizationProb", 0.0);
 	CSGNodeOptimization optimizationType = optimizationTypeFromString(p.getStr("Optimization", "OptimizationType", "traverse"));
 	int randomIterations = p.getInt("Optimization", "RandomIterations", 1);
+	bool useEGraph = p.getBool("Optimization", "UseEGraph", false);
 
 	double gradientStepSize = p.getDouble("Sampling", "GradientStepSize", 0.001);
+	Precision precision = precisionFromString(p.getStr("Sampling", "Precision", "double"));
+
+	size_t subtreeCacheSize = (size_t)p.getInt("Ranking", "SubtreeCacheSizeMB", 0) * 1024 * 1024;
+	size_t primitivesBudget = p.getBool("Ranking", "PrecomputePrimitives", false) ? (size_t)p.getInt("Ranking", "PrecomputedPrimitivesBudgetMB", 1024) * 1024 * 1024 : 0;
 
 	if (shapes.size() == 1)
 		return lmu::geometry(shapes[0]);
@@ -636,11 +740,11 @@ lmu::CSGNode lmu::createCSGNodeWithGA(const std::vector<std::shared_ptr<Implicit
 	double lambda = lambdaBasedOnPoints(shapes);
 	std::cout << "lambda: " << lambda << std::endl;
 
-	lmu::CSGNodeRanker r(lambda, epsilon, alpha, gradientStepSize, shapes, connectionGraph);
+	lmu::CSGNodeRanker r(lambda, epsilon, alpha, gradientStepSize, shapes, connectionGraph, precision, subtreeCacheSize, primitivesBudget);
 
 	lmu::CSGNodeCreator c(shapes, createNewRandomProb, subtreeProb, simpleCrossoverProb, maxTreeDepth, initializeWithUnionOfAllFunctions, r, connectionGraph);
 
-	lmu::CSGNodePopMan popMan(optimizationProb, preOptimizationProb, maxFunctions, nodeSelectionTries, randomIterations, optimizationType, r, connectionGraph);
+	lmu::CSGNodePopMan popMan(optimizationProb, preOptimizationProb, maxFunctions, nodeSelectionTries, randomIterations, optimizationType, r, connectionGraph, useEGraph);
 
 	if (cancellable)
 	{
@@ -712,8 +816,9 @@ CSGNode computeForTwoFunctions(const std::vector<ImplicitFunctionPtr>& functions
 	double alpha = params.getDouble("Ranking", "Alpha", (M_PI / 180.0) * 35.0);
 	double epsilon = params.getDouble("Ranking", "Epsilon", 0.01);
 	double gradientStepSize = params.getDouble("Sampling", "GradientStepSize", 0.001);
+	Precision precision = precisionFromString(params.getStr("Sampling", "Precision", "double"));
 
-	lmu::CSGNodeRanker ranker(lambdaBasedOnPoints(functions), epsilon, alpha, gradientStepSize, functions);
+	lmu::CSGNodeRanker ranker(lambdaBasedOnPoints(functions), epsilon, alpha, gradientStepSize, functions, lmu::Graph(), precision);
 
 	return computeForTwoFunctions(functions, ranker);
 }
@@ -766,6 +871,7 @@ std::tuple<long long, double> computeNodesForClique(const Clique& clique, const
 	double alpha = params.getDouble("Ranking", "Alpha", (M_PI / 180.0) * 35.0);
 	double epsilon = params.getDouble("Ranking", "Epsilon", 0.01);
 	double gradientStepSize = params.getDouble("Sampling", "GradientStepSize", 0.001);
+	Precision precision = precisionFromString(params.getStr("Sampling", "Precision", "double"));
 
 	if (clique.functions.empty())
 	{
@@ -777,7 +883,7 @@ std::tuple<long long, double> computeNodesForClique(const Clique& clique, const
 	}
 	else if (clique.functions.size() == 2)
 	{
-		lmu::CSGNodeRanker ranker(lambdaBasedOnPoints(clique.functions), epsilon, alpha, gradientStepSize, clique.functions);
+		lmu::CSGNodeRanker ranker(lambdaBasedOnPoints(clique.functions), epsilon, alpha, gradientStepSize, clique.functions, lmu::Graph(), precision);
 		
 		std::vector<CSGNode> candidates;
 
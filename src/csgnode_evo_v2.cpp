@@ -35,6 +35,11 @@ std::string lmu::CSGNodeRankerV2::info() const
 	return "Size weight: " + std::to_string(_sizeWeight);
 }
 
+lmu::CacheStatistics lmu::CSGNodeRankerV2::cacheStatistics() const
+{
+	return CacheStatistics();
+}
+
 double lmu::CSGNodeRankerV2::computeGeometryScore(const CSGNode & node, const std::vector<ImplicitFunctionPtr>& funcs) const
 {
 	if (!node.isValid())
@@ -0,0 +1,264 @@
+#include "../include/csgnode_jit.h"
+#include "../include/csgtape.h"
+#include "../include/primitive_set.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <functional>
+#include <stdexcept>
+
+#ifdef CSG_PLAYGROUND_JIT
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+using namespace lmu;
+
+lmu::CompiledCSGNode::CompiledCSGNode(const std::string& libraryPath, const std::shared_ptr<void>& library, Function function) :
+	_libraryPath(libraryPath),
+	_library(library),
+	_function(function)
+{
+}
+
+Eigen::VectorXd lmu::CompiledCSGNode::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	Eigen::VectorXd res(ps.rows());
+
+	//Columns of ps are the SoA coordinate arrays.
+	_function(ps.col(0).data(), ps.col(1).data(), ps.col(2).data(), ps.rows(), res.data());
+
+	return res;
+}
+
+const std::string& lmu::CompiledCSGNode::libraryPath() const
+{
+	return _libraryPath;
+}
+
+lmu::CSGNodeCompiler::CSGNodeCompiler(const std::string& cacheDir, const std::string& compiler, const std::string& flags) :
+	_cacheDir(cacheDir),
+	_compiler(compiler),
+	_flags(flags)
+{
+}
+
+std::string primitiveExpression(const Primitive& p)
+{
+	std::ostringstream ss;
+	ss << std::setprecision(17);
+
+	switch (p.type)
+	{
+	case ImplicitFunctionType::Sphere:
+		ss << "sphereDistance(lx, ly, lz, " << p.params[0] << ")";
+		break;
+	case ImplicitFunctionType::Box:
+		ss << "boxDistance(lx, ly, lz, " << p.params[0] << ", " << p.params[1] << ", " << p.params[2] << ")";
+		break;
+	case ImplicitFunctionType::Cylinder:
+		ss << "cylinderDistance(lx, ly, lz, " << p.params[0] << ", " << p.params[1] << ")";
+		break;
+	case ImplicitFunctionType::Cone:
+		ss << "coneDistance(lx, ly, lz, " << p.params[0] << ", " << p.params[1] << ", " << p.params[2] << ")";
+		break;
+	default:
+		return "0.0";
+	}
+
+	if (p.displacement != 0.0)
+		ss << " + displacement(lx, ly, lz, " << p.displacement << ")";
+
+	return ss.str();
+}
+
+//The instructions of the tape, executed per point. Each primitive is evaluated once per point.
+std::string lmu::CSGNodeCompiler::generateSource(const CSGNode& node)
+{
+	CSGTape tape(node);
+
+	std::ostringstream ss;
+	ss << std::setprecision(17);
+
+	ss << "// Generated by lmu::CSGNodeCompiler." << std::endl;
+	ss << "#include \"sdf_primitives.h\"" << std::endl << std::endl;
+	ss << "using namespace lmu::sdf;" << std::endl << std::endl;
+
+	std::vector<Primitive> primitives;
+	for (const auto& f : tape.primitives())
+	{
+		Primitive p;
+		if (!Primitive::fromFunction(*f, p))
+			throw std::runtime_error("Function '" + f->name() + "' cannot be compiled.");
+
+		ss << "static const double m" << primitives.size() << "[12] = { ";
+		for (int i = 0; i < 12; ++i)
+			ss << p.invTrans[i] << (i < 11 ? ", " : " };");
+		ss << " // " << f->name() << std::endl;
+
+		primitives.push_back(p);
+	}
+
+	ss << std::endl << "extern \"C\" void csgSignedDistances(const double* x, const double* y, const double* z, int n, double* out)" << std::endl;
+	ss << "{" << std::endl;
+	ss << "\tfor (int i = 0; i < n; ++i)" << std::endl;
+	ss << "\t{" << std::endl;
+	ss << "\t\tdouble lx, ly, lz;" << std::endl;
+
+	for (int i = 0; i < primitives.size(); ++i)
+	{
+		ss << "\t\ttransformPoint(x[i], y[i], z[i], m" << i << ", lx, ly, lz);" << std::endl;
+		ss << "\t\tconst double p" << i << " = " << primitiveExpression(primitives[i]) << ";" << std::endl;
+	}
+
+	for (int i = 0; i < tape.numRegisters(); ++i)
+		ss << "\t\tdouble r" << i << ";" << std::endl;
+
+	for (const auto& ins : tape.instructions())
+	{
+		std::string dst = "r" + std::to_string(ins.dst);
+		std::string src = "r" + std::to_string(ins.src);
+
+		ss << "\t\t";
+		switch (ins.op)
+		{
+		case CSGTapeOpCode::Load:
+			ss << dst << " = p" << ins.src << ";";
+			break;
+		case CSGTapeOpCode::Const:
+			ss << dst << " = " << ins.value << ";";
+			break;
+		case CSGTapeOpCode::Min:
+			ss << dst << " = " << src << " < " << dst << " ? " << src << " : " << dst << ";";
+			break;
+		case CSGTapeOpCode::Max:
+			ss << dst << " = " << src << " > " << dst << " ? " << src << " : " << dst << ";";
+			break;
+		case CSGTapeOpCode::MaxNeg:
+			ss << dst << " = " << dst << " > -" << src << " ? " << dst << " : -" << src << ";";
+			break;
+		case CSGTapeOpCode::Neg:
+			ss << dst << " = -" << dst << ";";
+			break;
+		}
+		ss << std::endl;
+	}
+
+	ss << "\t\tout[i] = " << (tape.numRegisters() > 0 ? "r0" : "0.0") << ";" << std::endl;
+	ss << "\t}" << std::endl;
+	ss << "}" << std::endl;
+
+	return ss.str();
+}
+
+bool lmu::CSGNodeCompiler::isAvailable()
+{
+#ifdef CSG_PLAYGROUND_JIT
+	return true;
+#else
+	return false;
+#endif
+}
+
+//Returns false if the file cannot be read.
+bool readFile(const std::string& path, std::string& content)
+{
+	std::ifstream f(path, std::ios::binary);
+	if (!f.good())
+		return false;
+
+	std::ostringstream ss;
+	ss << f.rdbuf();
+	content = ss.str();
+
+	return true;
+}
+
+void writeFile(const std::string& path, const std::string& content)
+{
+	std::ofstream f(path, std::ios::binary);
+	f << content;
+	f.close();
+	if (!f)
+		throw std::runtime_error("Could not write '" + path + "'.");
+}
+
+//Single-quoted for the shell, quotes inside are closed, escaped and reopened.
+std::string shellQuote(const std::string& s)
+{
+	std::string res = "'";
+	for (char c : s)
+		res += c == '\'' ? std::string("'\\''") : std::string(1, c);
+
+	return res + "'";
+}
+
+std::shared_ptr<CompiledCSGNode> lmu::CSGNodeCompiler::compile(const CSGNode& node) const
+{
+#ifdef CSG_PLAYGROUND_JIT
+
+	std::string source = generateSource(node);
+
+	//The compiled unit contains everything the library depends on: compiler, flags and sdf_primitives.h (inlined), 
+	//so a changed header or different flags never load a stale library.
+	std::string header;
+	std::string headerPath = std::string(CSG_PLAYGROUND_INCLUDE_DIR) + "/sdf_primitives.h";
+	if (!readFile(headerPath, header))
+		throw std::runtime_error("Could not read '" + headerPath + "'.");
+
+	const std::string include = "#include \"sdf_primitives.h\"";
+	std::string unit = "// " + _compiler + " " + _flags + "\n" + source;
+	unit.replace(unit.find(include), include.size(), header);
+
+	std::ostringstream name;
+	name << _cacheDir << "/csg_" << std::hex << std::hash<std::string>()(unit);
+	std::string sourcePath = name.str() + ".cpp";
+	std::string libraryPath = name.str() + ".so";
+
+	//The stored unit has to match, otherwise the name collides with another tree (or the library is from an older version).
+	std::string cachedUnit;
+	std::ifstream cachedLibrary(libraryPath);
+	if (!cachedLibrary.good() || !readFile(sourcePath, cachedUnit) || cachedUnit != unit)
+	{
+		//Written and built under temporary names so that concurrent processes never read partially written files.
+		std::string tmpSuffix = "." + std::to_string(getpid());
+		std::string tmpSourcePath = name.str() + tmpSuffix + ".cpp";
+		std::string tmpLibraryPath = libraryPath + tmpSuffix;
+
+		writeFile(tmpSourcePath, unit);
+
+		std::string cmd = _compiler + " " + _flags + " -std=c++14 -shared -fPIC -o " + shellQuote(tmpLibraryPath) + " " + shellQuote(tmpSourcePath);
+		if (std::system(cmd.c_str()) != 0)
+		{
+			std::remove(tmpSourcePath.c_str());
+			throw std::runtime_error("Compiling the tree failed: " + cmd);
+		}
+
+		//The library is moved first, a matching unit then always belongs to a complete library.
+		if (std::rename(tmpLibraryPath.c_str(), libraryPath.c_str()) != 0)
+			throw std::runtime_error("Could not move '" + tmpLibraryPath + "' to '" + libraryPath + "'.");
+		if (std::rename(tmpSourcePath.c_str(), sourcePath.c_str()) != 0)
+			throw std::runtime_error("Could not move '" + tmpSourcePath + "' to '" + sourcePath + "'.");
+	}
+
+	void* handle = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!handle)
+		throw std::runtime_error("Could not load '" + libraryPath + "': " + dlerror());
+
+	std::shared_ptr<void> library(handle, [](void* h) { dlclose(h); });
+
+	auto function = reinterpret_cast<CompiledCSGNode::Function>(dlsym(handle, "csgSignedDistances"));
+	if (!function)
+		throw std::runtime_error("'" + libraryPath + "' has no evaluator.");
+
+	return std::shared_ptr<CompiledCSGNode>(new CompiledCSGNode(libraryPath, library, function));
+
+#else
+
+	throw std::runtime_error("Compiling trees is not available (see CSG_PLAYGROUND_JIT).");
+
+#endif
+}
@@ -0,0 +1,123 @@
+#include "../include/csgnode_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <boost/functional/hash.hpp>
+
+using namespace lmu;
+
+bool lmu::CSGNodePool::Key::operator==(const Key& other) const
+{
+	return nodeClass == other.nodeClass && operationType == other.operationType && function == other.function && name == other.name && childs == other.childs;
+}
+
+size_t lmu::CSGNodePool::KeyHash::operator()(const Key& key) const
+{
+	size_t seed = key.nodeClass.hash_code();
+	boost::hash_combine(seed, key.operationType);
+	boost::hash_combine(seed, reinterpret_cast<std::uintptr_t>(key.function));
+	boost::hash_combine(seed, key.name);
+	boost::hash_range(seed, key.childs.begin(), key.childs.end());
+
+	return seed;
+}
+
+CSGNode lmu::CSGNodePool::intern(const CSGNode& node)
+{
+	if (!node.isValid())
+		return node;
+
+	//Already interned.
+	auto it = _nodeIds.find(node.nodePtr().get());
+	if (it != _nodeIds.end())
+		return CSGNode(_nodes.at(it->second));
+
+	//Childs first, so the key only has to look at the ids of the childs.
+	Key key{ typeid(*node.nodePtr()), node.operationType(), node.type() == CSGNodeType::Geometry ? node.function().get() : nullptr, node.name(), {} };
+
+	std::vector<CSGNode> childs;
+	childs.reserve(node.childsCRef().size());
+	key.childs.reserve(node.childsCRef().size());
+	bool childsInterned = true;
+
+	for (const auto& child : node.childsCRef())
+	{
+		CSGNode internedChild = intern(child);
+		key.childs.push_back(_nodeIds.at(internedChild.nodePtr().get()));
+		childsInterned &= internedChild.nodePtr() == child.nodePtr();
+		childs.push_back(internedChild);
+	}
+
+	auto existing = _ids.find(key);
+	if (existing != _ids.end())
+		return CSGNode(_nodes.at(existing->second));
+
+	//Copy-on-write: only this node is copied, and only if its childs had to be replaced.
+	CSGNode res = node;
+	if (!childsInterned)
+		res.childsRef() = childs;
+
+	int id = _nextId++;
+	_ids.emplace(key, id);
+	_keys.emplace(id, key);
+	_nodeIds[res.nodePtr().get()] = id;
+	_nodes[id] = res.nodePtr();
+
+	return res;
+}
+
+int lmu::CSGNodePool::id(const CSGNode& node) const
+{
+	if (!node.isValid())
+		return -1;
+
+	auto it = _nodeIds.find(node.nodePtr().get());
+	return it != _nodeIds.end() ? it->second : -1;
+}
+
+void lmu::CSGNodePool::prune()
+{
+	//Childs have smaller ids than their parents. Going from the largest id down,
+	//removing a parent releases its childs before they are visited.
+	std::vector<int> ids;
+	ids.reserve(_nodes.size());
+	for (const auto& n : _nodes)
+		ids.push_back(n.first);
+	std::sort(ids.begin(), ids.end(), std::greater<int>());
+
+	for (int id : ids)
+	{
+		auto it = _nodes.find(id);
+		if (it->second.use_count() > 1)
+			continue;
+
+		auto key = _keys.find(id);
+		_ids.erase(key->second);
+		_keys.erase(key);
+		_nodeIds.erase(it->second.get());
+		_nodes.erase(it);
+	}
+
+	_sizeAfterPrune = _nodes.size();
+}
+
+void lmu::CSGNodePool::pruneIfGrown()
+{
+	if (_nodes.size() > 2 * _sizeAfterPrune)
+		prune();
+}
+
+void lmu::CSGNodePool::clear()
+{
+	_ids.clear();
+	_keys.clear();
+	_nodeIds.clear();
+	_nodes.clear();
+	_sizeAfterPrune = 0;
+}
+
+int lmu::CSGNodePool::size() const
+{
+	return _nodes.size();
+}
@@ -0,0 +1,479 @@
+#include "../include/csgtape.h"
+
+#include <tuple>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <algorithm>
+
+#include "../include/constants.h"
+
+using namespace lmu;
+
+lmu::CSGTape::CSGTape(const CSGNode& node, const PrimitiveSet& primitives) :
+	_numRegisters(0)
+{
+	if (node.isValid())
+		compile(node, 0);
+
+	_primitiveSet = PrimitiveSet(_primitives, primitives);
+}
+
+void lmu::CSGTape::compile(const CSGNode& node, int reg)
+{
+	_numRegisters = std::max(_numRegisters, reg + 1);
+
+	if (node.type() == CSGNodeType::Geometry)
+	{
+		_instructions.push_back(CSGTapeInstruction(CSGTapeOpCode::Load, reg, primitiveIndex(node.function())));
+		return;
+	}
+
+	const auto& childs = node.childsCRef();
+
+	switch (node.operationType())
+	{
+	case CSGNodeOperationType::Union:
+	case CSGNodeOperationType::Intersection:
+		compileAccumulation(node, reg);
+		break;
+
+	case CSGNodeOperationType::Difference:
+		compile(childs[0], reg);
+		compile(childs[1], reg + 1);
+		_instructions.push_back(CSGTapeInstruction(CSGTapeOpCode::MaxNeg, reg, reg + 1));
+		break;
+
+	case CSGNodeOperationType::Complement:
+		compile(childs[0], reg);
+		_instructions.push_back(CSGTapeInstruction(CSGTapeOpCode::Neg, reg));
+		break;
+
+	case CSGNodeOperationType::Identity:
+		//NoOperation reports itself as identity but has no childs.
+		if (childs.empty())
+			_instructions.push_back(CSGTapeInstruction(CSGTapeOpCode::Const, reg, 0, std::numeric_limits<double>::max()));
+		else
+			compile(childs[0], reg);
+		break;
+
+	case CSGNodeOperationType::Noop:
+		_instructions.push_back(CSGTapeInstruction(CSGTapeOpCode::Const, reg, 0, std::numeric_limits<double>::max()));
+		break;
+
+	default:
+		throw std::runtime_error("Operation type is not supported");
+	}
+}
+
+void collectOperandsRec(const CSGNode& node, CSGNodeOperationType type, std::vector<const CSGNode*>& operands)
+{
+	for (const auto& child : node.childsCRef())
+	{
+		if (child.type() == CSGNodeType::Operation && child.operationType() == type)
+			collectOperandsRec(child, type, operands);
+		else
+			operands.push_back(&child);
+	}
+}
+
+void lmu::CSGTape::compileAccumulation(const CSGNode& node, int reg)
+{
+	bool isUnion = node.operationType() == CSGNodeOperationType::Union;
+
+	std::vector<const CSGNode*> operands;
+	collectOperandsRec(node, node.operationType(), operands);
+
+	if (operands.empty())
+	{
+		double value = isUnion ? std::numeric_limits<double>::max() : -std::numeric_limits<double>::max();
+		_instructions.push_back(CSGTapeInstruction(CSGTapeOpCode::Const, reg, 0, value));
+		return;
+	}
+
+	compile(*operands[0], reg);
+
+	for (int i = 1; i < operands.size(); ++i)
+	{
+		compile(*operands[i], reg + 1);
+		_instructions.push_back(CSGTapeInstruction(isUnion ? CSGTapeOpCode::Min : CSGTapeOpCode::Max, reg, reg + 1));
+	}
+}
+
+int lmu::CSGTape::primitiveIndex(const ImplicitFunctionPtr& function)
+{
+	auto it = _primitiveLookup.find(function.get());
+	if (it != _primitiveLookup.end())
+		return it->second;
+
+	int idx = _primitives.size();
+	_primitives.push_back(function);
+	_primitiveLookup[function.get()] = idx;
+
+	return idx;
+}
+
+//Constants of the tape (e.g. the max() of an empty union) have to stay finite in single precision.
+template<typename Scalar>
+Scalar constant(double value)
+{
+	return (Scalar)lmu::clamp(value, -(double)std::numeric_limits<Scalar>::max(), (double)std::numeric_limits<Scalar>::max());
+}
+
+Eigen::VectorXd lmu::CSGTape::signedDistances(const Eigen::MatrixXd& ps) const
+{
+	return signedDistances<double>(ps);
+}
+
+Eigen::MatrixXd lmu::CSGTape::signedDistanceAndGradients(const Eigen::MatrixXd& ps, double h) const
+{
+	return signedDistanceAndGradients<double>(ps, h);
+}
+
+template<typename Scalar>
+Eigen::Matrix<Scalar, Eigen::Dynamic, 1> lmu::CSGTape::signedDistances(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps) const
+{
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+
+	std::vector<Vector> prims = _primitiveSet.signedDistances(ps);
+
+	Matrix regs(ps.rows(), _numRegisters);
+
+	for (const auto& ins : _instructions)
+	{
+		auto dst = regs.col(ins.dst);
+
+		switch (ins.op)
+		{
+		case CSGTapeOpCode::Load:
+			dst = prims[ins.src];
+			break;
+		case CSGTapeOpCode::Const:
+			dst.setConstant(constant<Scalar>(ins.value));
+			break;
+		case CSGTapeOpCode::Min:
+			dst = (regs.col(ins.src).array() < dst.array()).select(regs.col(ins.src), dst);
+			break;
+		case CSGTapeOpCode::Max:
+			dst = (regs.col(ins.src).array() > dst.array()).select(regs.col(ins.src), dst);
+			break;
+		case CSGTapeOpCode::MaxNeg:
+			dst = (dst.array() > -regs.col(ins.src).array()).select(dst, -regs.col(ins.src));
+			break;
+		case CSGTapeOpCode::Neg:
+			dst = -dst;
+			break;
+		}
+	}
+
+	return _numRegisters > 0 ? Vector(regs.col(0)) : Vector::Zero(ps.rows());
+}
+
+template<typename Scalar>
+Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> lmu::CSGTape::signedDistanceAndGradients(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps, double h) const
+{
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+
+	std::vector<Matrix> prims(_primitives.size());
+	for (int i = 0; i < _primitives.size(); ++i)
+		prims[i] = _primitives[i]->signedDistanceAndGradients(ps, h);
+
+	std::vector<Eigen::Ref<const Matrix>> primRefs(prims.begin(), prims.end());
+
+	return execute<Scalar>(primRefs, ps.rows());
+}
+
+Eigen::MatrixXd lmu::CSGTape::signedDistanceAndGradients(const PrecomputedPrimitives& primitives) const
+{
+	std::vector<Eigen::Ref<const Eigen::MatrixXd>> primRefs;
+	primRefs.reserve(_primitives.size());
+	for (const auto& p : _primitives)
+		primRefs.push_back(primitives.signedDistanceAndGradients(p));
+
+	return execute<double>(primRefs, primitives.numPoints());
+}
+
+template<typename Scalar>
+Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> lmu::CSGTape::execute(const std::vector<Eigen::Ref<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>>>& prims, int numPoints) const
+{
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+
+	std::vector<Matrix> regs(_numRegisters, Matrix(numPoints, 4));
+	Eigen::Array<bool, Eigen::Dynamic, 1> takeSrc(numPoints);
+
+	for (const auto& ins : _instructions)
+	{
+		auto& dst = regs[ins.dst];
+
+		switch (ins.op)
+		{
+		case CSGTapeOpCode::Load:
+			dst = prims[ins.src];
+			break;
+		case CSGTapeOpCode::Const:
+			dst.setZero();
+			dst.col(0).setConstant(constant<Scalar>(ins.value));
+			break;
+		case CSGTapeOpCode::Min:
+			takeSrc = regs[ins.src].col(0).array() < dst.col(0).array();
+			for (int k = 0; k < 4; ++k)
+				dst.col(k) = takeSrc.select(regs[ins.src].col(k), dst.col(k));
+			break;
+		case CSGTapeOpCode::Max:
+			takeSrc = regs[ins.src].col(0).array() > dst.col(0).array();
+			for (int k = 0; k < 4; ++k)
+				dst.col(k) = takeSrc.select(regs[ins.src].col(k), dst.col(k));
+			break;
+		case CSGTapeOpCode::MaxNeg:
+			takeSrc = !(dst.col(0).array() > -regs[ins.src].col(0).array());
+			for (int k = 0; k < 4; ++k)
+				dst.col(k) = takeSrc.select(-regs[ins.src].col(k), dst.col(k));
+			break;
+		case CSGTapeOpCode::Neg:
+			dst = -dst;
+			break;
+		}
+	}
+
+	return _numRegisters > 0 ? regs[0] : Matrix::Zero(numPoints, 4);
+}
+
+template Eigen::VectorXd lmu::CSGTape::signedDistances<double>(const Eigen::MatrixXd& ps) const;
+template Eigen::VectorXf lmu::CSGTape::signedDistances<float>(const Eigen::MatrixXf& ps) const;
+template Eigen::MatrixXd lmu::CSGTape::signedDistanceAndGradients<double>(const Eigen::MatrixXd& ps, double h) const;
+template Eigen::MatrixXf lmu::CSGTape::signedDistanceAndGradients<float>(const Eigen::MatrixXf& ps, double h) const;
+
+const std::vector<CSGTapeInstruction>& lmu::CSGTape::instructions() const
+{
+	return _instructions;
+}
+
+const std::vector<ImplicitFunctionPtr>& lmu::CSGTape::primitives() const
+{
+	return _primitives;
+}
+
+const PrimitiveSet& lmu::CSGTape::primitiveSet() const
+{
+	return _primitiveSet;
+}
+
+int lmu::CSGTape::numRegisters() const
+{
+	return _numRegisters;
+}
+
+std::string lmu::CSGTape::info() const
+{
+	std::stringstream ss;
+
+	ss << "# Instructions: " << _instructions.size() << " Registers: " << _numRegisters << " Primitives: " << _primitives.size() << std::endl;
+
+	for (const auto& ins : _instructions)
+	{
+		ss << "r" << ins.dst << " = ";
+
+		switch (ins.op)
+		{
+		case CSGTapeOpCode::Load:
+			ss << "load " << _primitives[ins.src]->name();
+			break;
+		case CSGTapeOpCode::Const:
+			ss << "const " << ins.value;
+			break;
+		case CSGTapeOpCode::Min:
+			ss << "min r" << ins.dst << " r" << ins.src;
+			break;
+		case CSGTapeOpCode::Max:
+			ss << "max r" << ins.dst << " r" << ins.src;
+			break;
+		case CSGTapeOpCode::MaxNeg:
+			ss << "max r" << ins.dst << " -r" << ins.src;
+			break;
+		case CSGTapeOpCode::Neg:
+			ss << "-r" << ins.dst;
+			break;
+		}
+
+		ss << std::endl;
+	}
+
+	return ss.str();
+}
+
+template<typename Scalar>
+Eigen::Matrix<Scalar, Eigen::Dynamic, 1> lmu::signedDistancesTiled(const CSGNode& node, const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps, double tileSize)
+{
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+
+	Vector res(ps.rows());
+	if (ps.rows() == 0)
+		return res;
+
+	//Positions are only converted per point, ps stays in Scalar.
+	auto position = [&ps](int i) -> Eigen::Vector3d { return ps.row(i).transpose().template cast<double>(); };
+	Eigen::Vector3d origin = ps.colwise().minCoeff().transpose().template cast<double>();
+
+	std::vector<Eigen::Vector3i> tiles(ps.rows());
+	for (int i = 0; i < ps.rows(); ++i)
+		tiles[i] = ((position(i) - origin) / tileSize).array().floor().template cast<int>();
+
+	std::vector<int> order(ps.rows());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&tiles](int i0, int i1) 
+	{ 
+		return std::tie(tiles[i0].x(), tiles[i0].y(), tiles[i0].z()) < std::tie(tiles[i1].x(), tiles[i1].y(), tiles[i1].z()); 
+	});
+
+	//The bounds have to hold with the rounding of the evaluation in Scalar.
+	double tolerance = 64.0 * std::numeric_limits<Scalar>::epsilon();
+
+	//Primitives are converted once for all tiles.
+	PrimitiveSet primitives(allDistinctFunctions(node));
+
+	std::vector<std::pair<int, int>> ranges;
+	for (int start = 0, end = 0; start < order.size(); start = end)
+	{
+		end = start + 1;
+		while (end < order.size() && tiles[order[end]] == tiles[order[start]])
+			end++;
+
+		ranges.push_back(std::make_pair(start, end));
+	}
+
+	//Tiles are independent (inside of parallel regions, e.g. the slabs of computeMesh(), this runs serially).
+	#pragma omp parallel for schedule(dynamic)
+	for (int r = 0; r < ranges.size(); ++r)
+	{
+		int start = ranges[r].first, end = ranges[r].second;
+
+		Matrix tilePs(end - start, 3);
+		Eigen::Vector3d min = position(order[start]);
+		Eigen::Vector3d max = min;
+		for (int i = start; i < end; ++i)
+		{
+			tilePs.row(i - start) = ps.row(order[i]);
+			min = min.cwiseMin(position(order[i]));
+			max = max.cwiseMax(position(order[i]));
+		}
+
+		Vector tileValues = CSGTape(pruneCSGNode(node, min, max, tolerance), primitives).signedDistances(tilePs);
+
+		for (int i = start; i < end; ++i)
+			res(order[i]) = tileValues(i - start);
+	}
+
+	return res;
+}
+
+template Eigen::VectorXd lmu::signedDistancesTiled<double>(const CSGNode& node, const Eigen::MatrixXd& ps, double tileSize);
+template Eigen::VectorXf lmu::signedDistancesTiled<float>(const CSGNode& node, const Eigen::MatrixXf& ps, double tileSize);
+
+lmu::PrecomputedPrimitives::PrecomputedPrimitives(const std::vector<ImplicitFunctionPtr>& functions, const Eigen::MatrixXd& ps, double h, Precision precision) :
+	_results(ps.rows(), 4 * functions.size())
+{
+	Eigen::MatrixXf psFloat = precision == Precision::Float ? Eigen::MatrixXf(ps.cast<float>()) : Eigen::MatrixXf();
+
+	for (int i = 0; i < functions.size(); ++i)
+	{
+		if (precision == Precision::Float)
+			_results.middleCols(4 * i, 4) = functions[i]->signedDistanceAndGradients(psFloat, h).cast<double>();
+		else
+			_results.middleCols(4 * i, 4) = functions[i]->signedDistanceAndGradients(ps, h);
+
+		_indices[functions[i].get()] = i;
+	}
+}
+
+size_t lmu::PrecomputedPrimitives::memoryEstimate(int numFunctions, int numPoints)
+{
+	return (size_t)numFunctions * (size_t)numPoints * 4 * sizeof(double);
+}
+
+bool lmu::PrecomputedPrimitives::contains(const ImplicitFunctionPtr& function) const
+{
+	return _indices.find(function.get()) != _indices.end();
+}
+
+bool lmu::PrecomputedPrimitives::contains(const CSGTape& tape) const
+{
+	for (const auto& p : tape.primitives())
+	{
+		if (!contains(p))
+			return false;
+	}
+
+	return true;
+}
+
+Eigen::Ref<const Eigen::MatrixXd> lmu::PrecomputedPrimitives::signedDistanceAndGradients(const ImplicitFunctionPtr& function) const
+{
+	return _results.middleCols(4 * _indices.at(function.get()), 4);
+}
+
+int lmu::PrecomputedPrimitives::numPoints() const
+{
+	return _results.rows();
+}
+
+size_t lmu::PrecomputedPrimitives::memory() const
+{
+	return _results.size() * sizeof(double);
+}
+
+double lmu::computeGeometryScore(const CSGTape& tape, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs)
+{
+	double score = 0.0;
+	for (const auto& func : funcs)
+	{
+		//Evaluate the tape once for all points of the function.
+		Eigen::MatrixXd ps = func->pointsCRef().leftCols(3);
+		score += computeGeometryScore(tape.signedDistanceAndGradients(ps, h), func->pointsCRef(), epsilon, alpha);
+	}
+
+	return score;
+}
+
+template<typename Scalar>
+double geometryScore(const Eigen::Ref<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>>& distAndGrads, const PointCloud& points, double epsilon, double alpha)
+{
+	double score = 0.0;
+	for (int i = 0; i < points.rows(); ++i)
+	{
+		auto row = points.row(i);
+		Eigen::Vector3d n = row.tail<3>();
+
+		Eigen::Vector4d distAndGrad = distAndGrads.row(i).transpose().template cast<double>();
+
+		double d = distAndGrad[0] / epsilon;
+
+		Eigen::Vector3d grad = distAndGrad.tail<3>();
+		grad.normalize();
+		if (std::isnan(grad.norm()))
+		{
+			continue;
+		}
+
+		double gradientDotN = lmu::clamp(grad.dot(n), -1.0, 1.0); //clamp is necessary, acos is only defined in [-1,1].
+
+		double theta = std::acos(gradientDotN) / alpha;
+
+		double scoreDelta = (std::exp(-(d*d)) + std::exp(-(theta*theta)));
+
+		score += scoreDelta;
+	}
+
+	return score;
+}
+
+double lmu::computeGeometryScore(const Eigen::Ref<const Eigen::MatrixXd>& distAndGrads, const PointCloud& points, double epsilon, double alpha)
+{
+	return geometryScore<double>(distAndGrads, points, epsilon, alpha);
+}
+
+double lmu::computeGeometryScore(const Eigen::Ref<const Eigen::MatrixXf>& distAndGrads, const PointCloud& points, double epsilon, double alpha)
+{
+	return geometryScore<float>(distAndGrads, points, epsilon, alpha);
+}
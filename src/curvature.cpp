@@ -5,20 +5,17 @@
 #include "csgnode_helper.h"
 
 //from http://citeseerx.ist.psu.edu/viewdoc/download?doi=10.1.1.413.3008&rep=rep1&type=pdf
-lmu::Curvature lmu::curvature(const Eigen::Vector3d & ps, const CSGNode & node, double h)
+lmu::Curvature lmu::curvature(const HyperDual& d)
 {
-	Eigen::Matrix<double, 3, 3> m;
-	Eigen::Matrix<double, 3, 3> hess = hessian(ps, node, h);
+	const Eigen::Matrix<double, 3, 3>& hess = d.H;
 	Eigen::Matrix<double, 3, 3> hessAd = adjunct(hess);
 
 	//std::cout << "Hesse: " << hess << std::endl;
 	//std::cout << "Ad: " << hessAd << std::endl;
 
-	Eigen::Vector3d g(dx(ps, node, h), dy(ps, node, h), dz(ps, node, h));
-
+	const Eigen::Vector3d& g = d.g;
 
 	//std::cout << "Gradient: " << g.normalized() << std::endl;
-	//std::cout << "Gradient: " << Eigen::Vector3d(dx(ps, node, h), dy(ps, node, h), dz(ps, node, h)).normalized() << std::endl;
 	//std::cout << "Trace: " << hess.trace() << std::endl;
 
 	double gaussCurv = (g.transpose() * hessAd * g)(0, 0) / std::pow(g.norm(), 4);
@@ -38,6 +35,30 @@ lmu::Curvature lmu::curvature(const Eigen::Vector3d & ps, const CSGNode & node,
 	return c;
 }
 
+lmu::Curvature lmu::curvature(const Eigen::Vector3d & ps, const CSGNode & node, double h)
+{
+	HyperDual d = node.signedDistanceDerivatives(ps, h);
+
+	//The derivatives at ps do not see kinks within h (e.g. the edges of a box or a change of the winning operand of a union).
+	//There, the gradient does not follow the Hessian and the Hessian is taken from central differences of the gradients.
+	Eigen::Matrix<double, 3, 3> gradientDifferences;
+	double maxDeviation = 0.0;
+	for (int i = 0; i < 3; ++i)
+	{
+		Eigen::Vector3d e = Eigen::Vector3d::Unit(i) * h;
+		Eigen::Vector3d gp = node.signedDistanceAndGradient(ps + e, h).tail<3>();
+		Eigen::Vector3d gm = node.signedDistanceAndGradient(ps - e, h).tail<3>();
+
+		gradientDifferences.col(i) = (gp - gm) / (2.0 * h);
+		maxDeviation = std::max(maxDeviation, std::max((gp - d.g - d.H * e).norm(), (gm - d.g + d.H * e).norm()));
+	}
+
+	if (maxDeviation > 0.1 * d.g.norm())
+		d.H = 0.5 * (gradientDifferences + gradientDifferences.transpose());
+
+	return curvature(d);
+}
+
 Eigen::MatrixXd lmu::filterPrimitivePointsByCurvature(const std::vector<ImplicitFunctionPtr>& funcs, double h, const std::unordered_map<lmu::ImplicitFunctionPtr, double>& outlierTestValues, FilterBehavior behavior, bool normalized)
 {
 	std::vector<Eigen::Matrix<double,1,6>> points; 
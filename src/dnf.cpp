@@ -241,21 +241,14 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 
 		lmu::ImplicitFunctionPtr currentFunc = functions[i];		
 	
+		//Only the node's distance is needed here.
+		Eigen::MatrixXd samplePs = currentFunc->pointsCRef().leftCols(3);
+		Eigen::VectorXd sampleDistsNode = node.signedDistances(samplePs);
+
 		//Test if points of are inside the volume (if so => wrong node).
 		for (int j = 0; j < currentFunc->pointsCRef().rows(); ++j)
 		{
-			Eigen::Matrix<double, 1,6> pn = currentFunc->pointsCRef().row(j);
-
-			Eigen::Vector3d sampleP = pn.leftCols(3);
-			Eigen::Vector3d sampleN = pn.rightCols(3);
-
-			Eigen::Vector4d sampleDistGradFunction = currentFunc->signedDistanceAndGradient(sampleP);
-			double sampleDistFunction = sampleDistGradFunction[0];
-			Eigen::Vector3d sampleGradFunction = sampleDistGradFunction.bottomRows(3);			
-	
-			Eigen::Vector4d sampleDistGradNode = node.signedDistanceAndGradient(sampleP, params.h);
-			double sampleDistNode = sampleDistGradNode[0];
-			Eigen::Vector3d sampleGradNode = sampleDistGradNode.bottomRows(3);
+			double sampleDistNode = sampleDistsNode(j);
 			
 			numConsideredSamples++;
 
@@ -303,6 +296,10 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 		lmu::ImplicitFunctionPtr currentFunc = functions[i];
 		std::tuple<double, double> outlierTestValue = outlierTestValues.at(currentFunc);
 
+		Eigen::MatrixXd samplePs = currentFunc->pointsCRef().leftCols(3);
+		Eigen::VectorXd sampleDistsFunction = currentFunc->signedDistances(samplePs);
+		Eigen::MatrixXd sampleDistGradsNode = node.signedDistanceAndGradients(samplePs, params.h);
+
 		for (int j = 0; j < currentFunc->pointsCRef().rows(); ++j)
 		{
 			Eigen::Matrix<double, 1, 6> pn = currentFunc->pointsCRef().row(j);
@@ -310,14 +307,10 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 			Eigen::Vector3d sampleP = pn.leftCols(3);
 			Eigen::Vector3d sampleN = pn.rightCols(3);
 
-			Eigen::Vector4d sampleDistGradFunction = currentFunc->signedDistanceAndGradient(sampleP);
-			double sampleDistFunction = sampleDistGradFunction[0];
-
-			Eigen::Vector3d sampleGradFunction = sampleDistGradFunction.bottomRows(3);
+			double sampleDistFunction = sampleDistsFunction(j);
 
-			Eigen::Vector4d sampleDistGradNode = node.signedDistanceAndGradient(sampleP, params.h);
-			double sampleDistNode = sampleDistGradNode[0];
-			Eigen::Vector3d sampleGradNode = sampleDistGradNode.bottomRows(3);
+			double sampleDistNode = sampleDistGradsNode(j, 0);
+			Eigen::Vector3d sampleGradNode = sampleDistGradsNode.row(j).rightCols(3).transpose();
 
 			//Do not consider points that are far away from the node's surface.
 			if (std::abs(sampleDistNode - sampleDistFunction) > smallestDelta)
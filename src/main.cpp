@@ -67,6 +67,26 @@ int main(int argc, char *argv[])
 	using namespace std;
 
 	//RUN_TEST(CSGNodeTest);
+	//RUN_TEST(GradientTest);
+	//RUN_TEST(IntervalTest);
+	//RUN_TEST(BoundsTest);
+	//RUN_TEST(HyperDualTest);
+	//RUN_TEST(CopyOnWriteTest);
+	//RUN_TEST(ArenaTest);
+	//RUN_TEST(PoolTest);
+	//RUN_TEST(SubtreeCacheTest);
+	//RUN_TEST(PrecomputedPrimitivesTest);
+	//RUN_TEST(EGraphTest);
+	//RUN_TEST(StaticModelTest);
+	//RUN_TEST(PrimitiveSetTest);
+	//RUN_TEST(JITTest);
+	//RUN_TEST(TilingTest);
+	//RUN_TEST(TransformClassTest);
+	//RUN_TEST(AdaptiveMeshingTest);
+	//RUN_TEST(MarchingCubesTest);
+	//RUN_TEST(StreamingMeshTest);
+	//RUN_TEST(MeshIOTest);
+	//RUN_TEST(PrimitiveMeshPoolTest);
 
 
 	igl::opengl::glfw::Viewer viewer;
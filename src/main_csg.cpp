@@ -56,7 +56,7 @@ enum class CSGRecoveryType {
 
 static void usage(const char* pname) {
   std::cout << "Usage:" << std::endl;
-  std::cout << pname << " points.xyz shapes.prim params.ini"
+  std::cout << pname << " points.xyz|points.ply shapes.prim params.ini"
 	    << " partitionType recoveryType outBasename" 
 	    << std::endl;
   std::cout << std::endl;
@@ -85,10 +85,12 @@ int main(int argc, char *argv[])
   double maxAngleDistance = params.getDouble("Sampling", "MaxAngleDistance", M_PI / 18.0);
   double errorSigma = params.getDouble("Sampling", "ErrorSigma", 0.01);
   double connectionGraphSamplingStepSize = params.getDouble("Sampling", "ConnectionGraphSamplingStepSize", 0.01);
+  Precision precision = precisionFromString(params.getStr("Sampling", "Precision", "double"));
   
   std::string pcName = argv[1]; // "model.xyz";
 
-  auto pointCloud = lmu::readPointCloudXYZ(pcName, 1.0);
+  bool isPLY = pcName.size() >= 4 && pcName.substr(pcName.size() - 4) == ".ply";
+  auto pointCloud = isPLY ? lmu::readPointCloudPLY(pcName, 1.0) : lmu::readPointCloudXYZ(pcName, 1.0);
 
   std::string primName = argv[2]; // "model.prim";
 
@@ -176,9 +178,27 @@ int main(int argc, char *argv[])
   std::string outBasename = argv[6];
   lmu::writeNode(res, outBasename + "_tree.dot");
 
-  auto mesh = lmu::computeMesh(res, Eigen::Vector3i(100, 100, 100));
+  int meshResolution = params.getInt("Meshing", "Resolution", 100);
+  Eigen::Vector3i meshSamples(meshResolution, meshResolution, meshResolution);
 
-  igl::writeOBJ(outBasename + "_mesh.obj", mesh.vertices, mesh.indices);
+  //Streaming keeps only two grid layers in memory (for very high resolutions).
+  if (params.getBool("Meshing", "Streaming", false))
+  {
+    lmu::computeMeshToOBJ(res, meshSamples, outBasename + "_mesh.obj", Eigen::Vector3d(0.0, 0.0, 0.0), Eigen::Vector3d(0.0, 0.0, 0.0), precision);
+  }
+  else
+  {
+    auto mesh = lmu::computeMeshAdaptive(res, meshSamples, Eigen::Vector3d(0.0, 0.0, 0.0), Eigen::Vector3d(0.0, 0.0, 0.0), precision);
+
+    //obj|ply|stl (ply and stl are binary).
+    std::string meshFormat = params.getStr("Meshing", "Format", "obj");
+    if (meshFormat == "ply")
+      lmu::writeMeshPLY(outBasename + "_mesh.ply", mesh);
+    else if (meshFormat == "stl")
+      lmu::writeMeshSTL(outBasename + "_mesh.stl", mesh);
+    else
+      igl::writeOBJ(outBasename + "_mesh.obj", mesh.vertices, mesh.indices);
+  }
 
   
   //std::cout << lmu::espressoExpression(dnf) << std::endl;
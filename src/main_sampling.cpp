@@ -17,7 +17,7 @@ using namespace lmu;
 
 static void usage(const char* pname) {
   std::cout << "Usage:" << std::endl;
-  std::cout << pname << " modelID samplingStepSize maxDistance maxAngleDistance (RAD) noiseSigma outBasename" << std::endl;
+  std::cout << pname << " modelID samplingStepSize maxDistance maxAngleDistance (RAD) noiseSigma outBasename [xyz|ply]" << std::endl;
   std::cout << std::endl;
   std::cout << "Example: " << pname << " 11 0.0 (0.0 means maxDistance * 2) 0.03 0.17 0.01 model" << std::endl;
 }
@@ -29,7 +29,7 @@ int main(int argc, char *argv[])
   using namespace std;
 
 
-  if (argc != 7) {
+  if (argc != 7 && argc != 8) {
     usage(argv[0]);
     return -1;
   }
@@ -479,8 +479,13 @@ int main(int argc, char *argv[])
   auto pointCloud = lmu::computePointCloud(node, samplingParams);
   std::cout << "NUM POINTS: " << pointCloud.rows() << std::endl;
 
-  std::string pcName = modelBasename + ".xyz"; //"model.xyz";
-  lmu::writePointCloudXYZ(pcName, pointCloud);
+  //ply is binary.
+  std::string pcFormat = argc == 8 ? argv[7] : "xyz";
+  std::string pcName = modelBasename + (pcFormat == "ply" ? ".ply" : ".xyz"); //"model.xyz";
+  if (pcFormat == "ply")
+    lmu::writePointCloudPLY(pcName, pointCloud);
+  else
+    lmu::writePointCloudXYZ(pcName, pointCloud);
 
   std::vector<ImplicitFunctionPtr> shapes; 
   for (const auto& geoNode : allGeometryNodePtrs(node)) {
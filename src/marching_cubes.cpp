@@ -0,0 +1,272 @@
+#include "../include/marching_cubes.h"
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include <boost/functional/hash.hpp>
+
+#include <igl/copyleft/marching_cubes_tables.h>
+
+using namespace lmu;
+
+//Corners and edges in the order of igl::copyleft::marching_cubes (and of its tables).
+static const int cornerOffsets[8][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } };
+static const int edgeCorners[12][2] = { { 0, 1 }, { 1, 2 }, { 3, 2 }, { 0, 3 }, { 4, 5 }, { 5, 6 }, { 7, 6 }, { 4, 7 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+
+typedef std::pair<int64_t, int64_t> GridEdge;
+typedef std::unordered_map<GridEdge, int64_t, boost::hash<GridEdge>> GridEdgeMap;
+
+//Polygonized cube layers [z0, z1) of the grid. Vertices are identified by their grid edge (global sample indices).
+struct MarchingCubesSlab
+{
+	std::vector<GridEdge> edges;
+	std::vector<Eigen::Vector3d> vertices;
+	std::vector<Eigen::Vector3i> triangles;
+};
+
+void polygonizeSlab(const Eigen::VectorXd& values, const Eigen::MatrixXd& points, const Eigen::Vector3i& numSamples, int z0, int z1, MarchingCubesSlab& slab)
+{
+	const int64_t layerSize = (int64_t)numSamples.x() * numSamples.y();
+
+	int offsets[8];
+	for (int c = 0; c < 8; ++c)
+		offsets[c] = cornerOffsets[c][0] + cornerOffsets[c][1] * numSamples.x() + cornerOffsets[c][2] * layerSize;
+
+	std::unordered_map<GridEdge, int, boost::hash<GridEdge>> edgeVertices;
+
+	for (int z = z0; z < z1; ++z)
+	{
+		for (int y = 0; y < numSamples.y() - 1; ++y)
+		{
+			for (int x = 0; x < numSamples.x() - 1; ++x)
+			{
+				//Index of corner 0 in the slab.
+				int idx = x + y * numSamples.x() + (z - z0) * layerSize;
+
+				int outside = 0;
+				for (int c = 0; c < 8; ++c)
+				{
+					if (values(idx + offsets[c]) > 0.0)
+						outside |= 1 << c;
+				}
+
+				if (outside == 0 || outside == 255)
+					continue;
+
+				int samples[12];
+				for (int e = 0; e < 12; ++e)
+				{
+					if (!(edgeTable[outside] & (1 << e)))
+						continue;
+
+					int i0 = idx + offsets[edgeCorners[e][0]];
+					int i1 = idx + offsets[edgeCorners[e][1]];
+
+					GridEdge edge(i0 + z0 * layerSize, i1 + z0 * layerSize);
+
+					auto it = edgeVertices.insert(std::make_pair(edge, (int)slab.vertices.size()));
+					if (it.second)
+					{
+						double s0 = std::abs(values(i0));
+						double s1 = std::abs(values(i1));
+						double t = s0 / (s0 + s1);
+
+						slab.edges.push_back(edge);
+						slab.vertices.push_back(((1.0 - t) * points.row(i0) + t * points.row(i1)).transpose());
+					}
+					samples[e] = it.first->second;
+				}
+
+				const int* triangles = triTable[outside][0];
+				for (int i = 0; triangles[i] != -1; i += 3)
+					slab.triangles.push_back(Eigen::Vector3i(samples[triangles[i]], samples[triangles[i + 1]], samples[triangles[i + 2]]));
+			}
+		}
+	}
+}
+
+//Welds the vertices of consecutive slabs. Only vertices on the bottom layer of a slab are shared (with the slab below).
+class SlabWelder
+{
+public:
+
+	explicit SlabWelder(const Eigen::Vector3i& numSamples) :
+		_layerSize((int64_t)numSamples.x() * numSamples.y()),
+		_numVertices(0)
+	{
+	}
+
+	//Global indices of the slab vertices (cube layers [bottom, top)). 
+	//Vertices that are not shared get the next indices, newVertices holds them in order.
+	std::vector<int64_t> add(const MarchingCubesSlab& slab, int bottom, int top, std::vector<int>& newVertices)
+	{
+		std::vector<int64_t> vertexIndices(slab.vertices.size());
+		GridEdgeMap layerVertices;
+		newVertices.clear();
+
+		for (int i = 0; i < slab.vertices.size(); ++i)
+		{
+			const GridEdge& edge = slab.edges[i];
+			int64_t z0 = edge.first / _layerSize, z1 = edge.second / _layerSize;
+
+			auto it = z0 == bottom && z1 == bottom ? _prevLayerVertices.find(edge) : _prevLayerVertices.end();
+			if (it != _prevLayerVertices.end())
+			{
+				vertexIndices[i] = it->second;
+			}
+			else
+			{
+				vertexIndices[i] = _numVertices++;
+				newVertices.push_back(i);
+			}
+
+			if (z0 == top && z1 == top)
+				layerVertices[edge] = vertexIndices[i];
+		}
+
+		std::swap(_prevLayerVertices, layerVertices);
+
+		return vertexIndices;
+	}
+
+private:
+
+	int64_t _layerSize;
+	int64_t _numVertices;
+	GridEdgeMap _prevLayerVertices;
+};
+
+//Sample points of the layers [z0, z1], x fastest.
+Eigen::MatrixXd layerPoints(const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, int z0, int z1)
+{
+	Eigen::MatrixXd points((z1 - z0 + 1) * numSamples.x() * numSamples.y(), 3);
+	for (int z = z0; z <= z1; ++z)
+	{
+		for (int y = 0; y < numSamples.y(); ++y)
+		{
+			for (int x = 0; x < numSamples.x(); ++x)
+			{
+				int idx = numSamples(0) * numSamples(1) * (z - z0) + numSamples(0) * y + x;
+				points.row(idx) << (double)x * stepSize(0) + min(0), (double)y * stepSize(1) + min(1), (double)z * stepSize(2) + min(2);
+			}
+		}
+	}
+
+	return points;
+}
+
+Mesh lmu::marchingCubes(const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, int slabSize, const SlabSampler& sample)
+{
+	Mesh mesh;
+	mesh.vertices = Eigen::MatrixXd(0, 3);
+	mesh.indices = Eigen::MatrixXi(0, 3);
+
+	if (numSamples.minCoeff() < 2)
+		return mesh;
+
+	int numLayers = numSamples.z() - 1;
+	int numSlabs = (numLayers + slabSize - 1) / slabSize;
+	std::vector<MarchingCubesSlab> slabs(numSlabs);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int s = 0; s < numSlabs; ++s)
+	{
+		int z0 = s * slabSize;
+		int z1 = std::min(z0 + slabSize, numLayers);
+
+		Eigen::MatrixXd points = layerPoints(numSamples, min, stepSize, z0, z1);
+
+		polygonizeSlab(sample(z0, z1, points), points, numSamples, z0, z1, slabs[s]);
+	}
+
+	//Weld in slab order.
+	SlabWelder welder(numSamples);
+	std::vector<Eigen::Vector3d> vertices;
+	std::vector<Eigen::Vector3i> indices;
+	std::vector<int> newVertices;
+
+	for (int s = 0; s < numSlabs; ++s)
+	{
+		const MarchingCubesSlab& slab = slabs[s];
+		std::vector<int64_t> vertexIndices = welder.add(slab, s * slabSize, std::min((s + 1) * slabSize, numLayers), newVertices);
+
+		for (int i : newVertices)
+			vertices.push_back(slab.vertices[i]);
+
+		for (const auto& tri : slab.triangles)
+			indices.push_back(Eigen::Vector3i(vertexIndices[tri.x()], vertexIndices[tri.y()], vertexIndices[tri.z()]));
+	}
+
+	mesh.vertices.resize(vertices.size(), 3);
+	for (int i = 0; i < vertices.size(); ++i)
+		mesh.vertices.row(i) = vertices[i].transpose();
+
+	mesh.indices.resize(indices.size(), 3);
+	for (int i = 0; i < indices.size(); ++i)
+		mesh.indices.row(i) = indices[i].transpose();
+
+	return mesh;
+}
+
+int64_t lmu::marchingCubesToOBJ(const Eigen::Vector3i& numSamples, const Eigen::Vector3d& min, const Eigen::Vector3d& stepSize, const SlabSampler& sample, const std::string& file)
+{
+	std::ofstream f(file);
+	if (!f)
+		throw std::runtime_error("Could not open '" + file + "'.");
+
+	f << std::setprecision(10);
+
+	int64_t numTriangles = 0;
+
+	if (numSamples.minCoeff() >= 2)
+	{
+		SlabWelder welder(numSamples);
+		std::vector<int> newVertices;
+
+		//Two layers of samples: the bottom one (kept from the last step) and the newly sampled top one.
+		const int layerSize = numSamples.x() * numSamples.y();
+		Eigen::MatrixXd points(2 * layerSize, 3);
+		Eigen::VectorXd values(2 * layerSize);
+
+		points.topRows(layerSize) = layerPoints(numSamples, min, stepSize, 0, 0);
+		values.head(layerSize) = sample(0, 0, points.topRows(layerSize));
+
+		for (int z = 1; z < numSamples.z(); ++z)
+		{
+			if (z > 1)
+			{
+				points.topRows(layerSize) = points.bottomRows(layerSize);
+				values.head(layerSize) = values.tail(layerSize);
+			}
+
+			points.bottomRows(layerSize) = layerPoints(numSamples, min, stepSize, z, z);
+			values.tail(layerSize) = sample(z, z, points.bottomRows(layerSize));
+
+			MarchingCubesSlab slab;
+			polygonizeSlab(values, points, numSamples, z - 1, z, slab);
+
+			std::vector<int64_t> vertexIndices = welder.add(slab, z - 1, z, newVertices);
+
+			for (int i : newVertices)
+				f << "v " << slab.vertices[i].x() << " " << slab.vertices[i].y() << " " << slab.vertices[i].z() << "\n";
+
+			//OBJ indices are 1-based.
+			for (const auto& tri : slab.triangles)
+				f << "f " << vertexIndices[tri.x()] + 1 << " " << vertexIndices[tri.y()] + 1 << " " << vertexIndices[tri.z()] + 1 << "\n";
+
+			numTriangles += slab.triangles.size();
+		}
+	}
+
+	f.close();
+	if (!f)
+		throw std::runtime_error("Could not write '" + file + "'.");
+
+	return numTriangles;
+}
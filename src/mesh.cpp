@@ -7,6 +7,8 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <map>
+#include <mutex>
 
 #include <igl/readOBJ.h>
 #include <igl/signed_distance.h>
@@ -29,6 +31,45 @@ void lmu::transform(Mesh& mesh)
 	}
 }
 
+std::shared_ptr<const Mesh> lmu::sharedPrimitiveMesh(const std::vector<double>& key, const std::function<Mesh()>& create)
+{
+	static std::mutex mutex;
+	static std::map<std::vector<double>, std::weak_ptr<const Mesh>> pool;
+	static size_t pruneSize = 64;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = pool.find(key);
+		if (it != pool.end())
+		{
+			if (auto mesh = it->second.lock())
+				return mesh;
+		}
+	}
+
+	//Tessellated without holding the lock. If another thread was faster, its mesh is used.
+	auto mesh = std::make_shared<const Mesh>(create());
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto& entry = pool[key];
+	if (auto existing = entry.lock())
+		return existing;
+	entry = mesh;
+
+	//Entries of released meshes are removed whenever the pool has doubled in size.
+	if (pool.size() > pruneSize)
+	{
+		for (auto it = pool.begin(); it != pool.end();)
+			it = it->second.expired() ? pool.erase(it) : std::next(it);
+
+		pruneSize = std::max<size_t>(64, 2 * pool.size());
+	}
+
+	return mesh;
+}
+
 //
 // Following code for geometry generation derived from: 
 // 
@@ -0,0 +1,481 @@
+#include "../include/mesh.h"
+#include "../include/pointcloud.h"
+
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <boost/functional/hash.hpp>
+
+using namespace lmu;
+
+//Binary PLY (little endian) and STL files. Data is written from and read into contiguous buffers of ChunkSize records.
+
+static const int ChunkSize = 1 << 16;
+
+bool isLittleEndian()
+{
+	const uint16_t one = 1;
+	return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+
+std::ofstream openBinaryOutput(const std::string& file)
+{
+	if (!isLittleEndian())
+		throw std::runtime_error("Binary files are only supported on little endian platforms.");
+
+	std::ofstream f(file, std::ios::binary);
+	if (!f)
+		throw std::runtime_error("Could not open '" + file + "'.");
+
+	return f;
+}
+
+std::ifstream openBinaryInput(const std::string& file)
+{
+	if (!isLittleEndian())
+		throw std::runtime_error("Binary files are only supported on little endian platforms.");
+
+	std::ifstream f(file, std::ios::binary);
+	if (!f)
+		throw std::runtime_error("Could not open '" + file + "'.");
+
+	return f;
+}
+
+void closeBinaryOutput(std::ofstream& f, const std::string& file)
+{
+	f.close();
+	if (!f)
+		throw std::runtime_error("Could not write '" + file + "'.");
+}
+
+template<typename T>
+inline void append(std::vector<char>& buffer, const T& v)
+{
+	const char* p = reinterpret_cast<const char*>(&v);
+	buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+void readBlock(std::ifstream& f, char* data, size_t size, const std::string& file)
+{
+	f.read(data, size);
+	if (f.gcount() != size)
+		throw std::runtime_error("Unexpected end of '" + file + "'.");
+}
+
+// PLY
+
+enum class PLYType
+{
+	Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+};
+
+struct PLYProperty
+{
+	std::string name;
+	PLYType type;
+	bool isList;
+	PLYType countType; //Only for list properties.
+};
+
+struct PLYElement
+{
+	std::string name;
+	int64_t count;
+	std::vector<PLYProperty> properties;
+};
+
+PLYType plyType(const std::string& type, const std::string& file)
+{
+	if (type == "char" || type == "int8") return PLYType::Int8;
+	if (type == "uchar" || type == "uint8") return PLYType::UInt8;
+	if (type == "short" || type == "int16") return PLYType::Int16;
+	if (type == "ushort" || type == "uint16") return PLYType::UInt16;
+	if (type == "int" || type == "int32") return PLYType::Int32;
+	if (type == "uint" || type == "uint32") return PLYType::UInt32;
+	if (type == "float" || type == "float32") return PLYType::Float32;
+	if (type == "double" || type == "float64") return PLYType::Float64;
+
+	throw std::runtime_error("Unknown PLY type '" + type + "' in '" + file + "'.");
+}
+
+int plyTypeSize(PLYType type)
+{
+	switch (type)
+	{
+	case PLYType::Int8: case PLYType::UInt8:
+		return 1;
+	case PLYType::Int16: case PLYType::UInt16:
+		return 2;
+	case PLYType::Int32: case PLYType::UInt32: case PLYType::Float32:
+		return 4;
+	default:
+		return 8;
+	}
+}
+
+template<typename T>
+inline double plyValue(const char* p)
+{
+	T v;
+	std::memcpy(&v, p, sizeof(T));
+	return v;
+}
+
+inline double plyValue(const char* p, PLYType type)
+{
+	switch (type)
+	{
+	case PLYType::Int8: return plyValue<int8_t>(p);
+	case PLYType::UInt8: return plyValue<uint8_t>(p);
+	case PLYType::Int16: return plyValue<int16_t>(p);
+	case PLYType::UInt16: return plyValue<uint16_t>(p);
+	case PLYType::Int32: return plyValue<int32_t>(p);
+	case PLYType::UInt32: return plyValue<uint32_t>(p);
+	case PLYType::Float32: return plyValue<float>(p);
+	default: return plyValue<double>(p);
+	}
+}
+
+std::vector<PLYElement> readPLYHeader(std::ifstream& f, const std::string& file)
+{
+	std::string line;
+	if (!std::getline(f, line) || line.substr(0, 3) != "ply")
+		throw std::runtime_error("'" + file + "' is not a PLY file.");
+
+	std::vector<PLYElement> elements;
+	while (std::getline(f, line))
+	{
+		std::istringstream ss(line);
+		std::string keyword;
+		ss >> keyword;
+
+		if (keyword == "format")
+		{
+			std::string format;
+			ss >> format;
+			if (format != "binary_little_endian")
+				throw std::runtime_error("Only binary little endian PLY files are supported ('" + file + "' is " + format + ").");
+		}
+		else if (keyword == "element")
+		{
+			PLYElement element;
+			ss >> element.name >> element.count;
+			elements.push_back(element);
+		}
+		else if (keyword == "property")
+		{
+			if (elements.empty())
+				throw std::runtime_error("Property without element in '" + file + "'.");
+
+			PLYProperty property;
+			std::string type, countType;
+			ss >> type;
+
+			property.isList = type == "list";
+			if (property.isList)
+			{
+				ss >> countType >> type;
+				property.countType = plyType(countType, file);
+			}
+			property.type = plyType(type, file);
+			ss >> property.name;
+
+			elements.back().properties.push_back(property);
+		}
+		else if (keyword == "end_header")
+		{
+			return elements;
+		}
+	}
+
+	throw std::runtime_error("'" + file + "' has no end_header.");
+}
+
+//Reads an element without list properties. The values of the properties in names are stored in the columns of res 
+//in the order of names (missing properties stay 0).
+Eigen::MatrixXd readPLYScalars(std::ifstream& f, const PLYElement& element, const std::vector<std::string>& names, const std::string& file)
+{
+	std::vector<std::tuple<int, int, PLYType>> fields; //Offset in the record, column, type.
+	int recordSize = 0;
+	for (const auto& property : element.properties)
+	{
+		if (property.isList)
+			throw std::runtime_error("List property '" + property.name + "' of '" + element.name + "' is not supported in '" + file + "'.");
+
+		auto it = std::find(names.begin(), names.end(), property.name);
+		if (it != names.end())
+			fields.push_back(std::make_tuple(recordSize, (int)(it - names.begin()), property.type));
+
+		recordSize += plyTypeSize(property.type);
+	}
+
+	Eigen::MatrixXd res = Eigen::MatrixXd::Zero(element.count, names.size());
+
+	std::vector<char> buffer;
+	for (int64_t start = 0; start < element.count; start += ChunkSize)
+	{
+		int64_t n = std::min((int64_t)ChunkSize, element.count - start);
+		buffer.resize(n * recordSize);
+		readBlock(f, buffer.data(), buffer.size(), file);
+
+		for (int64_t i = 0; i < n; ++i)
+		{
+			for (const auto& field : fields)
+				res(start + i, std::get<1>(field)) = plyValue(buffer.data() + i * recordSize + std::get<0>(field), std::get<2>(field));
+		}
+	}
+
+	return res;
+}
+
+//Reads a face element with a single list property (vertex_indices or vertex_index) of triangles.
+Eigen::MatrixXi readPLYTriangles(std::ifstream& f, const PLYElement& element, const std::string& file)
+{
+	if (element.properties.size() != 1 || !element.properties[0].isList)
+		throw std::runtime_error("Faces of '" + file + "' must have exactly one list property.");
+
+	const PLYProperty& property = element.properties[0];
+	int countSize = plyTypeSize(property.countType);
+	int indexSize = plyTypeSize(property.type);
+
+	//With triangles only, all records have the same size.
+	int recordSize = countSize + 3 * indexSize;
+
+	Eigen::MatrixXi res(element.count, 3);
+
+	std::vector<char> buffer;
+	for (int64_t start = 0; start < element.count; start += ChunkSize)
+	{
+		int64_t n = std::min((int64_t)ChunkSize, element.count - start);
+		buffer.resize(n * recordSize);
+		readBlock(f, buffer.data(), buffer.size(), file);
+
+		for (int64_t i = 0; i < n; ++i)
+		{
+			const char* record = buffer.data() + i * recordSize;
+			if (plyValue(record, property.countType) != 3)
+				throw std::runtime_error("Only triangles are supported in '" + file + "'.");
+
+			for (int j = 0; j < 3; ++j)
+				res(start + i, j) = (int)plyValue(record + countSize + j * indexSize, property.type);
+		}
+	}
+
+	return res;
+}
+
+void lmu::writePointCloudPLY(const std::string& file, const PointCloud& points)
+{
+	std::ofstream f = openBinaryOutput(file);
+
+	f << "ply\nformat binary_little_endian 1.0\n"
+		<< "element vertex " << points.rows() << "\n"
+		<< "property double x\nproperty double y\nproperty double z\n"
+		<< "property double nx\nproperty double ny\nproperty double nz\n"
+		<< "end_header\n";
+
+	//PointCloud is row-major, so the rows are the vertex records.
+	for (int64_t start = 0; start < points.rows(); start += ChunkSize)
+	{
+		int64_t n = std::min((int64_t)ChunkSize, (int64_t)points.rows() - start);
+		f.write(reinterpret_cast<const char*>(points.data() + start * 6), n * 6 * sizeof(double));
+	}
+
+	closeBinaryOutput(f, file);
+}
+
+lmu::PointCloud lmu::readPointCloudPLY(const std::string& file, double scaleFactor)
+{
+	std::ifstream f = openBinaryInput(file);
+
+	PointCloud points;
+	for (const auto& element : readPLYHeader(f, file))
+	{
+		if (element.name != "vertex")
+			throw std::runtime_error("Unexpected element '" + element.name + "' in point cloud '" + file + "'.");
+
+		points = readPLYScalars(f, element, { "x", "y", "z", "nx", "ny", "nz" }, file);
+		points.leftCols(3) *= scaleFactor;
+	}
+
+	return points;
+}
+
+void lmu::writeMeshPLY(const std::string& file, const Mesh& mesh)
+{
+	std::ofstream f = openBinaryOutput(file);
+
+	bool hasNormals = mesh.normals.rows() == mesh.vertices.rows() && mesh.normals.cols() == 3;
+
+	f << "ply\nformat binary_little_endian 1.0\n"
+		<< "element vertex " << mesh.vertices.rows() << "\n"
+		<< "property double x\nproperty double y\nproperty double z\n";
+	if (hasNormals)
+		f << "property double nx\nproperty double ny\nproperty double nz\n";
+	f << "element face " << mesh.indices.rows() << "\n"
+		<< "property list uchar int vertex_indices\n"
+		<< "end_header\n";
+
+	//Vertices and normals are column-major, records are assembled per chunk.
+	std::vector<char> buffer;
+	for (int64_t start = 0; start < mesh.vertices.rows(); start += ChunkSize)
+	{
+		int64_t end = std::min(start + ChunkSize, (int64_t)mesh.vertices.rows());
+
+		buffer.clear();
+		for (int64_t i = start; i < end; ++i)
+		{
+			for (int j = 0; j < 3; ++j)
+				append(buffer, mesh.vertices(i, j));
+			for (int j = 0; hasNormals && j < 3; ++j)
+				append(buffer, mesh.normals(i, j));
+		}
+		f.write(buffer.data(), buffer.size());
+	}
+
+	for (int64_t start = 0; start < mesh.indices.rows(); start += ChunkSize)
+	{
+		int64_t end = std::min(start + ChunkSize, (int64_t)mesh.indices.rows());
+
+		buffer.clear();
+		for (int64_t i = start; i < end; ++i)
+		{
+			append(buffer, (uint8_t)3);
+			for (int j = 0; j < 3; ++j)
+				append(buffer, (int32_t)mesh.indices(i, j));
+		}
+		f.write(buffer.data(), buffer.size());
+	}
+
+	closeBinaryOutput(f, file);
+}
+
+Mesh lmu::fromPLYFile(const std::string& file)
+{
+	std::ifstream f = openBinaryInput(file);
+
+	Mesh mesh;
+	mesh.vertices = Eigen::MatrixXd(0, 3);
+	mesh.indices = Eigen::MatrixXi(0, 3);
+
+	for (const auto& element : readPLYHeader(f, file))
+	{
+		if (element.name == "vertex")
+		{
+			bool hasNormals = std::any_of(element.properties.begin(), element.properties.end(), [](const PLYProperty& p) { return p.name == "nx"; });
+
+			Eigen::MatrixXd vertices = readPLYScalars(f, element, { "x", "y", "z", "nx", "ny", "nz" }, file);
+			mesh.vertices = vertices.leftCols(3);
+			if (hasNormals)
+				mesh.normals = vertices.rightCols(3);
+		}
+		else if (element.name == "face")
+		{
+			mesh.indices = readPLYTriangles(f, element, file);
+		}
+		else
+		{
+			//Other elements are skipped.
+			readPLYScalars(f, element, {}, file);
+		}
+	}
+
+	return mesh;
+}
+
+// STL
+
+void lmu::writeMeshSTL(const std::string& file, const Mesh& mesh)
+{
+	std::ofstream f = openBinaryOutput(file);
+
+	char header[80] = {};
+	std::strncpy(header, "lmu::writeMeshSTL", sizeof(header));
+	f.write(header, sizeof(header));
+
+	uint32_t numTriangles = mesh.indices.rows();
+	f.write(reinterpret_cast<const char*>(&numTriangles), sizeof(numTriangles));
+
+	//Each record is the face normal, the three vertices (as floats) and an unused attribute.
+	std::vector<char> buffer;
+	for (int64_t start = 0; start < mesh.indices.rows(); start += ChunkSize)
+	{
+		int64_t end = std::min(start + ChunkSize, (int64_t)mesh.indices.rows());
+
+		buffer.clear();
+		for (int64_t i = start; i < end; ++i)
+		{
+			Eigen::Vector3d v0 = mesh.vertices.row(mesh.indices(i, 0)).transpose();
+			Eigen::Vector3d v1 = mesh.vertices.row(mesh.indices(i, 1)).transpose();
+			Eigen::Vector3d v2 = mesh.vertices.row(mesh.indices(i, 2)).transpose();
+
+			Eigen::Vector3f n = (v1 - v0).cross(v2 - v0).normalized().cast<float>();
+			for (const Eigen::Vector3f& v : { n, Eigen::Vector3f(v0.cast<float>()), Eigen::Vector3f(v1.cast<float>()), Eigen::Vector3f(v2.cast<float>()) })
+				for (int j = 0; j < 3; ++j)
+					append(buffer, v(j));
+
+			append(buffer, (uint16_t)0);
+		}
+		f.write(buffer.data(), buffer.size());
+	}
+
+	closeBinaryOutput(f, file);
+}
+
+Mesh lmu::fromSTLFile(const std::string& file)
+{
+	std::ifstream f = openBinaryInput(file);
+
+	char header[80];
+	readBlock(f, header, sizeof(header), file);
+
+	uint32_t numTriangles;
+	readBlock(f, reinterpret_cast<char*>(&numTriangles), sizeof(numTriangles), file);
+
+	//STL stores the vertices per triangle, equal vertices are merged.
+	typedef std::tuple<float, float, float> Vertex;
+	std::unordered_map<Vertex, int, boost::hash<Vertex>> vertexIndices;
+	std::vector<Eigen::Vector3d> vertices;
+
+	Mesh mesh;
+	mesh.indices.resize(numTriangles, 3);
+
+	const int recordSize = 50;
+	std::vector<char> buffer;
+	for (int64_t start = 0; start < numTriangles; start += ChunkSize)
+	{
+		int64_t n = std::min((int64_t)ChunkSize, (int64_t)numTriangles - start);
+		buffer.resize(n * recordSize);
+		readBlock(f, buffer.data(), buffer.size(), file);
+
+		for (int64_t i = 0; i < n; ++i)
+		{
+			float v[12];
+			std::memcpy(v, buffer.data() + i * recordSize, sizeof(v));
+
+			for (int j = 0; j < 3; ++j)
+			{
+				Vertex vertex(v[3 + 3 * j], v[4 + 3 * j], v[5 + 3 * j]);
+
+				auto it = vertexIndices.insert(std::make_pair(vertex, (int)vertices.size()));
+				if (it.second)
+					vertices.push_back(Eigen::Vector3d(std::get<0>(vertex), std::get<1>(vertex), std::get<2>(vertex)));
+
+				mesh.indices(start + i, j) = it.first->second;
+			}
+		}
+	}
+
+	mesh.vertices.resize(vertices.size(), 3);
+	for (int i = 0; i < vertices.size(); ++i)
+		mesh.vertices.row(i) = vertices[i].transpose();
+
+	return mesh;
+}
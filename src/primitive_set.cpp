@@ -0,0 +1,185 @@
+#include "../include/primitive_set.h"
+
+#include <numeric>
+#include <algorithm>
+
+using namespace lmu;
+
+bool lmu::Primitive::fromFunction(const ImplicitFunction& function, Primitive& primitive)
+{
+	primitive.type = function.type();
+	primitive.displacement = 0.0;
+	std::fill(primitive.params, primitive.params + MaxParameters, 0.0);
+
+	//Same inverse as the facade.
+	Eigen::Matrix<double, 3, 4, Eigen::RowMajor> invTrans = function.transform().inverse().matrix().topRows(3);
+	std::copy(invTrans.data(), invTrans.data() + 12, primitive.invTrans);
+
+	switch (primitive.type)
+	{
+	case ImplicitFunctionType::Sphere:
+	{
+		auto sphere = dynamic_cast<const IFSphere*>(&function);
+		if (!sphere)
+			return false;
+
+		primitive.params[0] = sphere->radius();
+		primitive.displacement = sphere->displacement();
+		return true;
+	}
+	case ImplicitFunctionType::Box:
+	{
+		auto box = dynamic_cast<const IFBox*>(&function);
+		if (!box)
+			return false;
+
+		Eigen::Vector3d halfSize = box->size() / 2.0;
+		std::copy(halfSize.data(), halfSize.data() + 3, primitive.params);
+		primitive.displacement = box->displacement();
+		return true;
+	}
+	case ImplicitFunctionType::Cylinder:
+	{
+		auto cylinder = dynamic_cast<const IFCylinder*>(&function);
+		if (!cylinder)
+			return false;
+
+		primitive.params[0] = cylinder->radius();
+		primitive.params[1] = cylinder->height() / 2.0;
+		return true;
+	}
+	case ImplicitFunctionType::Cone:
+	{
+		auto cone = dynamic_cast<const IFCone*>(&function);
+		if (!cone)
+			return false;
+
+		Eigen::Vector3d c = cone->c();
+		std::copy(c.data(), c.data() + 3, primitive.params);
+		return true;
+	}
+	case ImplicitFunctionType::Null:
+		return dynamic_cast<const IFNull*>(&function) != nullptr;
+	default:
+		return false;
+	}
+}
+
+lmu::PrimitiveSet::PrimitiveSet(const std::vector<std::shared_ptr<ImplicitFunction>>& functions)
+{
+	convert(functions, nullptr);
+}
+
+lmu::PrimitiveSet::PrimitiveSet(const std::vector<std::shared_ptr<ImplicitFunction>>& functions, const PrimitiveSet& converted)
+{
+	convert(functions, &converted);
+}
+
+void lmu::PrimitiveSet::convert(const std::vector<std::shared_ptr<ImplicitFunction>>& functions, const PrimitiveSet* converted)
+{
+	std::vector<int> order(functions.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&functions](int i0, int i1) { return functions[i0]->type() < functions[i1]->type(); });
+
+	for (int i : order)
+	{
+		Primitive primitive;
+		bool found = false;
+		if (converted)
+		{
+			auto it = converted->_lookup.find(functions[i].get());
+			if (it != converted->_lookup.end())
+			{
+				primitive = converted->_primitives[it->second];
+				found = true;
+			}
+		}
+
+		if (found || Primitive::fromFunction(*functions[i], primitive))
+		{
+			_lookup[functions[i].get()] = _primitives.size();
+			_primitives.push_back(primitive);
+			_indices.push_back(i);
+		}
+		else
+		{
+			_fallbacks.push_back(std::make_pair(i, functions[i]));
+		}
+	}
+}
+
+template<typename Scalar>
+SDFKernel<Scalar> kernelFor(ImplicitFunctionType type)
+{
+	const auto& kernels = sdfKernels().get<Scalar>();
+
+	switch (type)
+	{
+	case ImplicitFunctionType::Sphere:
+		return kernels.sphere;
+	case ImplicitFunctionType::Box:
+		return kernels.box;
+	case ImplicitFunctionType::Cylinder:
+		return kernels.cylinder;
+	case ImplicitFunctionType::Cone:
+		return kernels.cone;
+	default:
+		return nullptr;
+	}
+}
+
+template<typename Scalar>
+std::vector<Eigen::Matrix<Scalar, Eigen::Dynamic, 1>> lmu::PrimitiveSet::signedDistances(const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& ps) const
+{
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+	std::vector<Vector> res(_primitives.size() + _fallbacks.size());
+
+	SDFKernel<Scalar> k = nullptr;
+	for (int i = 0; i < _primitives.size(); ++i)
+	{
+		const Primitive& p = _primitives[i];
+		Vector& d = res[_indices[i]];
+
+		if (i == 0 || p.type != _primitives[i - 1].type)
+			k = kernelFor<Scalar>(p.type);
+
+		if (!k)
+		{
+			d = Vector::Zero(ps.rows());
+			continue;
+		}
+
+		//Columns of ps are the SoA coordinate arrays.
+		d.resize(ps.rows());
+		k(ps.col(0).data(), ps.col(1).data(), ps.col(2).data(), ps.rows(), p.invTrans, p.params, d.data());
+
+		if (p.displacement != 0.0)
+		{
+			//Same expression as ImplicitFunction::displacements().
+			Eigen::Affine3d invTrans = Eigen::Affine3d::Identity();
+			invTrans.matrix().topRows(3) = Eigen::Map<const Eigen::Matrix<double, 3, 4, Eigen::RowMajor>>(p.invTrans);
+
+			Eigen::MatrixXd localPs = (ps.template cast<double>() * invTrans.linear().transpose()).rowwise() + invTrans.translation().transpose();
+			d += ((p.displacement * localPs.col(0)).array().sin() * (p.displacement * localPs.col(1)).array().sin() * (p.displacement * localPs.col(2)).array().sin()).matrix().template cast<Scalar>();
+		}
+	}
+
+	for (const auto& f : _fallbacks)
+		res[f.first] = f.second->signedDistances(ps);
+
+	return res;
+}
+
+int lmu::PrimitiveSet::size() const
+{
+	return _primitives.size() + _fallbacks.size();
+}
+
+int lmu::PrimitiveSet::numFallbacks() const
+{
+	return _fallbacks.size();
+}
+
+template std::vector<Eigen::VectorXd> lmu::PrimitiveSet::signedDistances<double>(const Eigen::MatrixXd& ps) const;
+template std::vector<Eigen::VectorXf> lmu::PrimitiveSet::signedDistances<float>(const Eigen::MatrixXf& ps) const;
@@ -314,33 +314,38 @@ double lmu::ransacWithSim(const PointCloud& points, const CSGNodeSamplingParams&
 	size_t usedPoints = 0;
 	double cosMaxAngleDistance = std::cos(params.maxAngleDistance);
 
-	for (int i = 0; i < points.rows(); ++i)
-	{
-		accessedPoints++;
+	//Evaluate each function for all points at once and keep track of the best function per point.
+	Eigen::MatrixXd ps = points.leftCols(3);
+	std::vector<lmu::ImplicitFunctionPtr> curFuncs(points.rows(), nullptr);
+	std::vector<double> curMaxDeltas(points.rows(), std::numeric_limits<double>::max());
 
-		lmu::ImplicitFunctionPtr curFunc = nullptr;
-		double curMaxDelta = std::numeric_limits<double>::max();
+	for (auto const& func : knownFunctions)
+	{
+		Eigen::MatrixXd vs = func->signedDistanceAndGradients(ps);
 
-		for (auto const& func : knownFunctions)
+		for (int i = 0; i < points.rows(); ++i)
 		{
-			Eigen::Vector3d p = points.row(i).leftCols(3).transpose();
 			Eigen::Vector3d n = points.row(i).rightCols(3).transpose();
-			
-			Eigen::Vector4d v = func->signedDistanceAndGradient(p);
-			double absD = std::abs(v[0]);			
-			Eigen::Vector3d g = v.bottomRows(3).transpose();
+
+			double absD = std::abs(vs(i, 0));
+			Eigen::Vector3d g = vs.row(i).rightCols(3).transpose();
 			double absDAngleCos = std::abs(n.dot(g));
 
-			if (absD <= params.maxDistance + 3.0 * params.errorSigma && absDAngleCos > cosMaxAngleDistance && absD < curMaxDelta)
+			if (absD <= params.maxDistance + 3.0 * params.errorSigma && absDAngleCos > cosMaxAngleDistance && absD < curMaxDeltas[i])
 			{
-				curMaxDelta = absD;
-				curFunc = func;
+				curMaxDeltas[i] = absD;
+				curFuncs[i] = func;
 			}
 		}
+	}
+
+	for (int i = 0; i < points.rows(); ++i)
+	{
+		accessedPoints++;
 
-		if (curFunc)
+		if (curFuncs[i])
 		{			
-			pointsAndNormalsMap[curFunc].push_back(points.row(i));
+			pointsAndNormalsMap[curFuncs[i]].push_back(points.row(i));
 			usedPoints++;
 		}
 	}
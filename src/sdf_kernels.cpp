@@ -0,0 +1,165 @@
+#include "../include/sdf_kernels.h"
+#include "../include/sdf_primitives.h"
+
+#include <algorithm>
+
+#if defined(CSG_PLAYGROUND_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace lmu;
+
+template<typename Scalar, typename Eval>
+void runScalarKernel(const Scalar* x, const Scalar* y, const Scalar* z, int n, const double* m, Scalar* out, Eval eval)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		Scalar lx, ly, lz;
+		sdf::transformPoint(x[i], y[i], z[i], m, lx, ly, lz);
+		out[i] = eval(lx, ly, lz);
+	}
+}
+
+template<typename Scalar>
+void sphereKernelScalar(const Scalar* x, const Scalar* y, const Scalar* z, int n, const double* m, const double* params, Scalar* out)
+{
+	runScalarKernel(x, y, z, n, m, out, [params](Scalar lx, Scalar ly, Scalar lz) { return sdf::sphereDistance(lx, ly, lz, params[0]); });
+}
+
+template<typename Scalar>
+void boxKernelScalar(const Scalar* x, const Scalar* y, const Scalar* z, int n, const double* m, const double* params, Scalar* out)
+{
+	runScalarKernel(x, y, z, n, m, out, [params](Scalar lx, Scalar ly, Scalar lz) { return sdf::boxDistance(lx, ly, lz, params[0], params[1], params[2]); });
+}
+
+template<typename Scalar>
+void cylinderKernelScalar(const Scalar* x, const Scalar* y, const Scalar* z, int n, const double* m, const double* params, Scalar* out)
+{
+	runScalarKernel(x, y, z, n, m, out, [params](Scalar lx, Scalar ly, Scalar lz) { return sdf::cylinderDistance(lx, ly, lz, params[0], params[1]); });
+}
+
+template<typename Scalar>
+void coneKernelScalar(const Scalar* x, const Scalar* y, const Scalar* z, int n, const double* m, const double* params, Scalar* out)
+{
+	runScalarKernel(x, y, z, n, m, out, [params](Scalar lx, Scalar ly, Scalar lz) { return sdf::coneDistance(lx, ly, lz, params[0], params[1], params[2]); });
+}
+
+template<typename Scalar>
+SDFKernelSet<Scalar> scalarKernelSet()
+{
+	SDFKernelSet<Scalar> set;
+	set.sphere = sphereKernelScalar<Scalar>;
+	set.box = boxKernelScalar<Scalar>;
+	set.cylinder = cylinderKernelScalar<Scalar>;
+	set.cone = coneKernelScalar<Scalar>;
+
+	return set;
+}
+
+std::string lmu::simdLevelToString(SIMDLevel level)
+{
+	switch (level)
+	{
+	case SIMDLevel::Scalar:
+		return "Scalar";
+	case SIMDLevel::AVX2:
+		return "AVX2";
+	case SIMDLevel::AVX512:
+		return "AVX512";
+	default:
+		return "Undefined Level";
+	}
+}
+
+std::string lmu::precisionToString(Precision precision)
+{
+	switch (precision)
+	{
+	case Precision::Double:
+		return "Double";
+	case Precision::Float:
+		return "Float";
+	default:
+		return "Undefined Precision";
+	}
+}
+
+Precision lmu::precisionFromString(std::string precision)
+{
+	std::transform(precision.begin(), precision.end(), precision.begin(), ::tolower);
+
+	if (precision == "float")
+		return Precision::Float;
+
+	return Precision::Double;
+}
+
+SIMDLevel lmu::detectSIMDLevel()
+{
+#if defined(CSG_PLAYGROUND_SIMD) && defined(_MSC_VER)
+
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return SIMDLevel::Scalar;
+
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx)
+		return SIMDLevel::Scalar;
+
+	//Check that the OS saves the ymm (and zmm) registers.
+	unsigned long long xcr0 = _xgetbv(0);
+	bool ymmState = (xcr0 & 0x6) == 0x6;
+	bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	bool avx512f = (info[1] & (1 << 16)) != 0;
+
+	if (avx512f && zmmState)
+		return SIMDLevel::AVX512;
+	if (avx2 && ymmState)
+		return SIMDLevel::AVX2;
+
+#elif defined(CSG_PLAYGROUND_SIMD) && defined(__GNUC__)
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SIMDLevel::AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SIMDLevel::AVX2;
+
+#endif
+
+	return SIMDLevel::Scalar;
+}
+
+SDFKernels lmu::sdfKernels(SIMDLevel level)
+{
+#ifdef CSG_PLAYGROUND_SIMD
+	switch (level)
+	{
+	case SIMDLevel::AVX512:
+		return sdfKernelsAVX512();
+	case SIMDLevel::AVX2:
+		return sdfKernelsAVX2();
+	default:
+		break;
+	}
+#endif
+
+	SDFKernels kernels;
+	kernels.doubles = scalarKernelSet<double>();
+	kernels.floats = scalarKernelSet<float>();
+	kernels.level = SIMDLevel::Scalar;
+
+	return kernels;
+}
+
+const SDFKernels& lmu::sdfKernels()
+{
+	static const SDFKernels kernels = sdfKernels(detectSIMDLevel());
+	return kernels;
+}
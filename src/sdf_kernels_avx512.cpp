@@ -0,0 +1,183 @@
+// Compiled with AVX-512F enabled (see CMakeLists.txt). The kernels are only selected after a runtime CPU check.
+// Only intrinsics are used here so that no inline function compiled with AVX-512F can leak into the rest of the program.
+
+#include <immintrin.h>
+
+#include "../include/sdf_kernels.h"
+#include "../include/sdf_primitives.h"
+
+using namespace lmu;
+
+namespace
+{
+	// 8 doubles per instruction.
+	struct PackD
+	{
+		typedef double Scalar;
+		static const int width = 8;
+
+		PackD()
+		{
+		}
+
+		PackD(double s) :
+			v(_mm512_set1_pd(s))
+		{
+		}
+
+		PackD(__m512d v) :
+			v(v)
+		{
+		}
+
+		static PackD load(const double* p) { return _mm512_loadu_pd(p); }
+		void store(double* p) const { _mm512_storeu_pd(p, v); }
+
+		__m512d v;
+	};
+
+	// 16 floats per instruction.
+	struct PackF
+	{
+		typedef float Scalar;
+		static const int width = 16;
+
+		PackF()
+		{
+		}
+
+		PackF(double s) :
+			v(_mm512_set1_ps((float)s))
+		{
+		}
+
+		PackF(__m512 v) :
+			v(v)
+		{
+		}
+
+		static PackF load(const float* p) { return _mm512_loadu_ps(p); }
+		void store(float* p) const { _mm512_storeu_ps(p, v); }
+
+		__m512 v;
+	};
+
+	inline PackD operator+(const PackD& a, const PackD& b) { return _mm512_add_pd(a.v, b.v); }
+	inline PackD operator-(const PackD& a, const PackD& b) { return _mm512_sub_pd(a.v, b.v); }
+	inline PackD operator*(const PackD& a, const PackD& b) { return _mm512_mul_pd(a.v, b.v); }
+	inline PackD operator/(const PackD& a, const PackD& b) { return _mm512_div_pd(a.v, b.v); }
+
+	inline PackD vsqr(const PackD& a) { return _mm512_mul_pd(a.v, a.v); }
+	inline PackD vsqrt(const PackD& a) { return _mm512_sqrt_pd(a.v); }
+	inline PackD vabs(const PackD& a) { return _mm512_abs_pd(a.v); }
+	inline PackD vmax(const PackD& a, const PackD& b) { return _mm512_max_pd(a.v, b.v); }
+
+	inline PackD vsign(const PackD& a)
+	{
+		__m512d zero = _mm512_setzero_pd();
+		__m512d one = _mm512_set1_pd(1.0);
+		__mmask8 pos = _mm512_cmp_pd_mask(a.v, zero, _CMP_GT_OQ);
+		__mmask8 neg = _mm512_cmp_pd_mask(a.v, zero, _CMP_LT_OQ);
+		return _mm512_sub_pd(_mm512_maskz_mov_pd(pos, one), _mm512_maskz_mov_pd(neg, one));
+	}
+
+	inline PackF operator+(const PackF& a, const PackF& b) { return _mm512_add_ps(a.v, b.v); }
+	inline PackF operator-(const PackF& a, const PackF& b) { return _mm512_sub_ps(a.v, b.v); }
+	inline PackF operator*(const PackF& a, const PackF& b) { return _mm512_mul_ps(a.v, b.v); }
+	inline PackF operator/(const PackF& a, const PackF& b) { return _mm512_div_ps(a.v, b.v); }
+
+	inline PackF vsqr(const PackF& a) { return _mm512_mul_ps(a.v, a.v); }
+	inline PackF vsqrt(const PackF& a) { return _mm512_sqrt_ps(a.v); }
+	inline PackF vabs(const PackF& a) { return _mm512_abs_ps(a.v); }
+	inline PackF vmax(const PackF& a, const PackF& b) { return _mm512_max_ps(a.v, b.v); }
+
+	inline PackF vsign(const PackF& a)
+	{
+		__m512 zero = _mm512_setzero_ps();
+		__m512 one = _mm512_set1_ps(1.0f);
+		__mmask16 pos = _mm512_cmp_ps_mask(a.v, zero, _CMP_GT_OQ);
+		__mmask16 neg = _mm512_cmp_ps_mask(a.v, zero, _CMP_LT_OQ);
+		return _mm512_sub_ps(_mm512_maskz_mov_ps(pos, one), _mm512_maskz_mov_ps(neg, one));
+	}
+
+	template<typename Pack, typename Eval>
+	inline Pack evalPack(const typename Pack::Scalar* x, const typename Pack::Scalar* y, const typename Pack::Scalar* z, const double* m, Eval eval)
+	{
+		Pack lx, ly, lz;
+		sdf::transformPoint(Pack::load(x), Pack::load(y), Pack::load(z), m, lx, ly, lz);
+		return eval(lx, ly, lz);
+	}
+
+	template<typename Pack, typename Eval>
+	void runKernel(const typename Pack::Scalar* x, const typename Pack::Scalar* y, const typename Pack::Scalar* z, int n, const double* m, typename Pack::Scalar* out, Eval eval)
+	{
+		typedef typename Pack::Scalar Scalar;
+
+		int i = 0;
+		for (; i + Pack::width <= n; i += Pack::width)
+			evalPack<Pack>(x + i, y + i, z + i, m, eval).store(out + i);
+
+		if (i == n)
+			return;
+
+		//Remaining points are padded to a full pack.
+		Scalar bx[Pack::width] = { 0 }, by[Pack::width] = { 0 }, bz[Pack::width] = { 0 }, bout[Pack::width];
+		for (int j = 0; i + j < n; ++j)
+		{
+			bx[j] = x[i + j];
+			by[j] = y[i + j];
+			bz[j] = z[i + j];
+		}
+
+		evalPack<Pack>(bx, by, bz, m, eval).store(bout);
+
+		for (int j = 0; i + j < n; ++j)
+			out[i + j] = bout[j];
+	}
+
+	template<typename Pack>
+	void sphereKernel(const typename Pack::Scalar* x, const typename Pack::Scalar* y, const typename Pack::Scalar* z, int n, const double* m, const double* params, typename Pack::Scalar* out)
+	{
+		runKernel<Pack>(x, y, z, n, m, out, [params](const Pack& lx, const Pack& ly, const Pack& lz) { return sdf::sphereDistance(lx, ly, lz, params[0]); });
+	}
+
+	template<typename Pack>
+	void boxKernel(const typename Pack::Scalar* x, const typename Pack::Scalar* y, const typename Pack::Scalar* z, int n, const double* m, const double* params, typename Pack::Scalar* out)
+	{
+		runKernel<Pack>(x, y, z, n, m, out, [params](const Pack& lx, const Pack& ly, const Pack& lz) { return sdf::boxDistance(lx, ly, lz, params[0], params[1], params[2]); });
+	}
+
+	template<typename Pack>
+	void cylinderKernel(const typename Pack::Scalar* x, const typename Pack::Scalar* y, const typename Pack::Scalar* z, int n, const double* m, const double* params, typename Pack::Scalar* out)
+	{
+		runKernel<Pack>(x, y, z, n, m, out, [params](const Pack& lx, const Pack& ly, const Pack& lz) { return sdf::cylinderDistance(lx, ly, lz, params[0], params[1]); });
+	}
+
+	template<typename Pack>
+	void coneKernel(const typename Pack::Scalar* x, const typename Pack::Scalar* y, const typename Pack::Scalar* z, int n, const double* m, const double* params, typename Pack::Scalar* out)
+	{
+		runKernel<Pack>(x, y, z, n, m, out, [params](const Pack& lx, const Pack& ly, const Pack& lz) { return sdf::coneDistance(lx, ly, lz, params[0], params[1], params[2]); });
+	}
+
+	template<typename Pack>
+	SDFKernelSet<typename Pack::Scalar> kernelSet()
+	{
+		SDFKernelSet<typename Pack::Scalar> set;
+		set.sphere = sphereKernel<Pack>;
+		set.box = boxKernel<Pack>;
+		set.cylinder = cylinderKernel<Pack>;
+		set.cone = coneKernel<Pack>;
+
+		return set;
+	}
+}
+
+SDFKernels lmu::sdfKernelsAVX512()
+{
+	SDFKernels kernels;
+	kernels.doubles = kernelSet<PackD>();
+	kernels.floats = kernelSet<PackF>();
+	kernels.level = SIMDLevel::AVX512;
+
+	return kernels;
+}